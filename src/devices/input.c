@@ -3,7 +3,10 @@
 #include "devices/intq.h"
 #include "devices/serial.h"
 
-/* Stores keys from the keyboard and serial port. */
+/* Stores keys from the keyboard and serial port.  The buffer's
+   own spinlock is all the locking the input device needs: it is
+   held for every check of the buffer and every change to it, and
+   serial_notify() takes the serial port's lock itself. */
 static struct intq buffer;
 
 /* Initializes the input buffer. */
@@ -19,9 +22,11 @@ void
 input_putc (uint8_t key) 
 {
   ASSERT (intr_get_level () == INTR_OFF);
-  ASSERT (!intq_full (&buffer));
 
-  intq_putc (&buffer, key);
+  /* Check for room and add the key in one step, so that two
+     handlers on different CPUs cannot both take the last slot. */
+  if (!intq_try_putc (&buffer, key))
+    PANIC ("input buffer full");
   serial_notify ();
 }
 
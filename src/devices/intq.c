@@ -11,6 +11,7 @@ void
 intq_init (struct intq *q) 
 {
   lock_init (&q->lock);
+  spinlock_init (&q->spin);
   q->not_full = q->not_empty = NULL;
   q->head = q->tail = 0;
 }
@@ -41,10 +42,13 @@ intq_getc (struct intq *q)
   uint8_t byte;
   
   ASSERT (intr_get_level () == INTR_OFF);
+  spinlock_acquire (&q->spin);
   while (intq_empty (q)) 
     {
       ASSERT (!intr_context ());
+      spinlock_release (&q->spin);
       lock_acquire (&q->lock);
+      spinlock_acquire (&q->spin);
       wait (q, &q->not_empty);
       lock_release (&q->lock);
     }
@@ -52,6 +56,7 @@ intq_getc (struct intq *q)
   byte = q->buf[q->tail];
   q->tail = next (q->tail);
   signal (q, &q->not_full);
+  spinlock_release (&q->spin);
   return byte;
 }
 
@@ -63,10 +68,13 @@ void
 intq_putc (struct intq *q, uint8_t byte) 
 {
   ASSERT (intr_get_level () == INTR_OFF);
+  spinlock_acquire (&q->spin);
   while (intq_full (q))
     {
       ASSERT (!intr_context ());
+      spinlock_release (&q->spin);
       lock_acquire (&q->lock);
+      spinlock_acquire (&q->spin);
       wait (q, &q->not_full);
       lock_release (&q->lock);
     }
@@ -74,8 +82,30 @@ intq_putc (struct intq *q, uint8_t byte)
   q->buf[q->head] = byte;
   q->head = next (q->head);
   signal (q, &q->not_empty);
+  spinlock_release (&q->spin);
 }
 
+/* Adds BYTE to the end of Q and returns true, unless Q is full,
+   in which case returns false without waiting.  May be called
+   from an interrupt handler. */
+bool
+intq_try_putc (struct intq *q, uint8_t byte) 
+{
+  bool ok;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  spinlock_acquire (&q->spin);
+  ok = !intq_full (q);
+  if (ok)
+    {
+      q->buf[q->head] = byte;
+      q->head = next (q->head);
+      signal (q, &q->not_empty);
+    }
+  spinlock_release (&q->spin);
+  return ok;
+}
+
 /* Returns the position after POS within an intq. */
 static int
 next (int pos) 
@@ -84,17 +114,22 @@ next (int pos)
 }
 
 /* WAITER must be the address of Q's not_empty or not_full
-   member.  Waits until the given condition is true. */
+   member, and Q's spinlock must be held.  Waits until the given
+   condition is true, unless it already became true while we
+   were acquiring Q's lock. */
 static void
-wait (struct intq *q UNUSED, struct thread **waiter) 
+wait (struct intq *q, struct thread **waiter) 
 {
   ASSERT (!intr_context ());
   ASSERT (intr_get_level () == INTR_OFF);
-  ASSERT ((waiter == &q->not_empty && intq_empty (q))
-          || (waiter == &q->not_full && intq_full (q)));
+  ASSERT (waiter == &q->not_empty || waiter == &q->not_full);
 
-  *waiter = thread_current ();
-  thread_block ();
+  if (waiter == &q->not_empty ? intq_empty (q) : intq_full (q)) 
+    {
+      *waiter = thread_current ();
+      thread_block_spin (&q->spin, WCHAN_IO);
+      spinlock_acquire (&q->spin);
+    }
 }
 
 /* WAITER must be the address of Q's not_empty or not_full
@@ -2,6 +2,7 @@
 #define DEVICES_INTQ_H
 
 #include "threads/interrupt.h"
+#include "threads/spinlock.h"
 #include "threads/synch.h"
 
 /* An "interrupt queue", a circular buffer shared between
@@ -15,7 +16,8 @@
    and condition variables from threads/synch.h cannot be used in
    this case, as they normally would, because they can only
    protect kernel threads from one another, not from interrupt
-   handlers. */
+   handlers.  On a multiprocessor, a spinlock additionally
+   protects the queue from handlers and threads on other CPUs. */
 
 /* Queue buffer size, in bytes. */
 #define INTQ_BUFSIZE 64
@@ -29,6 +31,7 @@ struct intq
     struct thread *not_empty;   /* Thread waiting for not-empty condition. */
 
     /* Queue. */
+    struct spinlock spin;       /* Protects the waiters and the queue. */
     uint8_t buf[INTQ_BUFSIZE];  /* Buffer. */
     int head;                   /* New data is written here. */
     int tail;                   /* Old data is read here. */
@@ -39,5 +42,6 @@ bool intq_empty (const struct intq *);
 bool intq_full (const struct intq *);
 uint8_t intq_getc (struct intq *);
 void intq_putc (struct intq *, uint8_t);
+bool intq_try_putc (struct intq *, uint8_t);
 
 #endif /* devices/intq.h */
@@ -0,0 +1,206 @@
+#include "devices/lapic.h"
+#include <debug.h>
+#include "devices/timer.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/vaddr.h"
+
+/* Local Advanced Programmable Interrupt Controller (APIC).
+
+   Every x86 CPU in a multiprocessor system has its own local
+   APIC, which accepts interrupts for that CPU and lets it send
+   inter-processor interrupts (IPIs) to the others.  Its
+   registers are memory-mapped at the same physical address on
+   every CPU, but each CPU sees its own local APIC there.  See
+   [IA32-v3a] chapter 8 "Advanced Programmable Interrupt
+   Controller (APIC)". */
+
+/* Local APIC registers, as byte offsets from the base. */
+#define LAPIC_ID        0x020   /* Local APIC ID. */
+#define LAPIC_TPR       0x080   /* Task priority. */
+#define LAPIC_EOI       0x0b0   /* End of interrupt. */
+#define LAPIC_SVR       0x0f0   /* Spurious interrupt vector. */
+#define LAPIC_ESR       0x280   /* Error status. */
+#define LAPIC_ICR_LO    0x300   /* Interrupt command, low word. */
+#define LAPIC_ICR_HI    0x310   /* Interrupt command, high word. */
+#define LAPIC_LVT_TIMER 0x320   /* Local vector table: timer. */
+#define LAPIC_LVT_LINT0 0x350   /* Local vector table: LINT0 pin. */
+#define LAPIC_LVT_LINT1 0x360   /* Local vector table: LINT1 pin. */
+#define LAPIC_LVT_ERROR 0x370   /* Local vector table: error. */
+
+/* LAPIC_SVR bits. */
+#define SVR_ENABLE      0x00000100      /* APIC software enable. */
+
+/* Local vector table entry bits. */
+#define LVT_MASKED      0x00010000      /* Interrupt masked. */
+#define LVT_NMI         0x00000400      /* Deliver as NMI. */
+#define LVT_EXTINT      0x00000700      /* Deliver as 8259A ExtINT. */
+
+/* LAPIC_ICR_LO bits. */
+#define ICR_FIXED       0x00000000      /* Fixed delivery mode. */
+#define ICR_INIT        0x00000500      /* INIT delivery mode. */
+#define ICR_STARTUP     0x00000600      /* Start-up delivery mode. */
+#define ICR_PENDING     0x00001000      /* Delivery status: pending. */
+#define ICR_ASSERT      0x00004000      /* Level: assert. */
+#define ICR_LEVEL       0x00008000      /* Trigger mode: level. */
+#define ICR_OTHERS      0x000c0000      /* Shorthand: all excl. self. */
+
+/* Local APIC registers, identity-mapped at their physical
+   address, or null if there is no local APIC. */
+static volatile uint32_t *lapic;
+
+/* Returns the value of local APIC register REG. */
+static inline uint32_t
+lapic_read (int reg)
+{
+  return lapic[reg / sizeof *lapic];
+}
+
+/* Writes VALUE to local APIC register REG. */
+static inline void
+lapic_write (int reg, uint32_t value)
+{
+  lapic[reg / sizeof *lapic] = value;
+}
+
+/* Maps the local APIC's registers, at physical address PADDR,
+   into the kernel's page tables.  Since PADDR lies far above
+   the RAM that the kernel maps at PHYS_BASE, we can map it at
+   virtual address PADDR itself.  The mapping has caching
+   disabled, as device registers require. */
+void
+lapic_map (uintptr_t paddr)
+{
+  uint32_t *pd = base_page_dir;
+  uint32_t *pt;
+  void *vaddr = (void *) paddr;
+
+  ASSERT (pg_ofs (vaddr) == 0);
+  ASSERT (vaddr > ptov (ram_pages * PGSIZE - 1));
+
+  if (pd[pd_no (vaddr)] == 0)
+    pd[pd_no (vaddr)] = pde_create (palloc_get_page (PAL_ASSERT | PAL_ZERO));
+  pt = pde_get_pt (pd[pd_no (vaddr)]);
+  pt[pt_no (vaddr)] = paddr | PTE_G | PTE_PCD | PTE_PWT | PTE_W | PTE_P;
+
+  /* Flush the TLB by reloading CR3. */
+  asm volatile ("movl %0, %%cr3" : : "r" (vtop (pd)) : "memory");
+
+  lapic = vaddr;
+}
+
+/* Returns true if lapic_map() has been called, false if this is
+   a uniprocessor without a usable local APIC. */
+bool
+lapic_present (void)
+{
+  return lapic != NULL;
+}
+
+/* Initializes the running CPU's local APIC.  BSP should be true
+   on the bootstrap processor, whose LINT0 pin receives the
+   8259A PIC's interrupts; all device interrupts keep going to
+   the bootstrap processor that way. */
+void
+lapic_init (bool bsp)
+{
+  ASSERT (lapic != NULL);
+
+  /* Enable the local APIC and direct spurious interrupts to
+     their own vector. */
+  lapic_write (LAPIC_SVR, SVR_ENABLE | LAPIC_VEC_SPURIOUS);
+
+  /* We do not use the local APIC timer. */
+  lapic_write (LAPIC_LVT_TIMER, LVT_MASKED);
+
+  /* Pass through PIC interrupts and NMIs on the bootstrap
+     processor only. */
+  lapic_write (LAPIC_LVT_LINT0, bsp ? LVT_EXTINT : LVT_MASKED);
+  lapic_write (LAPIC_LVT_LINT1, bsp ? LVT_NMI : LVT_MASKED);
+  lapic_write (LAPIC_LVT_ERROR, LVT_MASKED);
+
+  /* Clear the error status register, which requires two
+     back-to-back writes, and any outstanding interrupt. */
+  lapic_write (LAPIC_ESR, 0);
+  lapic_write (LAPIC_ESR, 0);
+  lapic_write (LAPIC_EOI, 0);
+
+  /* Accept interrupts of every priority. */
+  lapic_write (LAPIC_TPR, 0);
+}
+
+/* Returns the running CPU's local APIC ID. */
+uint8_t
+lapic_id (void)
+{
+  return lapic_read (LAPIC_ID) >> 24;
+}
+
+/* Acknowledges the local APIC interrupt being serviced. */
+void
+lapic_eoi (void)
+{
+  lapic_write (LAPIC_EOI, 0);
+}
+
+/* Waits for the previous IPI to be sent. */
+static void
+icr_wait (void)
+{
+  while (lapic_read (LAPIC_ICR_LO) & ICR_PENDING)
+    asm volatile ("pause");
+}
+
+/* Sends an interrupt command with low word LO to the CPU whose
+   local APIC ID is APIC_ID.  Interrupts must be off so that we
+   are not interrupted between writing the two halves of the
+   command register. */
+static void
+icr_send (uint8_t apic_id, uint32_t lo)
+{
+  enum intr_level old_level = intr_disable ();
+  icr_wait ();
+  lapic_write (LAPIC_ICR_HI, (uint32_t) apic_id << 24);
+  lapic_write (LAPIC_ICR_LO, lo);
+  icr_wait ();
+  intr_set_level (old_level);
+}
+
+/* Sends interrupt VEC to the CPU whose local APIC ID is
+   APIC_ID. */
+void
+lapic_send_ipi (uint8_t apic_id, uint8_t vec)
+{
+  icr_send (apic_id, ICR_FIXED | ICR_ASSERT | vec);
+}
+
+/* Sends interrupt VEC to every CPU except the running one. */
+void
+lapic_broadcast_ipi (uint8_t vec)
+{
+  icr_send (0, ICR_OTHERS | ICR_FIXED | ICR_ASSERT | vec);
+}
+
+/* Starts the application processor whose local APIC ID is
+   APIC_ID executing in real mode at physical address
+   START_PADDR, which must be page-aligned and below 1 MB.  This
+   is the "universal start-up algorithm" of [MP] B.4: an INIT
+   IPI, followed by two STARTUP IPIs.  Must be called with
+   interrupts on, since it sleeps. */
+void
+lapic_start_ap (uint8_t apic_id, uintptr_t start_paddr)
+{
+  ASSERT (start_paddr % PGSIZE == 0 && start_paddr < 0x100000);
+
+  icr_send (apic_id, ICR_INIT | ICR_LEVEL | ICR_ASSERT);
+  timer_usleep (200);
+  icr_send (apic_id, ICR_INIT | ICR_LEVEL);
+  timer_msleep (10);
+
+  icr_send (apic_id, ICR_STARTUP | (start_paddr >> PGBITS));
+  timer_usleep (200);
+  icr_send (apic_id, ICR_STARTUP | (start_paddr >> PGBITS));
+  timer_usleep (200);
+}
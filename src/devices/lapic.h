@@ -0,0 +1,27 @@
+#ifndef DEVICES_LAPIC_H
+#define DEVICES_LAPIC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Interrupt vectors used for local APIC interrupts.  They lie
+   above all the vectors used by the 8259A PICs, and in the
+   highest priority class, so that the local APIC never holds
+   them back behind a device interrupt. */
+#define LAPIC_VEC_BASE     0xf0 /* Lowest local APIC vector. */
+#define LAPIC_VEC_TICK     0xf0 /* Timer tick, forwarded by CPU 0. */
+#define LAPIC_VEC_RESCHED  0xf1 /* Reschedule request. */
+#define LAPIC_VEC_HALT     0xf2 /* Stop the CPU (on panic). */
+#define LAPIC_VEC_PAGEDIR  0xf3 /* Drop a lazily loaded page dir. */
+#define LAPIC_VEC_SPURIOUS 0xff /* Spurious interrupt. */
+
+void lapic_map (uintptr_t paddr);
+bool lapic_present (void);
+void lapic_init (bool bsp);
+uint8_t lapic_id (void);
+void lapic_eoi (void);
+void lapic_send_ipi (uint8_t apic_id, uint8_t vec);
+void lapic_broadcast_ipi (uint8_t vec);
+void lapic_start_ap (uint8_t apic_id, uintptr_t start_paddr);
+
+#endif /* devices/lapic.h */
@@ -5,6 +5,7 @@
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/spinlock.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
 
@@ -54,6 +55,13 @@ static enum { UNINIT, POLL, QUEUE } mode;
 /* Data to be transmitted. */
 static struct intq txq;
 
+/* Protects the UART registers and MODE, and makes each check of
+   TXQ and what we do about it atomic.  Disabling interrupts only
+   keeps out serial_interrupt() on the same CPU, but it runs on
+   the BSP while any CPU may print.  Every byte taken out of TXQ
+   is taken under it. */
+static struct spinlock serial_lock;
+
 static void set_serial (int bps);
 static void putc_poll (uint8_t);
 static void write_ier (void);
@@ -88,9 +96,11 @@ serial_init_queue (void)
   ASSERT (mode == POLL);
 
   intr_register_ext (0x20 + 4, serial_interrupt, "serial");
-  mode = QUEUE;
   old_level = intr_disable ();
+  spinlock_acquire (&serial_lock);
+  mode = QUEUE;
   write_ier ();
+  spinlock_release (&serial_lock);
   intr_set_level (old_level);
 }
 
@@ -100,6 +110,7 @@ serial_putc (uint8_t byte)
 {
   enum intr_level old_level = intr_disable ();
 
+  spinlock_acquire (&serial_lock);
   if (mode != QUEUE)
     {
       /* If we're not set up for interrupt-driven I/O yet,
@@ -112,19 +123,28 @@ serial_putc (uint8_t byte)
     {
       /* Otherwise, queue a byte and update the interrupt enable
          register. */
-      if (old_level == INTR_OFF && intq_full (&txq)) 
+      if (old_level == INTR_OFF) 
         {
-          /* Interrupts are off and the transmit queue is full.
-             If we wanted to wait for the queue to empty,
-             we'd have to reenable interrupts.
-             That's impolite, so we'll send a character via
-             polling instead. */
-          putc_poll (intq_getc (&txq)); 
+          /* Interrupts are off, so if the transmit queue is full
+             we can't wait for it to empty without reenabling
+             them.  That's impolite, so we'll send characters via
+             polling instead until ours fits.  Only we, holding
+             serial_lock, take bytes out, so a full queue is
+             never empty. */
+          while (!intq_try_putc (&txq, byte))
+            putc_poll (intq_getc (&txq)); 
+        }
+      else
+        {
+          /* We may sleep until the interrupt handler makes room,
+             but not holding serial_lock, which it needs. */
+          spinlock_release (&serial_lock);
+          intq_putc (&txq, byte); 
+          spinlock_acquire (&serial_lock);
         }
-
-      intq_putc (&txq, byte); 
       write_ier ();
     }
+  spinlock_release (&serial_lock);
   
   intr_set_level (old_level);
 }
@@ -135,8 +155,10 @@ void
 serial_flush (void) 
 {
   enum intr_level old_level = intr_disable ();
+  spinlock_acquire (&serial_lock);
   while (!intq_empty (&txq))
     putc_poll (intq_getc (&txq));
+  spinlock_release (&serial_lock);
   intr_set_level (old_level);
 }
 
@@ -148,8 +170,10 @@ void
 serial_notify (void) 
 {
   ASSERT (intr_get_level () == INTR_OFF);
+  spinlock_acquire (&serial_lock);
   if (mode == QUEUE)
     write_ier ();
+  spinlock_release (&serial_lock);
 }
 
 /* Configures the serial port for BPS bits per second. */
@@ -172,7 +196,8 @@ set_serial (int bps)
   outb (LCR_REG, LCR_N81);
 }
 
-/* Update interrupt enable register. */
+/* Update interrupt enable register.
+   Must be called with serial_lock held. */
 static void
 write_ier (void) 
 {
@@ -209,14 +234,22 @@ putc_poll (uint8_t byte)
 static void
 serial_interrupt (struct intr_frame *f UNUSED) 
 {
+  spinlock_acquire (&serial_lock);
+
   /* Inquire about interrupt in UART.  Without this, we can
      occasionally miss an interrupt running under QEMU. */
   inb (IIR_REG);
 
   /* As long as we have room to receive a byte, and the hardware
-     has a byte for us, receive a byte.  */
+     has a byte for us, receive a byte.  input_putc() calls back
+     into serial_notify(), which takes serial_lock itself. */
   while (!input_full () && (inb (LSR_REG) & LSR_DR) != 0)
-    input_putc (inb (RBR_REG));
+    {
+      uint8_t byte = inb (RBR_REG);
+      spinlock_release (&serial_lock);
+      input_putc (byte);
+      spinlock_acquire (&serial_lock);
+    }
 
   /* As long as we have a byte to transmit, and the hardware is
      ready to accept a byte for transmission, transmit a byte. */
@@ -225,4 +258,5 @@ serial_interrupt (struct intr_frame *f UNUSED)
 
   /* Update interrupt enable register based on queue status. */
   write_ier ();
+  spinlock_release (&serial_lock);
 }
@@ -1,10 +1,13 @@
 #include "devices/timer.h"
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stdio.h>
+#include "threads/cpu.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
+#include "threads/spinlock.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
   
@@ -17,14 +20,51 @@
 #error TIMER_FREQ <= 1000 recommended
 #endif
 
-/* Number of timer ticks since OS booted. */
+/* 8254 input frequency divided by TIMER_FREQ, rounded to
+   nearest: the PIT count for one timer tick. */
+#define PIT_TICK_COUNT ((1193180 + TIMER_FREQ / 2) / TIMER_FREQ)
+
+/* Largest number of ticks the PIT can count in one shot. */
+#define PIT_MAX_TICKS (0xffff / PIT_TICK_COUNT)
+
+/* Number of timer ticks since OS booted.  Only the bootstrap
+   processor, which receives the timer interrupt, updates it, but
+   a 32-bit CPU cannot read a 64-bit value atomically, so readers
+   go through ticks_seq.  Readers on any number of CPUs then
+   proceed in parallel, without disabling interrupts. */
 static int64_t ticks;
+static struct seqlock ticks_seq;
 
 /* Number of loops per timer tick.
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
+/* Pending timeouts, including those of threads sleeping in
+   timer_sleep(), in order of increasing expiry tick.  Timeouts
+   with equal expiry ticks are kept in the order they were added.
+   Protected by timeout_lock, which is held while timeouts fire. */
+static struct list timeout_list;
+static struct spinlock timeout_lock;
+
+/* Tickless idle.  See timer_idle_enter().  Only touched on the
+   bootstrap processor with interrupts off. */
+bool timer_tickless;                /* Enabled? */
+static unsigned oneshot_ticks;      /* Ticks in one-shot countdown, or 0. */
+static long long skipped_ticks;     /* Timer interrupts not taken. */
+
+/* Sleep statistics.  Protected by timeout_lock. */
+static long long sleep_wakeups;     /* # of sleepers woken. */
+static long long oversleep_ticks;   /* Total ticks slept past wakeup. */
+static int64_t max_oversleep;       /* Longest single oversleep. */
+
 static intr_handler_func timer_interrupt;
+static list_less_func expires_less;
+static void insert_timeout (struct timeout *, int64_t ticks,
+                            timeout_func *, void *aux);
+static timeout_func wake_sleeper;
+static void pit_periodic (void);
+static void pit_one_shot (unsigned count);
+static unsigned pit_read (void);
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
@@ -35,14 +75,11 @@ static void real_time_sleep (int64_t num, int32_t denom);
 void
 timer_init (void) 
 {
-  /* 8254 input frequency divided by TIMER_FREQ, rounded to
-     nearest. */
-  uint16_t count = (1193180 + TIMER_FREQ / 2) / TIMER_FREQ;
-
-  outb (0x43, 0x34);    /* CW: counter 0, LSB then MSB, mode 2, binary. */
-  outb (0x40, count & 0xff);
-  outb (0x40, count >> 8);
+  pit_periodic ();
 
+  seqlock_init (&ticks_seq);
+  list_init (&timeout_list);
+  spinlock_init (&timeout_lock);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
 
@@ -73,14 +110,104 @@ timer_calibrate (void)
   printf ("%'"PRIu64" loops/s.\n", (uint64_t) loops_per_tick * TIMER_FREQ);
 }
 
+/* Called by the idle thread on the bootstrap processor, with
+   interrupts off, just before it halts the CPU.
+
+   In tickless mode, instead of interrupting every tick, programs
+   the PIT to interrupt just once, when the next timeout is due,
+   such as a thread waking up from timer_sleep(), when the next
+   throttled EDF
+   thread may run again, or, with the multi-level feedback queue
+   scheduler, at the next once-per-second update, whichever comes
+   first.  The PIT's 16-bit counter limits this to
+   PIT_MAX_TICKS ticks at a time.  timer_interrupt() or
+   timer_idle_exit() then adds the ticks that passed and puts
+   the PIT back in periodic mode.
+
+   Tickless mode is only used while no application processor is
+   running, because they rely on the forwarded tick.  Each CPU's
+   local APIC timer could count much longer one-shots, on every
+   CPU, but the local APIC code has not been booted yet (see
+   threads/cpu.c), so the PIT is all we use. */
+void
+timer_idle_enter (void) 
+{
+  int64_t next = INT64_MAX;
+  int64_t delta;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!timer_tickless || cpu_current () != &cpus[0] || cpu_aps_started ())
+    return;
+  ASSERT (oneshot_ticks == 0);
+
+  /* Find the next tick at which something has to happen.  Only
+     this CPU updates `ticks', so we may read it directly. */
+  spinlock_acquire (&timeout_lock);
+  if (!list_empty (&timeout_list))
+    next = list_entry (list_front (&timeout_list), struct timeout,
+                       elem)->expires;
+  spinlock_release (&timeout_lock);
+  if (thread_mlfqs && ticks - ticks % TIMER_FREQ + TIMER_FREQ < next)
+    next = ticks - ticks % TIMER_FREQ + TIMER_FREQ;
+  if (thread_next_release () < next)
+    next = thread_next_release ();
+
+  delta = next - ticks;
+  if (delta <= 1)
+    return;
+  oneshot_ticks = delta < PIT_MAX_TICKS ? delta : PIT_MAX_TICKS;
+  pit_one_shot (oneshot_ticks * PIT_TICK_COUNT);
+}
+
+/* Called by the idle thread on the bootstrap processor, with
+   interrupts off, after it wakes up.  If it was woken by an
+   interrupt other than the timer's before the one-shot count
+   ran out, accounts for the ticks that have passed so far and
+   returns the PIT to periodic mode. */
+void
+timer_idle_exit (void) 
+{
+  unsigned total, remaining, elapsed;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (oneshot_ticks == 0)
+    return;
+
+  total = oneshot_ticks * PIT_TICK_COUNT;
+  remaining = pit_read ();
+  if (remaining <= total)
+    elapsed = (total - remaining) / PIT_TICK_COUNT;
+  else
+    {
+      /* The count ran out and wrapped around, but we have not
+         yet taken the interrupt.  It will supply the last
+         tick. */
+      elapsed = oneshot_ticks - 1;
+    }
+  pit_periodic ();
+  oneshot_ticks = 0;
+
+  seqlock_write_begin (&ticks_seq);
+  ticks += elapsed;
+  seqlock_write_end (&ticks_seq);
+  skipped_ticks += elapsed;
+}
+
 /* Returns the number of timer ticks since the OS booted. */
 int64_t
 timer_ticks (void) 
 {
-  enum intr_level old_level = intr_disable ();
-  int64_t t = ticks;
-  intr_set_level (old_level);
-  barrier ();
+  unsigned seq;
+  int64_t t;
+
+  do
+    {
+      seq = seqlock_read_begin (&ticks_seq);
+      t = ticks;
+    }
+  while (seqlock_read_retry (&ticks_seq, seq));
   return t;
 }
 
@@ -92,15 +219,109 @@ timer_elapsed (int64_t then)
   return timer_ticks () - then;
 }
 
-/* Suspends execution for approximately TICKS timer ticks. */
+/* Suspends execution for approximately TICKS timer ticks.
+
+   The calling thread is blocked until its timeout fires in
+   timer_interrupt(), so it consumes no CPU time while asleep. */
 void
 timer_sleep (int64_t ticks) 
 {
-  int64_t start = timer_ticks ();
+  struct timeout t;
+  enum intr_level old_level;
+  int64_t late;
 
   ASSERT (intr_get_level () == INTR_ON);
-  while (timer_elapsed (start) < ticks) 
-    thread_yield ();
+  if (ticks <= 0)
+    return;
+
+  old_level = intr_disable ();
+  spinlock_acquire (&timeout_lock);
+  insert_timeout (&t, ticks, wake_sleeper, thread_current ());
+  thread_block_spin (&timeout_lock, WCHAN_SLEEP);
+
+  /* Account for how long we actually slept past our wake-up
+     tick, which includes any time spent on the ready queue. */
+  late = timer_ticks () - t.expires;
+  spinlock_acquire (&timeout_lock);
+  sleep_wakeups++;
+  oversleep_ticks += late;
+  if (late > max_oversleep)
+    max_oversleep = late;
+  spinlock_release (&timeout_lock);
+  intr_set_level (old_level);
+}
+
+/* Timeout function for timer_sleep(): wakes up thread T_. */
+static void
+wake_sleeper (void *t_) 
+{
+  thread_unblock (t_);
+}
+
+/* Arranges for FUNC to be called with AUX, in the timer
+   interrupt handler, once approximately TICKS timer ticks have
+   passed.  TIMEOUT must remain valid until then, or until it is
+   cancelled with timer_timeout_cancel().
+
+   FUNC runs in an interrupt handler, so it must not sleep.  It
+   runs with an internal spinlock held, so it must not call
+   timer_sleep() or add or cancel a timeout, but it may acquire
+   other spinlocks and call thread_unblock().  Holding that
+   spinlock makes timer_timeout_cancel() wait for FUNC to
+   finish, if it is running. */
+void
+timer_timeout_add (struct timeout *timeout, int64_t ticks,
+                   timeout_func *func, void *aux) 
+{
+  enum intr_level old_level;
+
+  ASSERT (timeout != NULL);
+  ASSERT (func != NULL);
+
+  old_level = intr_disable ();
+  spinlock_acquire (&timeout_lock);
+  insert_timeout (timeout, ticks > 0 ? ticks : 1, func, aux);
+  spinlock_release (&timeout_lock);
+  intr_set_level (old_level);
+}
+
+/* Cancels TIMEOUT.  Returns true if it was still pending, false
+   if its function has already been called, in which case the
+   call has finished. */
+bool
+timer_timeout_cancel (struct timeout *timeout) 
+{
+  enum intr_level old_level;
+  bool pending;
+
+  ASSERT (timeout != NULL);
+
+  old_level = intr_disable ();
+  spinlock_acquire (&timeout_lock);
+  pending = timeout->pending;
+  if (pending) 
+    {
+      list_remove (&timeout->elem);
+      timeout->pending = false;
+    }
+  spinlock_release (&timeout_lock);
+  intr_set_level (old_level);
+
+  return pending;
+}
+
+/* Sets up TIMEOUT to call FUNC with AUX after TICKS ticks, which
+   must be positive, and adds it to timeout_list, which must be
+   locked. */
+static void
+insert_timeout (struct timeout *timeout, int64_t ticks,
+                timeout_func *func, void *aux) 
+{
+  timeout->expires = timer_ticks () + ticks;
+  timeout->func = func;
+  timeout->aux = aux;
+  timeout->pending = true;
+  list_insert_ordered (&timeout_list, &timeout->elem, expires_less, NULL);
 }
 
 /* Suspends execution for approximately MS milliseconds. */
@@ -129,14 +350,95 @@ void
 timer_print_stats (void) 
 {
   printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
+  printf ("Timer: %lld sleepers woken, %lld ticks overslept "
+          "(max %"PRId64")\n",
+          sleep_wakeups, oversleep_ticks, max_oversleep);
+  if (timer_tickless)
+    printf ("Timer: %lld tick interrupts skipped while idle\n",
+            skipped_ticks);
 }
 
 /* Timer interrupt handler. */
 static void
 timer_interrupt (struct intr_frame *args UNUSED)
 {
-  ticks++;
+  seqlock_write_begin (&ticks_seq);
+  if (oneshot_ticks == 0)
+    ticks++;
+  else
+    {
+      /* End of a tickless idle period.  Credit all the ticks
+         it covered. */
+      pit_periodic ();
+      ticks += oneshot_ticks;
+      skipped_ticks += oneshot_ticks - 1;
+      oneshot_ticks = 0;
+    }
+  seqlock_write_end (&ticks_seq);
+  cpu_tick_others ();
   thread_tick ();
+
+  /* Fire every timeout whose time has come, such as waking up
+     sleepers.  Since timeout_list is sorted, we only need to
+     look at its front, so this is O(1) on ticks when nothing is
+     due. */
+  spinlock_acquire (&timeout_lock);
+  while (!list_empty (&timeout_list))
+    {
+      struct timeout *t = list_entry (list_front (&timeout_list),
+                                      struct timeout, elem);
+      if (t->expires > ticks)
+        break;
+      list_pop_front (&timeout_list);
+      t->pending = false;
+      t->func (t->aux);
+    }
+  spinlock_release (&timeout_lock);
+  thread_preempt ();
+}
+
+/* Returns true if timeout A expires before timeout B. */
+static bool
+expires_less (const struct list_elem *a_, const struct list_elem *b_,
+              void *aux UNUSED)
+{
+  const struct timeout *a = list_entry (a_, struct timeout, elem);
+  const struct timeout *b = list_entry (b_, struct timeout, elem);
+
+  return a->expires < b->expires;
+}
+
+/* Programs the PIT to interrupt every PIT_TICK_COUNT counts,
+   that is, TIMER_FREQ times per second. */
+static void
+pit_periodic (void) 
+{
+  outb (0x43, 0x34);    /* CW: counter 0, LSB then MSB, mode 2, binary. */
+  outb (0x40, PIT_TICK_COUNT & 0xff);
+  outb (0x40, PIT_TICK_COUNT >> 8);
+}
+
+/* Programs the PIT to interrupt once, after COUNT counts. */
+static void
+pit_one_shot (unsigned count) 
+{
+  ASSERT (count > 0 && count <= 0xffff);
+
+  outb (0x43, 0x30);    /* CW: counter 0, LSB then MSB, mode 0, binary. */
+  outb (0x40, count & 0xff);
+  outb (0x40, count >> 8);
+}
+
+/* Returns the PIT's current count. */
+static unsigned
+pit_read (void) 
+{
+  uint8_t lsb, msb;
+
+  outb (0x43, 0x00);    /* CW: latch counter 0. */
+  lsb = inb (0x40);
+  msb = inb (0x40);
+  return lsb | (msb << 8);
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
@@ -1,14 +1,35 @@
 #ifndef DEVICES_TIMER_H
 #define DEVICES_TIMER_H
 
+#include <list.h>
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 /* Number of timer interrupts per second. */
 #define TIMER_FREQ 100
 
+/* If true, stop the periodic timer interrupt while idle.
+   Controlled by kernel command-line option "-tickless". */
+extern bool timer_tickless;
+
+/* A timeout, which calls a function from the timer interrupt
+   handler once a given number of ticks have passed.  See
+   timer_timeout_add(). */
+typedef void timeout_func (void *aux);
+struct timeout
+  {
+    struct list_elem elem;      /* List element. */
+    int64_t expires;            /* Tick at which to fire. */
+    timeout_func *func;         /* Function to call. */
+    void *aux;                  /* Argument for FUNC. */
+    bool pending;               /* Not yet fired or cancelled? */
+  };
+
 void timer_init (void);
 void timer_calibrate (void);
+void timer_idle_enter (void);
+void timer_idle_exit (void);
 
 int64_t timer_ticks (void);
 int64_t timer_elapsed (int64_t);
@@ -18,6 +39,10 @@ void timer_msleep (int64_t milliseconds);
 void timer_usleep (int64_t microseconds);
 void timer_nsleep (int64_t nanoseconds);
 
+void timer_timeout_add (struct timeout *, int64_t ticks,
+                        timeout_func *, void *aux);
+bool timer_timeout_cancel (struct timeout *);
+
 void timer_print_stats (void);
 
 #endif /* devices/timer.h */
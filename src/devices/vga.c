@@ -5,6 +5,7 @@
 #include <string.h>
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/spinlock.h"
 #include "threads/vaddr.h"
 
 /* VGA text screen support.  See [FREEVGA] for more information. */
@@ -25,6 +26,11 @@ static size_t cx, cy;
    The attribute at (x,y) is fb[y][x][1]. */
 static uint8_t (*fb)[COL_CNT][2];
 
+/* Protects the cursor, the framebuffer, and the CRTC registers
+   from other CPUs.  Disabling interrupts only keeps out
+   interrupt handlers on the same CPU. */
+static struct spinlock vga_lock;
+
 static void clear_row (size_t y);
 static void cls (void);
 static void newline (void);
@@ -51,8 +57,10 @@ void
 vga_putc (int c)
 {
   /* Disable interrupts to lock out interrupt handlers
-     that might write to the console. */
+     that might write to the console, and take vga_lock to lock
+     out other CPUs. */
   enum intr_level old_level = intr_disable ();
+  spinlock_acquire (&vga_lock);
 
   init ();
   
@@ -92,6 +100,7 @@ vga_putc (int c)
   /* Update cursor position. */
   move_cursor ();
 
+  spinlock_release (&vga_lock);
   intr_set_level (old_level);
 }
 
@@ -7,6 +7,7 @@
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per disk sector. */
+static size_t free_map_hint;         /* Where to start the next search. */
 
 /* Initializes the free map. */
 void
@@ -20,13 +21,21 @@ free_map_init (void)
 }
 
 /* Allocates CNT consecutive sectors from the free map and stores
-   the first into *SECTORP.
+   the first into *SECTORP.  The search starts where the last one
+   left off, so that it need not pass over all the sectors
+   allocated so far every time.
    Returns true if successful, false if all sectors were
    available. */
 bool
 free_map_allocate (size_t cnt, disk_sector_t *sectorp) 
 {
-  disk_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
+  disk_sector_t sector = bitmap_scan_from_hint (free_map, free_map_hint,
+                                                cnt, false);
+  if (sector != BITMAP_ERROR)
+    {
+      bitmap_set_multiple (free_map, sector, cnt, true);
+      free_map_hint = sector + cnt;
+    }
   if (sector != BITMAP_ERROR
       && free_map_file != NULL
       && !bitmap_write (free_map, free_map_file))
@@ -6,6 +6,9 @@
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/rcu.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
@@ -33,10 +36,11 @@ struct inode
   {
     struct list_elem elem;              /* Element in inode list. */
     disk_sector_t sector;               /* Sector number of disk location. */
-    int open_cnt;                       /* Number of openers. */
+    int open_cnt;                       /* Number of openers (atomic). */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
     struct inode_disk data;             /* Inode content. */
+    struct rcu_head rcu;                /* Deferred free. */
   };
 
 /* Returns the disk sector that contains byte offset POS within
@@ -54,14 +58,34 @@ byte_to_sector (const struct inode *inode, off_t pos)
 }
 
 /* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
+   returns the same `struct inode'.
+
+   Lookups traverse the list under RCU, without taking any lock,
+   so that opening a file that is already open does not
+   serialize against every other open.  Insertions and removals
+   take open_inodes_lock.  It is held only long enough to search
+   and update the list, so it is an adaptive mutex: on a
+   multiprocessor, a thread that finds it held usually waits out
+   the holder instead of sleeping.  An inode whose open_cnt has
+   dropped to 0 is on its way out and may not be revived, so
+   lookups take a reference with get_inode(), which fails in
+   that case. */
 static struct list open_inodes;
+static struct mutex open_inodes_lock;
+
+/* Cache of `struct inode's. */
+static struct kmem_cache *inode_cache;
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
   list_init (&open_inodes);
+  mutex_init (&open_inodes_lock);
+  inode_cache = kmem_cache_create ("inode", sizeof (struct inode), 0,
+                                   NULL, NULL);
+  if (inode_cache == NULL)
+    PANIC ("inode cache creation failed");
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -105,48 +129,110 @@ inode_create (disk_sector_t sector, off_t length)
   return success;
 }
 
+/* Atomically increments INODE's open_cnt unless it is 0.
+   Returns true if successful, false if INODE is being closed
+   for the last time. */
+static bool
+get_inode (struct inode *inode)
+{
+  int cnt = *(volatile int *) &inode->open_cnt;
+
+  while (cnt != 0)
+    {
+      int old = cnt;
+
+      asm volatile ("lock; cmpxchgl %2, %1"
+                    : "+a" (cnt), "+m" (inode->open_cnt)
+                    : "r" (cnt + 1)
+                    : "memory", "cc");
+      if (cnt == old)
+        return true;
+    }
+  return false;
+}
+
+/* Searches the open inodes for one at SECTOR and returns it with
+   a new reference, or a null pointer if there is none.  The
+   caller must be in an RCU read-side critical section or hold
+   open_inodes_lock. */
+static struct inode *
+lookup_inode (disk_sector_t sector)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
+       e = list_next (e)) 
+    {
+      struct inode *inode = list_entry (e, struct inode, elem);
+      if (inode->sector == sector && get_inode (inode))
+        return inode;
+    }
+  return NULL;
+}
+
 /* Reads an inode from SECTOR
    and returns a `struct inode' that contains it.
    Returns a null pointer if memory allocation fails. */
 struct inode *
 inode_open (disk_sector_t sector) 
 {
-  struct list_elem *e;
-  struct inode *inode;
+  struct inode *inode, *open;
+  enum intr_level old_level;
 
   /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
-    {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
-        {
-          inode_reopen (inode);
-          return inode; 
-        }
-    }
+  old_level = rcu_read_lock ();
+  inode = lookup_inode (sector);
+  rcu_read_unlock (old_level);
+  if (inode != NULL)
+    return inode;
 
   /* Allocate memory. */
-  inode = malloc (sizeof *inode);
+  inode = kmem_cache_alloc (inode_cache);
   if (inode == NULL)
     return NULL;
 
-  /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
+  /* Initialize.  The inode must be complete before lookups can
+     see it. */
   inode->sector = sector;
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
   disk_read (filesys_disk, inode->sector, &inode->data);
+
+  /* Publish it, unless someone else opened the same inode while
+     we were reading it. */
+  mutex_acquire (&open_inodes_lock);
+  open = lookup_inode (sector);
+  if (open == NULL)
+    rcu_list_push_front (&open_inodes, &inode->elem);
+  mutex_release (&open_inodes_lock);
+  if (open != NULL)
+    {
+      kmem_cache_free (inode_cache, inode);
+      inode = open;
+    }
   return inode;
 }
 
+/* Atomically decrements INODE's open_cnt.  Returns true if it
+   dropped to 0. */
+static bool
+put_inode (struct inode *inode)
+{
+  bool zero;
+
+  asm volatile ("lock; decl %0; sete %1"
+                : "+m" (inode->open_cnt), "=qm" (zero)
+                : : "memory", "cc");
+  return zero;
+}
+
 /* Reopens and returns INODE. */
 struct inode *
 inode_reopen (struct inode *inode)
 {
   if (inode != NULL)
-    inode->open_cnt++;
+    asm volatile ("lock; incl %0" : "+m" (inode->open_cnt) : : "memory");
   return inode;
 }
 
@@ -157,6 +243,14 @@ inode_get_inumber (const struct inode *inode)
   return inode->sector;
 }
 
+/* Frees the inode that contains HEAD, once no lookup can still
+   see it. */
+static void
+free_inode (struct rcu_head *head)
+{
+  kmem_cache_free (inode_cache, rcu_entry (head, struct inode, rcu));
+}
+
 /* Closes INODE and writes it to disk.
    If this was the last reference to INODE, frees its memory.
    If INODE was also a removed inode, frees its blocks. */
@@ -168,10 +262,14 @@ inode_close (struct inode *inode)
     return;
 
   /* Release resources if this was the last opener. */
-  if (--inode->open_cnt == 0)
+  if (put_inode (inode))
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
+      /* Remove from inode list.  Lookups that are traversing the
+         list may still be looking at it, but can no longer take
+         a reference to it. */
+      mutex_acquire (&open_inodes_lock);
+      rcu_list_remove (&inode->elem);
+      mutex_release (&open_inodes_lock);
  
       /* Deallocate blocks if removed. */
       if (inode->removed) 
@@ -181,7 +279,7 @@ inode_close (struct inode *inode)
                             bytes_to_sectors (inode->data.length)); 
         }
 
-      free (inode); 
+      call_rcu (&inode->rcu, free_inode);
     }
 }
 
@@ -5,6 +5,8 @@
 #include <stdio.h>
 #include <string.h>
 
+static void explain_backtrace (void);
+
 /* Prints the call stack, that is, a list of addresses, one in
    each of the functions we are nested within.  gdb or addr2line
    may be applied to kernel.o to translate these into file names,
@@ -12,7 +14,6 @@
 void
 debug_backtrace (void) 
 {
-  static bool explained;
   void **frame;
   
   printf ("Call stack:");
@@ -21,6 +22,48 @@ debug_backtrace (void)
        frame = frame[0]) 
     printf (" %p", frame[1]);
   printf (".\n");
+  explain_backtrace ();
+}
+
+/* Stores up to MAX addresses of the call stack of the function
+   that calls this one, innermost first, in FRAMES, and returns
+   the number stored.  Unlike debug_backtrace(), does not print,
+   so the call stack may be saved now and printed later, with
+   debug_backtrace_print(). */
+size_t
+debug_backtrace_save (void **frames, size_t max) 
+{
+  void **frame;
+  size_t cnt = 0;
+
+  for (frame = __builtin_frame_address (0);
+       frame != NULL && frame[0] != NULL && cnt < max;
+       frame = frame[0]) 
+    frames[cnt++] = frame[1];
+  return cnt;
+}
+
+/* Prints the CNT call stack addresses in FRAMES, as saved by
+   debug_backtrace_save(), in the same format as
+   debug_backtrace(). */
+void
+debug_backtrace_print (void *const *frames, size_t cnt) 
+{
+  size_t i;
+
+  printf ("Call stack:");
+  for (i = 0; i < cnt; i++)
+    printf (" %p", frames[i]);
+  printf (".\n");
+  explain_backtrace ();
+}
+
+/* Explains, the first time it is called, how to make use of a
+   call stack. */
+static void
+explain_backtrace (void) 
+{
+  static bool explained;
 
   if (!explained) 
     {
@@ -1,6 +1,8 @@
 #ifndef __LIB_DEBUG_H
 #define __LIB_DEBUG_H
 
+#include <stddef.h>
+
 /* GCC lets us add "attributes" to functions, function
    parameters, etc. to indicate their properties.
    See the GCC manual for details. */
@@ -16,6 +18,8 @@
 void debug_panic (const char *file, int line, const char *function,
                   const char *message, ...) PRINTF_FORMAT (4, 5) NO_RETURN;
 void debug_backtrace (void);
+size_t debug_backtrace_save (void **frames, size_t max);
+void debug_backtrace_print (void *const *frames, size_t cnt);
 
 #endif
 
@@ -68,6 +68,65 @@ last_mask (const struct bitmap *b)
   int last_bits = b->bit_cnt % ELEM_BITS;
   return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
+
+/* Returns a bit mask for the element that contains bit START,
+   in which the bits corresponding to bits START up to but not
+   including END are set to 1 and the rest are set to 0.  END
+   may lie beyond that element. */
+static inline elem_type
+range_mask (size_t start, size_t end) 
+{
+  size_t lo = start % ELEM_BITS;
+  size_t hi = end - (start - lo);
+  elem_type mask = (elem_type) -1 << lo;
+
+  if (hi < ELEM_BITS)
+    mask &= ((elem_type) 1 << hi) - 1;
+  return mask;
+}
+
+/* Returns element E of B, inverted if VALUE is false, so that
+   the bits set to VALUE in B are set to 1. */
+static inline elem_type
+elem_match (const struct bitmap *b, size_t e, bool value) 
+{
+  return value ? b->bits[e] : ~b->bits[e];
+}
+
+/* Returns the number of bits set to 1 in X, by adding up
+   adjacent fields of bits in parallel, without looping or
+   calling into libgcc. */
+static inline size_t
+popcount (elem_type x) 
+{
+  x = x - ((x >> 1) & (elem_type) -1 / 3);
+  x = (x & (elem_type) -1 / 15 * 3) + ((x >> 2) & (elem_type) -1 / 15 * 3);
+  x = (x + (x >> 4)) & (elem_type) -1 / 255 * 15;
+  return (elem_type) (x * ((elem_type) -1 / 255))
+         >> (sizeof (elem_type) - 1) * CHAR_BIT;
+}
+
+/* Atomically sets the bits in *E that are set in MASK.
+
+   This is equivalent to `*e |= mask' except that it is
+   guaranteed to be atomic on a uniprocessor machine.  See the
+   description of the OR instruction in [IA32-v2b]. */
+static inline void
+elem_or (elem_type *e, elem_type mask) 
+{
+  asm ("orl %1, %0" : "+m" (*e) : "r" (mask) : "cc");
+}
+
+/* Atomically clears the bits in *E that are set in MASK.
+
+   This is equivalent to `*e &= ~mask' except that it is
+   guaranteed to be atomic on a uniprocessor machine.  See the
+   description of the AND instruction in [IA32-v2a]. */
+static inline void
+elem_and_not (elem_type *e, elem_type mask) 
+{
+  asm ("andl %1, %0" : "+m" (*e) : "r" (~mask) : "cc");
+}
 
 /* Creation and destruction. */
 
@@ -157,26 +216,14 @@ bitmap_set (struct bitmap *b, size_t idx, bool value)
 void
 bitmap_mark (struct bitmap *b, size_t bit_idx) 
 {
-  size_t idx = elem_idx (bit_idx);
-  elem_type mask = bit_mask (bit_idx);
-
-  /* This is equivalent to `b->bits[idx] |= mask' except that it
-     is guaranteed to be atomic on a uniprocessor machine.  See
-     the description of the OR instruction in [IA32-v2b]. */
-  asm ("orl %1, %0" : "=m" (b->bits[idx]) : "r" (mask) : "cc");
+  elem_or (&b->bits[elem_idx (bit_idx)], bit_mask (bit_idx));
 }
 
 /* Atomically sets the bit numbered BIT_IDX in B to false. */
 void
 bitmap_reset (struct bitmap *b, size_t bit_idx) 
 {
-  size_t idx = elem_idx (bit_idx);
-  elem_type mask = bit_mask (bit_idx);
-
-  /* This is equivalent to `b->bits[idx] &= ~mask' except that it
-     is guaranteed to be atomic on a uniprocessor machine.  See
-     the description of the AND instruction in [IA32-v2a]. */
-  asm ("andl %1, %0" : "=m" (b->bits[idx]) : "r" (~mask) : "cc");
+  elem_and_not (&b->bits[elem_idx (bit_idx)], bit_mask (bit_idx));
 }
 
 /* Atomically toggles the bit numbered IDX in B;
@@ -214,18 +261,29 @@ bitmap_set_all (struct bitmap *b, bool value)
   bitmap_set_multiple (b, 0, bitmap_size (b), value);
 }
 
-/* Sets the CNT bits starting at START in B to VALUE. */
+/* Sets the CNT bits starting at START in B to VALUE.
+   Each element is updated atomically, a whole element at a
+   time. */
 void
 bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
-  
+  size_t end = start + cnt;
+
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    bitmap_set (b, start + i, value);
+  while (start < end) 
+    {
+      size_t e = elem_idx (start);
+      elem_type mask = range_mask (start, end);
+
+      if (value)
+        elem_or (&b->bits[e], mask);
+      else
+        elem_and_not (&b->bits[e], mask);
+      start = (e + 1) * ELEM_BITS;
+    }
 }
 
 /* Returns the number of bits in B between START and START + CNT,
@@ -233,16 +291,22 @@ bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value)
 size_t
 bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i, value_cnt;
+  size_t end = start + cnt;
+  size_t value_cnt;
 
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
   value_cnt = 0;
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      value_cnt++;
+  while (start < end) 
+    {
+      size_t e = elem_idx (start);
+
+      value_cnt += popcount (elem_match (b, e, value)
+                             & range_mask (start, end));
+      start = (e + 1) * ELEM_BITS;
+    }
   return value_cnt;
 }
 
@@ -251,15 +315,20 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
-  
+  size_t end = start + cnt;
+
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      return true;
+  while (start < end) 
+    {
+      size_t e = elem_idx (start);
+
+      if ((elem_match (b, e, value) & range_mask (start, end)) != 0)
+        return true;
+      start = (e + 1) * ELEM_BITS;
+    }
   return false;
 }
 
@@ -287,7 +356,70 @@ bitmap_all (const struct bitmap *b, size_t start, size_t cnt)
   return !bitmap_contains (b, start, cnt, false);
 }
 
-/* Finding set or unset bits. */
+/* Finding set or unset bits.
+
+   Rather than testing every candidate starting bit, we look at
+   B a whole element at a time.  find_next() skips over elements
+   that have no bits set to the value we want, and then uses the
+   "bsf" instruction to find the first bit that is.  Finding a
+   group of bits set to VALUE is then a matter of finding the
+   next bit set to VALUE, which starts a run, and the next bit
+   after it set to !VALUE, which ends the run, until a run is
+   long enough.  Each element is looked at about once, however
+   long the group we are looking for. */
+
+/* Returns the index of the first bit in B at or after START
+   that is set to VALUE, or the number of bits in B if there is
+   none. */
+static size_t
+find_next (const struct bitmap *b, size_t start, bool value) 
+{
+  size_t e, bit;
+  elem_type match;
+
+  if (start >= b->bit_cnt)
+    return b->bit_cnt;
+
+  e = elem_idx (start);
+  match = elem_match (b, e, value) & ((elem_type) -1 << (start % ELEM_BITS));
+  while (match == 0) 
+    {
+      if (++e >= elem_cnt (b->bit_cnt))
+        return b->bit_cnt;
+      match = elem_match (b, e, value);
+    }
+
+  /* The unused bits at the end of the last element may have any
+     value, so a match there does not count. */
+  bit = e * ELEM_BITS + __builtin_ctzl (match);
+  return bit < b->bit_cnt ? bit : b->bit_cnt;
+}
+
+/* Finds and returns the starting index of the first group of CNT
+   consecutive bits in B that are all set to VALUE and that lie
+   entirely at or after START and before END.
+   If there is no such group, returns BITMAP_ERROR. */
+static size_t
+scan_range (const struct bitmap *b, size_t start, size_t end,
+            size_t cnt, bool value) 
+{
+  if (cnt == 0)
+    return start;
+
+  while (start < end && end - start >= cnt) 
+    {
+      size_t run_end;
+
+      start = find_next (b, start, value);
+      if (start >= end || end - start < cnt)
+        break;
+      run_end = find_next (b, start, !value);
+      if (run_end - start >= cnt)
+        return start;
+      start = run_end;
+    }
+  return BITMAP_ERROR;
+}
 
 /* Finds and returns the starting index of the first group of CNT
    consecutive bits in B at or after START that are all set to
@@ -299,15 +431,37 @@ bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
 
-  if (cnt <= b->bit_cnt) 
+  return scan_range (b, start, b->bit_cnt, cnt, value);
+}
+
+/* Finds and returns the starting index of the first group of CNT
+   consecutive bits in B at or after HINT that are all set to
+   VALUE, or failing that, the first such group that starts
+   before HINT, wrapping around to the beginning of B.  If there
+   is no such group, returns BITMAP_ERROR.
+
+   Passing the end of the group found last time as HINT gives a
+   "next fit" search, which does not rescan the crowded
+   beginning of B every time.  HINT may be any value; if it is
+   past the end of B, the search starts at the beginning. */
+size_t
+bitmap_scan_from_hint (const struct bitmap *b, size_t hint, size_t cnt,
+                       bool value) 
+{
+  size_t idx;
+
+  ASSERT (b != NULL);
+
+  if (hint > b->bit_cnt)
+    hint = 0;
+  idx = scan_range (b, hint, b->bit_cnt, cnt, value);
+  if (idx == BITMAP_ERROR && hint > 0) 
     {
-      size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i; 
+      size_t end = hint - 1 + cnt;
+      idx = scan_range (b, 0, end < b->bit_cnt ? end : b->bit_cnt,
+                        cnt, value);
     }
-  return BITMAP_ERROR;
+  return idx;
 }
 
 /* Finds the first group of CNT consecutive bits in B at or after
@@ -5,6 +5,7 @@
 #include <stddef.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/cpu.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
 #include "devices/serial.h"
@@ -19,6 +20,7 @@ debug_panic (const char *file, int line, const char *function,
   va_list args;
 
   intr_disable ();
+  cpu_halt_others ();
   console_panic ();
 
   level++;
@@ -0,0 +1,279 @@
+#include "heap.h"
+#include "../debug.h"
+
+/* The heap is a complete binary tree: every level is full except
+   possibly the last, which is filled from the left.  Numbering
+   the nodes 1, 2, ... in breadth-first order, the bits of a
+   node's number after the leading 1 spell out the path from the
+   root to that node, 0 meaning left and 1 meaning right.  That
+   is how we find the last node, to remove it, and the place for
+   a new node, to add it, in O(lg n) time. */
+
+static struct heap_elem *find_node (const struct heap *, size_t idx);
+static struct heap_elem *detach_last (struct heap *);
+static void replace_node (struct heap *, struct heap_elem *old,
+                          struct heap_elem *new);
+static void swap_with_parent (struct heap *, struct heap_elem *);
+static void sift_up (struct heap *, struct heap_elem *);
+static void sift_down (struct heap *, struct heap_elem *);
+static struct heap_elem *least_below (const struct heap *,
+                                      struct heap_elem *);
+
+/* Initializes HEAP as an empty heap ordered by LESS, which is
+   passed AUX. */
+void
+heap_init (struct heap *heap, heap_less_func *less, void *aux) 
+{
+  ASSERT (heap != NULL);
+  ASSERT (less != NULL);
+
+  heap->size = 0;
+  heap->root = NULL;
+  heap->less = less;
+  heap->aux = aux;
+}
+
+/* Returns the number of elements in HEAP. */
+size_t
+heap_size (const struct heap *heap) 
+{
+  return heap->size;
+}
+
+/* Returns true if HEAP is empty, false otherwise. */
+bool
+heap_empty (const struct heap *heap) 
+{
+  return heap->size == 0;
+}
+
+/* Returns the least element in HEAP, without removing it.
+   HEAP must not be empty. */
+struct heap_elem *
+heap_top (const struct heap *heap) 
+{
+  ASSERT (!heap_empty (heap));
+  return heap->root;
+}
+
+/* Returns the least element in HEAP, without removing it, by
+   comparing every element.  HEAP must not be empty.  Takes O(n)
+   time, but unlike heap_top() gives the right answer even if
+   elements' values have changed without a call to
+   heap_update(). */
+struct heap_elem *
+heap_scan (const struct heap *heap) 
+{
+  ASSERT (!heap_empty (heap));
+  return least_below (heap, heap->root);
+}
+
+/* Inserts E, which must not be in any heap, into HEAP. */
+void
+heap_push (struct heap *heap, struct heap_elem *e) 
+{
+  struct heap_elem *parent;
+
+  ASSERT (heap != NULL);
+  ASSERT (e != NULL);
+
+  e->left = e->right = NULL;
+  heap->size++;
+  if (heap->size == 1) 
+    {
+      e->parent = NULL;
+      heap->root = e;
+      return;
+    }
+
+  parent = find_node (heap, heap->size / 2);
+  e->parent = parent;
+  if (heap->size % 2 == 0)
+    parent->left = e;
+  else
+    parent->right = e;
+  sift_up (heap, e);
+}
+
+/* Removes and returns the least element in HEAP, which must not
+   be empty. */
+struct heap_elem *
+heap_pop (struct heap *heap) 
+{
+  struct heap_elem *top = heap_top (heap);
+
+  heap_remove (heap, top);
+  return top;
+}
+
+/* Removes E, which must be in HEAP, from HEAP. */
+void
+heap_remove (struct heap *heap, struct heap_elem *e) 
+{
+  struct heap_elem *last;
+
+  ASSERT (!heap_empty (heap));
+  ASSERT (e != NULL);
+
+  /* Fill E's place with the last node, then restore the heap
+     property, which may require moving it up or down. */
+  last = detach_last (heap);
+  if (last != e) 
+    {
+      replace_node (heap, e, last);
+      sift_up (heap, last);
+      sift_down (heap, last);
+    }
+}
+
+/* Restores the heap property after the value of E, which must be
+   in HEAP, has changed. */
+void
+heap_update (struct heap *heap, struct heap_elem *e) 
+{
+  sift_up (heap, e);
+  sift_down (heap, e);
+}
+
+/* Returns the node numbered IDX in HEAP, counting from 1. */
+static struct heap_elem *
+find_node (const struct heap *heap, size_t idx) 
+{
+  struct heap_elem *e = heap->root;
+  int bit;
+
+  ASSERT (idx >= 1 && idx <= heap->size);
+
+  for (bit = 30 - __builtin_clz (idx); bit >= 0; bit--)
+    e = (idx >> bit) & 1 ? e->right : e->left;
+  return e;
+}
+
+/* Unlinks the last node from HEAP and returns it. */
+static struct heap_elem *
+detach_last (struct heap *heap) 
+{
+  struct heap_elem *last = find_node (heap, heap->size);
+
+  if (last->parent == NULL)
+    heap->root = NULL;
+  else if (last->parent->left == last)
+    last->parent->left = NULL;
+  else
+    last->parent->right = NULL;
+  heap->size--;
+  return last;
+}
+
+/* Puts NEW, which is not linked into HEAP, in the place of OLD,
+   which is. */
+static void
+replace_node (struct heap *heap, struct heap_elem *old,
+              struct heap_elem *new) 
+{
+  new->parent = old->parent;
+  new->left = old->left;
+  new->right = old->right;
+
+  if (new->parent == NULL)
+    heap->root = new;
+  else if (new->parent->left == old)
+    new->parent->left = new;
+  else
+    new->parent->right = new;
+  if (new->left != NULL)
+    new->left->parent = new;
+  if (new->right != NULL)
+    new->right->parent = new;
+}
+
+/* Exchanges E with its parent in HEAP. */
+static void
+swap_with_parent (struct heap *heap, struct heap_elem *e) 
+{
+  struct heap_elem *p = e->parent;
+  struct heap_elem *left = e->left, *right = e->right;
+
+  /* E takes P's place under P's parent. */
+  e->parent = p->parent;
+  if (e->parent == NULL)
+    heap->root = e;
+  else if (e->parent->left == p)
+    e->parent->left = e;
+  else
+    e->parent->right = e;
+
+  /* P becomes E's child, and E takes P's other child. */
+  if (p->left == e) 
+    {
+      e->left = p;
+      e->right = p->right;
+      if (e->right != NULL)
+        e->right->parent = e;
+    }
+  else 
+    {
+      e->right = p;
+      e->left = p->left;
+      if (e->left != NULL)
+        e->left->parent = e;
+    }
+  p->parent = e;
+
+  /* P takes E's old children. */
+  p->left = left;
+  p->right = right;
+  if (left != NULL)
+    left->parent = p;
+  if (right != NULL)
+    right->parent = p;
+}
+
+/* Moves E up HEAP while it is less than its parent. */
+static void
+sift_up (struct heap *heap, struct heap_elem *e) 
+{
+  while (e->parent != NULL && heap->less (e, e->parent, heap->aux))
+    swap_with_parent (heap, e);
+}
+
+/* Moves E down HEAP while one of its children is less than it. */
+static void
+sift_down (struct heap *heap, struct heap_elem *e) 
+{
+  for (;;) 
+    {
+      struct heap_elem *min = e->left;
+
+      if (min == NULL)
+        break;
+      if (e->right != NULL && heap->less (e->right, min, heap->aux))
+        min = e->right;
+      if (!heap->less (min, e, heap->aux))
+        break;
+      swap_with_parent (heap, min);
+    }
+}
+
+/* Returns the least of E and the nodes below it in HEAP,
+   comparing every one. */
+static struct heap_elem *
+least_below (const struct heap *heap, struct heap_elem *e) 
+{
+  struct heap_elem *least = e;
+  struct heap_elem *child;
+
+  if (e->left != NULL) 
+    {
+      child = least_below (heap, e->left);
+      if (heap->less (child, least, heap->aux))
+        least = child;
+    }
+  if (e->right != NULL) 
+    {
+      child = least_below (heap, e->right);
+      if (heap->less (child, least, heap->aux))
+        least = child;
+    }
+  return least;
+}
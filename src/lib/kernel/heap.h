@@ -0,0 +1,67 @@
+#ifndef __LIB_KERNEL_HEAP_H
+#define __LIB_KERNEL_HEAP_H
+
+/* Binary min-heap.
+
+   Like the lists in list.h, the heap does not use dynamic
+   allocation.  Each structure that can be in a heap embeds a
+   struct heap_elem member, and the heap is a complete binary
+   tree linked through those members.  The heap_entry macro
+   converts a struct heap_elem back to the structure that
+   contains it, just like list_entry.
+
+   heap_push(), heap_pop(), heap_remove(), and heap_update() all
+   take O(lg n) time, heap_top() takes constant time, and
+   heap_scan() takes O(n) time.
+   Because no allocation is needed, all of them may be used with
+   interrupts off, for example by the scheduler.
+
+   Elements that compare equal come out in no particular order. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Heap element. */
+struct heap_elem 
+  {
+    struct heap_elem *parent;   /* Parent, or null for the root. */
+    struct heap_elem *left;     /* Left child, or null. */
+    struct heap_elem *right;    /* Right child, or null. */
+  };
+
+/* Converts pointer to heap element HEAP_ELEM into a pointer to
+   the structure that HEAP_ELEM is embedded inside.  Supply the
+   name of the outer structure STRUCT and the member name MEMBER
+   of the heap element. */
+#define heap_entry(HEAP_ELEM, STRUCT, MEMBER)           \
+        ((STRUCT *) ((uint8_t *) &(HEAP_ELEM)->parent   \
+                     - offsetof (STRUCT, MEMBER.parent)))
+
+/* Compares the value of two heap elements A and B, given
+   auxiliary data AUX.  Returns true if A is less than B, or
+   false if A is greater than or equal to B. */
+typedef bool heap_less_func (const struct heap_elem *a,
+                             const struct heap_elem *b,
+                             void *aux);
+
+/* Heap. */
+struct heap 
+  {
+    size_t size;                /* Number of elements. */
+    struct heap_elem *root;     /* Least element, or null. */
+    heap_less_func *less;       /* Comparison function. */
+    void *aux;                  /* Auxiliary data for `less'. */
+  };
+
+void heap_init (struct heap *, heap_less_func *, void *aux);
+size_t heap_size (const struct heap *);
+bool heap_empty (const struct heap *);
+struct heap_elem *heap_top (const struct heap *);
+struct heap_elem *heap_scan (const struct heap *);
+void heap_push (struct heap *, struct heap_elem *);
+struct heap_elem *heap_pop (struct heap *);
+void heap_remove (struct heap *, struct heap_elem *);
+void heap_update (struct heap *, struct heap_elem *);
+
+#endif /* lib/kernel/heap.h */
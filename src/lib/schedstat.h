@@ -0,0 +1,28 @@
+#ifndef __LIB_SCHEDSTAT_H
+#define __LIB_SCHEDSTAT_H
+
+#include <stdint.h>
+
+/* Kinds of event that a thread may block waiting for. */
+enum wait_channel
+  {
+    WCHAN_OTHER,                /* Anything else (thread_block()). */
+    WCHAN_SEMA,                 /* Semaphore, lock, or condition. */
+    WCHAN_SLEEP,                /* timer_sleep() and friends. */
+    WCHAN_IO,                   /* Interrupt queue (keyboard, serial). */
+    WCHAN_CNT                   /* Number of wait channel types. */
+  };
+
+/* Scheduler statistics for one thread, as kept by the kernel and
+   returned by the schedstat() system call.  Times are in timer
+   ticks. */
+struct schedstat
+  {
+    int64_t run_ticks;                  /* Time running. */
+    int64_t ready_ticks;                /* Time ready, waiting to run. */
+    int64_t blocked_ticks[WCHAN_CNT];   /* Time blocked, by channel. */
+    unsigned voluntary_switches;        /* Blocked or yielded. */
+    unsigned involuntary_switches;      /* Preempted. */
+  };
+
+#endif /* lib/schedstat.h */
@@ -0,0 +1,138 @@
+#include <synch.h>
+#include <limits.h>
+#include <syscall.h>
+
+/* User-space mutexes and condition variables, after "Futexes
+   Are Tricky" by Ulrich Drepper.  The fast paths are a single
+   atomic instruction; only a thread that must sleep, or must
+   wake a sleeping thread, makes a system call. */
+
+/* Atomically stores NEW into *P and returns its old value.
+   "xchg" with a memory operand is implicitly locked. */
+static inline int
+atomic_xchg (int *p, int new)
+{
+  asm volatile ("xchgl %0, %1" : "+r" (new), "+m" (*p) : : "memory");
+  return new;
+}
+
+/* Atomically stores NEW into *P if *P equals OLD.  Returns the
+   value that *P had. */
+static inline int
+atomic_cmpxchg (int *p, int old, int new)
+{
+  asm volatile ("lock; cmpxchgl %2, %1"
+                : "+a" (old), "+m" (*p)
+                : "r" (new)
+                : "memory", "cc");
+  return old;
+}
+
+/* Atomically adds DELTA to *P. */
+static inline void
+atomic_add (int *p, int delta)
+{
+  asm volatile ("lock; addl %1, %0"
+                : "+m" (*p)
+                : "ir" (delta)
+                : "memory", "cc");
+}
+
+/* Initializes mutex M as unlocked. */
+void
+mutex_init (struct mutex *m)
+{
+  m->state = 0;
+}
+
+/* Acquires mutex M, sleeping until it becomes available if
+   necessary. */
+void
+mutex_acquire (struct mutex *m)
+{
+  int c = atomic_cmpxchg (&m->state, 0, 1);
+
+  if (c != 0)
+    {
+      /* Contended.  Mark the mutex as having waiters, so that
+         its holder wakes us up, and sleep until we get it. */
+      if (c != 2)
+        c = atomic_xchg (&m->state, 2);
+      while (c != 0)
+        {
+          futex_wait (&m->state, 2);
+          c = atomic_xchg (&m->state, 2);
+        }
+    }
+}
+
+/* Tries to acquire mutex M without sleeping.  Returns true if
+   successful, false if M is already held. */
+bool
+mutex_try_acquire (struct mutex *m)
+{
+  return atomic_cmpxchg (&m->state, 0, 1) == 0;
+}
+
+/* Releases mutex M, which the caller must hold, and wakes up a
+   waiter if there may be one. */
+void
+mutex_release (struct mutex *m)
+{
+  if (atomic_xchg (&m->state, 0) == 2)
+    futex_wake (&m->state, 1);
+}
+
+/* Initializes condition variable C. */
+void
+cond_init (struct condition *c)
+{
+  c->seq = 0;
+  c->waiters = 0;
+}
+
+/* Atomically releases M and waits for C to be signaled, then
+   reacquires M before returning.  M must be held.  As with any
+   condition variable, the caller must recheck its condition
+   afterward, since wakeups may be spurious. */
+void
+cond_wait (struct condition *c, struct mutex *m)
+{
+  int seq;
+
+  /* Count ourselves as a waiter before sampling SEQ.  Both are
+     locked operations, so a signaler that does not see us in
+     WAITERS has already changed SEQ, and futex_wait() returns
+     at once. */
+  atomic_add (&c->waiters, 1);
+  seq = *(volatile int *) &c->seq;
+  mutex_release (m);
+
+  futex_wait (&c->seq, seq);
+  atomic_add (&c->waiters, -1);
+
+  /* Reacquire M, marking it contended: other threads woken by a
+     broadcast may be sleeping on it too. */
+  while (atomic_xchg (&m->state, 2) != 0)
+    futex_wait (&m->state, 2);
+}
+
+/* Wakes up one thread waiting on C, if any.  M should be held,
+   so that a thread cannot check its condition and go to sleep
+   in between the caller changing the condition and signaling. */
+void
+cond_signal (struct condition *c, struct mutex *m UNUSED)
+{
+  atomic_add (&c->seq, 1);
+  if (*(volatile int *) &c->waiters > 0)
+    futex_wake (&c->seq, 1);
+}
+
+/* Wakes up all threads waiting on C.  M should be held. */
+void
+cond_broadcast (struct condition *c, struct mutex *m UNUSED)
+{
+  atomic_add (&c->seq, 1);
+  if (*(volatile int *) &c->waiters > 0)
+    futex_wake (&c->seq, INT_MAX);
+}
@@ -0,0 +1,45 @@
+#ifndef __LIB_USER_SYNCH_H
+#define __LIB_USER_SYNCH_H
+
+#include <stdbool.h>
+
+/* Mutex built on futex_wait() and futex_wake().
+
+   STATE is 0 if the mutex is unlocked, 1 if it is locked with
+   no waiters, and 2 if it is locked and other threads may be
+   waiting, so that acquiring and releasing a mutex that no
+   other thread wants never enters the kernel. */
+struct mutex
+  {
+    int state;                  /* 0, 1, or 2; see above. */
+  };
+
+/* Initializer for a mutex, which may also be zero-initialized. */
+#define MUTEX_INITIALIZER { 0 }
+
+void mutex_init (struct mutex *);
+void mutex_acquire (struct mutex *);
+bool mutex_try_acquire (struct mutex *);
+void mutex_release (struct mutex *);
+
+/* Condition variable built on futex_wait() and futex_wake().
+
+   SEQ changes on every signal, and waiters sleep until it does.
+   WAITERS counts the threads in cond_wait(), so that signaling a
+   condition with no waiters does not enter the kernel. */
+struct condition
+  {
+    int seq;                    /* Signal sequence number. */
+    int waiters;                /* Number of waiting threads. */
+  };
+
+/* Initializer for a condition variable, which may also be
+   zero-initialized. */
+#define CONDITION_INITIALIZER { 0, 0 }
+
+void cond_init (struct condition *);
+void cond_wait (struct condition *, struct mutex *);
+void cond_signal (struct condition *, struct mutex *);
+void cond_broadcast (struct condition *, struct mutex *);
+
+#endif /* lib/user/synch.h */
@@ -182,3 +182,21 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+bool
+schedstat (struct schedstat *st) 
+{
+  return syscall1 (SYS_SCHEDSTAT, st);
+}
+
+int
+futex_wait (int *uaddr, int val) 
+{
+  return syscall2 (SYS_FUTEX_WAIT, uaddr, val);
+}
+
+int
+futex_wake (int *uaddr, int cnt) 
+{
+  return syscall2 (SYS_FUTEX_WAKE, uaddr, cnt);
+}
@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 #include <debug.h>
+#include <schedstat.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -45,4 +46,11 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Scheduler statistics. */
+bool schedstat (struct schedstat *);
+
+/* User-space synchronization.  See lib/user/synch.h. */
+int futex_wait (int *uaddr, int val);
+int futex_wake (int *uaddr, int cnt);
+
 #endif /* lib/user/syscall.h */
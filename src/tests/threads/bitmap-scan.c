@@ -0,0 +1,168 @@
+/* Measures bitmap_scan() on a bitmap of 1M bits against the
+   bit-at-a-time search it replaced, and first-fit allocation
+   against next-fit allocation with bitmap_scan_from_hint().
+
+   We time three cases, each for BENCH_TICKS timer ticks:
+
+     - "full": every bit is set except for a group at the very
+       end, which must be found.  The old search called
+       bitmap_contains() once per bit; the new one skips whole
+       elements.
+
+     - "fragmented": each bit is set at random with probability
+       1/2, and we look for a group of 12 clear bits, which
+       takes a few runs of clear bits to find.
+
+     - "allocate": starting from an empty bitmap, we allocate
+       8-bit groups one after another, as free_map_allocate()
+       does, searching from bit 0 each time or from where the
+       last search left off.
+
+   Next fit may run out of room before the time is up; rates
+   are per second of time actually spent.  The old and new
+   searches must return the same results. */
+
+#include <stdio.h>
+#include <bitmap.h>
+#include <random.h>
+#include "tests/threads/tests.h"
+#include "devices/timer.h"
+
+#define BIT_CNT ((size_t) 1 << 20)
+#define BENCH_TICKS (TIMER_FREQ / 2)
+#define ALLOC_CNT 8
+
+static size_t old_scan (const struct bitmap *, size_t start, size_t cnt,
+                        bool value);
+static void compare (const char *name, struct bitmap *, size_t cnt);
+static void compare_allocate (struct bitmap *);
+static long long rate (long long cnt, int64_t start);
+
+void
+test_bitmap_scan (void)
+{
+  struct bitmap *b;
+  size_t i;
+
+  b = bitmap_create (BIT_CNT);
+  if (b == NULL)
+    fail ("bitmap_create failed");
+
+  bitmap_set_all (b, true);
+  bitmap_set_multiple (b, BIT_CNT - 64, 64, false);
+  compare ("full", b, 64);
+
+  random_init (0);
+  for (i = 0; i < BIT_CNT; i++)
+    bitmap_set (b, i, random_ulong () & 1);
+  compare ("fragmented", b, 12);
+
+  compare_allocate (b);
+  bitmap_destroy (b);
+}
+
+/* The search that bitmap_scan() used to do: test every starting
+   index in turn, one bit at a time. */
+static size_t
+old_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
+{
+  if (cnt <= bitmap_size (b))
+    {
+      size_t last = bitmap_size (b) - cnt;
+      size_t i, j;
+
+      for (i = start; i <= last; i++)
+        {
+          for (j = 0; j < cnt; j++)
+            if (bitmap_test (b, i + j) != value)
+              break;
+          if (j == cnt)
+            return i;
+        }
+    }
+  return BITMAP_ERROR;
+}
+
+/* Searches B for a group of CNT clear bits over and over, first
+   with old_scan() and then with bitmap_scan(), and reports the
+   rate of each. */
+static void
+compare (const char *name, struct bitmap *b, size_t cnt)
+{
+  long long old_cnt = 0, new_cnt = 0, old_rate;
+  size_t old_idx, new_idx;
+  int64_t start;
+
+  start = timer_ticks ();
+  do
+    {
+      old_idx = old_scan (b, 0, cnt, false);
+      old_cnt++;
+    }
+  while (timer_elapsed (start) < BENCH_TICKS);
+  old_rate = rate (old_cnt, start);
+
+  start = timer_ticks ();
+  do
+    {
+      new_idx = bitmap_scan (b, 0, cnt, false);
+      new_cnt++;
+    }
+  while (timer_elapsed (start) < BENCH_TICKS);
+
+  if (old_idx != new_idx)
+    fail ("%s: bitmap_scan() found bit %zu instead of %zu",
+          name, new_idx, old_idx);
+  msg ("%s: bit at a time %lld scans/s, word at a time %lld scans/s.",
+       name, old_rate, rate (new_cnt, start));
+}
+
+/* Allocates ALLOC_CNT-bit groups from B, emptied first, for
+   BENCH_TICKS with first-fit and then with next-fit searches,
+   and reports the rate of each. */
+static void
+compare_allocate (struct bitmap *b)
+{
+  long long first_cnt = 0, next_cnt = 0, first_rate;
+  size_t hint = 0;
+  int64_t start;
+
+  bitmap_set_all (b, false);
+  start = timer_ticks ();
+  while (timer_elapsed (start) < BENCH_TICKS)
+    {
+      size_t idx = bitmap_scan_and_flip (b, 0, ALLOC_CNT, false);
+      if (idx == BITMAP_ERROR)
+        break;
+      first_cnt++;
+    }
+  first_rate = rate (first_cnt, start);
+
+  bitmap_set_all (b, false);
+  start = timer_ticks ();
+  while (timer_elapsed (start) < BENCH_TICKS)
+    {
+      size_t idx = bitmap_scan_from_hint (b, hint, ALLOC_CNT, false);
+      if (idx == BITMAP_ERROR)
+        break;
+      if (idx != (size_t) next_cnt * ALLOC_CNT)
+        fail ("next-fit allocation %lld at bit %zu", next_cnt, idx);
+      bitmap_set_multiple (b, idx, ALLOC_CNT, true);
+      hint = idx + ALLOC_CNT;
+      next_cnt++;
+    }
+
+  msg ("allocate: first fit %lld allocations/s, "
+       "next fit %lld allocations/s.",
+       first_rate, rate (next_cnt, start));
+}
+
+/* Returns the rate per second of CNT operations done since
+   START. */
+static long long
+rate (long long cnt, int64_t start)
+{
+  int64_t elapsed = timer_elapsed (start);
+
+  return cnt * TIMER_FREQ / (elapsed > 0 ? elapsed : 1);
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+@output = get_core_output ("run", @output);
+
+foreach my $case ('full', 'fragmented') {
+    fail "$case results missing from output.\n"
+      if !grep (/^\(bitmap-scan\) $case: bit at a time \d+ scans\/s, word at a time \d+ scans\/s\.$/,
+		@output);
+}
+fail "allocate results missing from output.\n"
+  if !grep (/^\(bitmap-scan\) allocate: first fit \d+ allocations\/s, next fit \d+ allocations\/s\.$/,
+	    @output);
+pass;
@@ -0,0 +1,155 @@
+/* Measures the cost of waking WAITER_CNT threads with a
+   broadcast on a condition variable.
+
+   The waiters, which outrank the main thread, wait on a
+   condition variable until the main thread bumps a generation
+   count and broadcasts, ROUND_CNT times over.  We report the
+   time taken and how many times the waiters went to sleep.
+
+   We do this twice: once with the classic implementation of a
+   condition variable, in which every waiter sleeps on a
+   semaphore of its own, and then with struct condition.  In the
+   first case, a semaphore "up" wakes a waiter that, if it gets
+   to run right away, preempting the main thread or on another
+   CPU, only goes straight back to sleep waiting for the lock
+   that the main thread still holds.  With struct condition's
+   wait morphing, each waiter sleeps just once per round. */
+
+#include <stdio.h>
+#include <inttypes.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define WAITER_CNT 100
+#define ROUND_CNT 100
+
+/* A waiter in the classic implementation. */
+struct sema_waiter 
+  {
+    struct list_elem elem;
+    struct semaphore sema;
+  };
+
+static bool use_condition;
+static struct lock lock;
+static struct condition go_cond, ready_cond;
+static struct list sema_waiters;
+static int generation, arrived;
+static unsigned sleeps[WAITER_CNT];
+static struct semaphore done_sema;
+
+static thread_func waiter_thread;
+static void run (bool use_condition);
+static void wait_go (void);
+static void broadcast_go (void);
+
+void
+test_cond_broadcast (void) 
+{
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  lock_init (&lock);
+  cond_init (&go_cond);
+  cond_init (&ready_cond);
+  list_init (&sema_waiters);
+  sema_init (&done_sema, 0);
+
+  run (false);
+  run (true);
+}
+
+/* Runs the benchmark with struct condition if USE_CONDITION_ is
+   true, otherwise with per-waiter semaphores. */
+static void
+run (bool use_condition_) 
+{
+  long long total_sleeps = 0;
+  int64_t start, elapsed;
+  int i;
+
+  use_condition = use_condition_;
+  generation = arrived = 0;
+  for (i = 0; i < WAITER_CNT; i++)
+    thread_create ("waiter", PRI_DEFAULT + 1, waiter_thread, &sleeps[i]);
+
+  start = timer_ticks ();
+  for (i = 0; i < ROUND_CNT; i++) 
+    {
+      lock_acquire (&lock);
+      while (arrived < WAITER_CNT)
+        cond_wait (&ready_cond, &lock);
+      arrived = 0;
+      generation++;
+      broadcast_go ();
+      lock_release (&lock);
+    }
+  for (i = 0; i < WAITER_CNT; i++)
+    sema_down (&done_sema);
+  elapsed = timer_elapsed (start);
+
+  for (i = 0; i < WAITER_CNT; i++)
+    total_sleeps += sleeps[i];
+  msg ("%s: %d broadcasts to %d waiters in %"PRId64" ticks, %lld sleeps.",
+       use_condition ? "condition" : "semaphores", ROUND_CNT, WAITER_CNT,
+       elapsed, total_sleeps);
+}
+
+static void
+waiter_thread (void *sleeps_) 
+{
+  unsigned *sleeps = sleeps_;
+  struct schedstat before, after;
+  int i;
+
+  thread_get_schedstat (&before);
+  lock_acquire (&lock);
+  for (i = 0; i < ROUND_CNT; i++) 
+    {
+      int gen = generation;
+
+      if (++arrived == WAITER_CNT)
+        cond_signal (&ready_cond, &lock);
+      while (generation == gen)
+        wait_go ();
+    }
+  lock_release (&lock);
+  thread_get_schedstat (&after);
+
+  *sleeps = after.voluntary_switches - before.voluntary_switches;
+  sema_up (&done_sema);
+}
+
+/* Waits for the main thread to broadcast.  The lock must be
+   held. */
+static void
+wait_go (void) 
+{
+  if (use_condition)
+    cond_wait (&go_cond, &lock);
+  else 
+    {
+      struct sema_waiter w;
+
+      sema_init (&w.sema, 0);
+      list_push_back (&sema_waiters, &w.elem);
+      lock_release (&lock);
+      sema_down (&w.sema);
+      lock_acquire (&lock);
+    }
+}
+
+/* Wakes up every waiter.  The lock must be held. */
+static void
+broadcast_go (void) 
+{
+  if (use_condition)
+    cond_broadcast (&go_cond, &lock);
+  else
+    while (!list_empty (&sema_waiters))
+      sema_up (&list_entry (list_pop_front (&sema_waiters),
+                            struct sema_waiter, elem)->sema);
+}
@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+@output = get_core_output ("run", @output);
+
+my (%sleeps);
+foreach (@output) {
+    $sleeps{$1} = $2
+      if /^\(cond-broadcast\) (\w+): \d+ broadcasts to \d+ waiters in \d+ ticks, (\d+) sleeps\.$/;
+}
+foreach my $kind ('semaphores', 'condition') {
+    fail "$kind results missing from output.\n" if !defined $sleeps{$kind};
+}
+fail "Waiters slept $sleeps{condition} times with struct condition, "
+  . "but only $sleeps{semaphores} times with semaphores.\n"
+  if $sleeps{condition} >= $sleeps{semaphores};
+pass;
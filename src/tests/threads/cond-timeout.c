@@ -0,0 +1,117 @@
+/* Checks cond_wait_timeout().
+
+   First, a waiter that is never signaled must give up once its
+   timeout passes and return false, holding the lock again.
+   Then, a waiter that is signaled well before its deadline must
+   return true, holding the lock, and its cancelled timeout must
+   not fire later.  Last, a waiter with a one-tick timeout waits
+   over and over while the main thread signals as fast as it
+   can, so that signals and timeouts race; every wait must
+   return with the lock held, whichever way it ends. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define RACE_CNT 200
+
+static struct lock lock;
+static struct condition cond;
+static struct semaphore done_sema;
+static volatile bool race_done;
+
+static thread_func timeout_thread;
+static thread_func signaled_thread;
+static thread_func race_thread;
+
+void
+test_cond_timeout (void)
+{
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  lock_init (&lock);
+  cond_init (&cond);
+  sema_init (&done_sema, 0);
+
+  /* The waiter runs first, since it outranks us, and sleeps for
+     a tenth of the time that we do. */
+  thread_create ("timeout", PRI_DEFAULT + 1, timeout_thread, NULL);
+  timer_sleep (TIMER_FREQ);
+  sema_down (&done_sema);
+
+  thread_create ("signaled", PRI_DEFAULT + 1, signaled_thread, NULL);
+  lock_acquire (&lock);
+  msg ("Signaling.");
+  cond_signal (&cond, &lock);
+  lock_release (&lock);
+  sema_down (&done_sema);
+
+  /* Give the cancelled timeout a chance to go off, if it is
+     still pending. */
+  timer_sleep (2 * TIMER_FREQ);
+  msg ("No timeout fired after being cancelled.");
+
+  thread_create ("race", PRI_DEFAULT, race_thread, NULL);
+  while (!race_done)
+    {
+      lock_acquire (&lock);
+      cond_signal (&cond, &lock);
+      lock_release (&lock);
+      thread_yield ();
+    }
+  sema_down (&done_sema);
+}
+
+/* Waits with nobody to signal it. */
+static void
+timeout_thread (void *aux UNUSED)
+{
+  bool signaled;
+
+  lock_acquire (&lock);
+  signaled = cond_wait_timeout (&cond, &lock, TIMER_FREQ / 10);
+  msg ("timeout: cond_wait_timeout returned %s, lock %sheld.",
+       signaled ? "true" : "false",
+       lock_held_by_current_thread (&lock) ? "" : "not ");
+  lock_release (&lock);
+  sema_up (&done_sema);
+}
+
+/* Waits to be signaled by the main thread, with a deadline far
+   enough away that it should not be reached. */
+static void
+signaled_thread (void *aux UNUSED)
+{
+  bool signaled;
+
+  lock_acquire (&lock);
+  signaled = cond_wait_timeout (&cond, &lock, TIMER_FREQ);
+  msg ("signaled: cond_wait_timeout returned %s, lock %sheld.",
+       signaled ? "true" : "false",
+       lock_held_by_current_thread (&lock) ? "" : "not ");
+  lock_release (&lock);
+  sema_up (&done_sema);
+}
+
+/* Waits RACE_CNT times with a timeout of a single tick. */
+static void
+race_thread (void *aux UNUSED)
+{
+  int i;
+
+  for (i = 0; i < RACE_CNT; i++)
+    {
+      lock_acquire (&lock);
+      cond_wait_timeout (&cond, &lock, 1);
+      if (!lock_held_by_current_thread (&lock))
+        fail ("race: wait %d returned without the lock", i);
+      lock_release (&lock);
+    }
+  msg ("race: all %d waits returned with the lock held.", RACE_CNT);
+  race_done = true;
+  sema_up (&done_sema);
+}
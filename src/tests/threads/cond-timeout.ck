@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(cond-timeout) begin
+(cond-timeout) timeout: cond_wait_timeout returned false, lock held.
+(cond-timeout) Signaling.
+(cond-timeout) signaled: cond_wait_timeout returned true, lock held.
+(cond-timeout) No timeout fired after being cancelled.
+(cond-timeout) race: all 200 waits returned with the lock held.
+(cond-timeout) end
+EOF
+pass;
@@ -0,0 +1,78 @@
+/* Checks that an earliest-deadline-first thread gets its budget
+   in each period, but no more, so that ordinary threads still
+   get to run.
+
+   Creates an EDF thread with a budget of 2 ticks every 10 ticks
+   that spins without ever blocking, then spins itself for
+   RUN_TICKS ticks.  If the EDF thread were not throttled, the
+   main thread would never get to run again.  Also checks that
+   admission control refuses a thread that would overcommit the
+   CPU, which assumes that there is only one CPU. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define PERIOD 10
+#define BUDGET 2
+#define RUN_TICKS 200
+
+static thread_func spin_thread;
+static struct semaphore done_sema;
+static volatile bool done;
+static struct schedstat spin_stat;
+
+void
+test_edf_throttle (void) 
+{
+  int64_t start;
+  long long expected;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  sema_init (&done_sema, 0);
+  done = false;
+
+  msg ("Creating EDF thread with budget %d every %d ticks.",
+       BUDGET, PERIOD);
+  if (thread_create_deadline ("spin", PERIOD, BUDGET, PERIOD,
+                              spin_thread, NULL) == TID_ERROR)
+    fail ("could not create EDF thread");
+
+  if (thread_create_deadline ("greedy", PERIOD, PERIOD - BUDGET, PERIOD,
+                              spin_thread, NULL) != TID_ERROR)
+    fail ("admitted EDF thread that overcommits the CPU");
+  msg ("Overcommitting EDF thread rejected.");
+
+  /* The EDF thread preempts us for its budget in each period,
+     but we keep getting the rest. */
+  start = timer_ticks ();
+  while (timer_elapsed (start) < RUN_TICKS)
+    continue;
+  msg ("Main thread ran for %d ticks.", RUN_TICKS);
+
+  done = true;
+  sema_down (&done_sema);
+
+  /* The EDF thread should have run for about BUDGET ticks in
+     each of the RUN_TICKS / PERIOD periods. */
+  expected = (long long) RUN_TICKS / PERIOD * BUDGET;
+  if (spin_stat.run_ticks < expected * 3 / 4
+      || spin_stat.run_ticks > expected * 5 / 4 + BUDGET)
+    fail ("EDF thread ran %lld ticks, expected about %lld",
+          spin_stat.run_ticks, expected);
+  msg ("EDF thread ran for its budget in each period.");
+}
+
+static void
+spin_thread (void *aux UNUSED) 
+{
+  while (!done)
+    continue;
+  thread_get_schedstat (&spin_stat);
+  sema_up (&done_sema);
+}
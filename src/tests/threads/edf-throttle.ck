@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(edf-throttle) begin
+(edf-throttle) Creating EDF thread with budget 2 every 10 ticks.
+(edf-throttle) Overcommitting EDF thread rejected.
+(edf-throttle) Main thread ran for 200 ticks.
+(edf-throttle) EDF thread ran for its budget in each period.
+(edf-throttle) end
+EOF
+pass;
@@ -0,0 +1,53 @@
+/* Checks that the lock order validator reports an inversion, and
+   only that.
+
+   First, we nest several locks initialized by the same
+   lock_init() call, which must not be reported.  Then we take
+   two mutexes in one order and then in the other.  Neither
+   mutex is ever contended, so both are acquired without
+   sleeping; the second order must still be reported, along with
+   where the first was established.
+
+   The validator is only compiled in with "make LOCKDEP=1".
+   Otherwise, we just say so. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/synch.h"
+
+#define NEST_CNT 4
+
+void
+test_lockdep_inversion (void)
+{
+  struct lock locks[NEST_CNT];
+  struct mutex a, b;
+  int i;
+
+#ifndef LOCKDEP
+  msg ("Lockdep is not compiled in.  Build with \"make LOCKDEP=1\".");
+#endif
+
+  msg ("Nesting %d locks of one class in order.", NEST_CNT);
+  for (i = 0; i < NEST_CNT; i++)
+    lock_init (&locks[i]);
+  for (i = 0; i < NEST_CNT; i++)
+    lock_acquire (&locks[i]);
+  for (i = NEST_CNT - 1; i >= 0; i--)
+    lock_release (&locks[i]);
+
+  mutex_init (&a);
+  mutex_init (&b);
+
+  msg ("Taking mutexes a, b in that order.");
+  mutex_acquire (&a);
+  mutex_acquire (&b);
+  mutex_release (&b);
+  mutex_release (&a);
+
+  msg ("Taking mutexes b, a in the opposite order.");
+  mutex_acquire (&b);
+  mutex_acquire (&a);
+  mutex_release (&a);
+  mutex_release (&b);
+}
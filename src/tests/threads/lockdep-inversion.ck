@@ -0,0 +1,30 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+@output = get_core_output ("run", @output);
+
+pass "Lockdep is not compiled in, so nothing to check."
+  if grep (/^\(lockdep-inversion\) Lockdep is not compiled in/, @output);
+
+my (@reports) = grep (/^Lockdep: possible deadlock/, @output);
+fail "Expected 1 lockdep report, found " . scalar (@reports) . ".\n"
+  if @reports != 1;
+
+my ($report) = 0;
+$report++ while $output[$report] !~ /^Lockdep: possible deadlock/;
+fail "Lockdep reported a possible deadlock before the inversion.\n"
+  if !grep (/Taking mutexes b, a in the opposite order\./,
+	    @output[0...$report - 1]);
+
+fail "Report does not name the two mutexes.\n"
+  if !grep (/^It is acquiring a lock of class "&a" .* while holding one of class "&b" /,
+	    @output);
+fail "Report does not show where the first order was established.\n"
+  if !grep (/^Earlier, a lock of class "&b" .* was acquired while holding one of class "&a" /,
+	    @output);
+pass;
@@ -0,0 +1,185 @@
+/* Checks that malloc()'s per-CPU magazines never hand out a
+   block twice, and times malloc() and free() as the number of
+   threads allocating at once grows.
+
+   First, one thread allocates more blocks of one size than a
+   magazine holds, frees them all, so that some go back to the
+   depot, and allocates them again.  Each time, no two of the
+   blocks may overlap.
+
+   Then 1, 2, and 4 threads in turn each keep a small working
+   set of blocks of assorted sizes, repeatedly freeing one and
+   allocating a replacement, for ROUND_CNT rounds.  Each block
+   gets a tag, unique to its thread and allocation, at its start
+   and at its end, and the tags must still be there when the
+   block is freed: a block handed to two owners at once ends up
+   with one owner's tags in the other's block.  We also print how
+   long each thread count took.  With 4 CPUs ("pintos --smp=4",
+   as the test is run), each thread gets a CPU, and so a
+   magazine, of its own. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include "tests/threads/tests.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define THREAD_MAX 4
+#define ROUND_CNT 20000
+#define WORKING_SET 16
+
+/* More blocks than any magazine holds. */
+#define REUSE_CNT 100
+#define REUSE_SIZE 16
+
+static const size_t sizes[] = {16, 24, 48, 64, 100, 200, 256, 500};
+#define SIZE_CNT (sizeof sizes / sizeof *sizes)
+
+static struct semaphore start_gate, finish_line;
+
+static void check_reuse (void);
+static void check_disjoint (uint8_t *blocks[], int cnt, size_t size);
+static thread_func churn;
+
+void
+test_malloc_scale (void)
+{
+  int thread_cnt;
+
+  check_reuse ();
+
+  sema_init (&start_gate, 0);
+  sema_init (&finish_line, 0);
+  for (thread_cnt = 1; thread_cnt <= THREAD_MAX; thread_cnt *= 2)
+    {
+      int64_t start;
+      int i;
+
+      for (i = 0; i < thread_cnt; i++)
+        thread_create ("churn", PRI_DEFAULT, churn, (void *) i);
+      start = timer_ticks ();
+      for (i = 0; i < thread_cnt; i++)
+        sema_up (&start_gate);
+      for (i = 0; i < thread_cnt; i++)
+        sema_down (&finish_line);
+
+      msg ("%d thread(s) made %d malloc/free pairs each in %"PRId64
+           " ticks.", thread_cnt, ROUND_CNT, timer_elapsed (start));
+      msg ("%d thread(s): every block kept its owner's tags.", thread_cnt);
+    }
+}
+
+/* Allocates, frees, and reallocates more blocks than a magazine
+   holds, checking that they never overlap. */
+static void
+check_reuse (void)
+{
+  uint8_t *blocks[REUSE_CNT];
+  int round, i;
+
+  for (round = 0; round < 2; round++)
+    {
+      for (i = 0; i < REUSE_CNT; i++)
+        {
+          blocks[i] = malloc (REUSE_SIZE);
+          if (blocks[i] == NULL)
+            fail ("out of memory");
+        }
+      check_disjoint (blocks, REUSE_CNT, REUSE_SIZE);
+      for (i = 0; i < REUSE_CNT; i++)
+        free (blocks[i]);
+    }
+  msg ("%d blocks, freed and allocated again, never overlapped.",
+       REUSE_CNT);
+}
+
+/* Fails if any two of the CNT blocks in BLOCKS, each SIZE bytes
+   long, overlap. */
+static void
+check_disjoint (uint8_t *blocks[], int cnt, size_t size)
+{
+  int i, j;
+
+  for (i = 0; i < cnt; i++)
+    for (j = i + 1; j < cnt; j++)
+      if (blocks[i] < blocks[j] + size && blocks[j] < blocks[i] + size)
+        fail ("blocks %p and %p overlap", blocks[i], blocks[j]);
+}
+
+/* Returns the tag for the SERIAL'th allocation by thread ID. */
+static uint32_t
+make_tag (int id, unsigned serial)
+{
+  return ((uint32_t) id << 24) | (serial & 0xffffff);
+}
+
+/* Writes TAG at the start and the end of BLOCK, which is SIZE
+   bytes long. */
+static void
+put_tags (uint8_t *block, size_t size, uint32_t tag)
+{
+  *(uint32_t *) block = tag;
+  *(uint32_t *) (block + size - sizeof tag) = tag;
+}
+
+/* Fails unless BLOCK, SIZE bytes long, still has TAG at its
+   start and its end. */
+static void
+check_tags (uint8_t *block, size_t size, uint32_t tag)
+{
+  uint32_t head = *(uint32_t *) block;
+  uint32_t tail = *(uint32_t *) (block + size - sizeof tag);
+
+  if (head != tag || tail != tag)
+    fail ("block %p tagged %#"PRIx32" has %#"PRIx32" and %#"PRIx32,
+          block, tag, head, tail);
+}
+
+/* Replaces the blocks in a working set ROUND_CNT times, checking
+   each block's tags before freeing it.  ID_ tells this thread's
+   tags apart from the others'. */
+static void
+churn (void *id_)
+{
+  int id = (int) id_;
+  uint8_t *blocks[WORKING_SET];
+  size_t block_sizes[WORKING_SET];
+  uint32_t tags[WORKING_SET];
+  unsigned serial = 0;
+  unsigned i;
+
+  sema_down (&start_gate);
+  for (i = 0; i < WORKING_SET; i++)
+    {
+      block_sizes[i] = sizes[i % SIZE_CNT];
+      blocks[i] = malloc (block_sizes[i]);
+      if (blocks[i] == NULL)
+        fail ("out of memory");
+      tags[i] = make_tag (id, serial++);
+      put_tags (blocks[i], block_sizes[i], tags[i]);
+    }
+
+  for (i = 0; i < ROUND_CNT; i++)
+    {
+      unsigned slot = i % WORKING_SET;
+
+      check_tags (blocks[slot], block_sizes[slot], tags[slot]);
+      free (blocks[slot]);
+      block_sizes[slot] = sizes[(i / WORKING_SET + slot) % SIZE_CNT];
+      blocks[slot] = malloc (block_sizes[slot]);
+      if (blocks[slot] == NULL)
+        fail ("out of memory");
+      tags[slot] = make_tag (id, serial++);
+      put_tags (blocks[slot], block_sizes[slot], tags[slot]);
+    }
+
+  for (i = 0; i < WORKING_SET; i++)
+    {
+      check_tags (blocks[i], block_sizes[i], tags[i]);
+      free (blocks[i]);
+    }
+  sema_up (&finish_line);
+}
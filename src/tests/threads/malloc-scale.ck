@@ -0,0 +1,26 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+
+# The timings vary from run to run, so we check the lines that
+# report them only for their form and then set them aside.
+my ($timing) = qr/^\(malloc-scale\) \d thread\(s\) made 20000 malloc\/free pairs each in \d+ ticks\.$/;
+my (@timings) = grep (/$timing/, @output);
+fail "Expected 3 timing lines, found " . scalar (@timings) . ".\n"
+  if @timings != 3;
+@output = grep (!/$timing/, @output);
+
+compare_output ("run", \@output, [<<'EOF']);
+(malloc-scale) begin
+(malloc-scale) 100 blocks, freed and allocated again, never overlapped.
+(malloc-scale) 1 thread(s): every block kept its owner's tags.
+(malloc-scale) 2 thread(s): every block kept its owner's tags.
+(malloc-scale) 4 thread(s): every block kept its owner's tags.
+(malloc-scale) end
+EOF
+pass;
@@ -0,0 +1,137 @@
+/* Hammers a critical section a few instructions long with four
+   threads at once, first under a plain lock and then under an
+   adaptive mutex.
+
+   Inside the critical section, each thread reads a shared count,
+   notes that it is inside, and writes the count back plus one.
+   If two threads were ever inside together, one of them sees the
+   other's mark, and updates are lost, so the count comes out
+   short.  Either way, the test fails.
+
+   With more than one CPU ("pintos --smp=4", as the test is run),
+   a thread that finds the mutex held is almost always looking at
+   a holder running on another CPU, so some acquisitions must
+   have waited it out by spinning instead of going to sleep; the
+   mutex counts those.  We also print how long each kind of lock
+   took and how often the threads slept, for comparison. */
+
+#include <stdio.h>
+#include <inttypes.h>
+#include "tests/threads/tests.h"
+#include "threads/cpu.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define CONTENDER_CNT 4
+#define INCREMENTS 20000
+
+static struct lock lock;
+static struct mutex mutex;
+static bool contend_on_mutex;
+
+static volatile int count;
+static volatile bool inside, overlapped;
+static unsigned sleeps;
+static struct semaphore start_gate, finish_line;
+
+static thread_func contender;
+static void contend (bool on_mutex);
+
+void
+test_mutex_hot (void)
+{
+  lock_init (&lock);
+  mutex_init (&mutex);
+  sema_init (&start_gate, 0);
+  sema_init (&finish_line, 0);
+
+  contend (false);
+  contend (true);
+
+  if (cpu_cnt == 1)
+    msg ("Only one CPU, so the mutex had no running holder to spin on.");
+  else if (mutex.spin_acquires == 0)
+    fail ("mutex never waited out a running holder on %d CPUs", cpu_cnt);
+  else
+    msg ("mutex: some acquisitions spun instead of sleeping.");
+}
+
+/* Lets CONTENDER_CNT threads loose on the mutex, if ON_MUTEX, or
+   on the lock, and checks and reports how it went. */
+static void
+contend (bool on_mutex)
+{
+  const char *name = on_mutex ? "mutex" : "lock";
+  int64_t start;
+  int i;
+
+  contend_on_mutex = on_mutex;
+  count = 0;
+  sleeps = 0;
+  for (i = 0; i < CONTENDER_CNT; i++)
+    thread_create (name, PRI_DEFAULT, contender, NULL);
+
+  /* Open the gate only once everyone is lined up. */
+  start = timer_ticks ();
+  for (i = 0; i < CONTENDER_CNT; i++)
+    sema_up (&start_gate);
+  for (i = 0; i < CONTENDER_CNT; i++)
+    sema_down (&finish_line);
+
+  msg ("%s: %d x %d increments took %"PRId64" ticks, with %u sleeps.",
+       name, CONTENDER_CNT, INCREMENTS, timer_elapsed (start), sleeps);
+  if (overlapped)
+    fail ("%s: two threads were in the critical section at once", name);
+  if (count != CONTENDER_CNT * INCREMENTS)
+    fail ("%s: count is %d, not %d", name, count,
+          CONTENDER_CNT * INCREMENTS);
+  msg ("%s: every increment was exclusive.", name);
+}
+
+/* Increments COUNT INCREMENTS times under the lock or mutex. */
+static void
+contender (void *aux UNUSED)
+{
+  struct schedstat before, after;
+  int i;
+
+  sema_down (&start_gate);
+  thread_get_schedstat (&before);
+  for (i = 0; i < INCREMENTS; i++)
+    {
+      int old;
+
+      if (contend_on_mutex)
+        mutex_acquire (&mutex);
+      else
+        lock_acquire (&lock);
+
+      old = count;
+      if (inside)
+        overlapped = true;
+      inside = true;
+      count = old + 1;
+      inside = false;
+
+      if (contend_on_mutex)
+        mutex_release (&mutex);
+      else
+        lock_release (&lock);
+    }
+  thread_get_schedstat (&after);
+
+  /* Each contender adds its own sleeps while holding the lock
+     under test for one last time. */
+  if (contend_on_mutex)
+    mutex_acquire (&mutex);
+  else
+    lock_acquire (&lock);
+  sleeps += after.voluntary_switches - before.voluntary_switches;
+  if (contend_on_mutex)
+    mutex_release (&mutex);
+  else
+    lock_release (&lock);
+
+  sema_up (&finish_line);
+}
@@ -0,0 +1,24 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+@output = get_core_output ("run", @output);
+
+# The timings vary from run to run, so we only check that they
+# were printed, and then that every check passed.
+foreach my $kind ('lock', 'mutex') {
+    fail "No timing for the $kind.\n"
+      if !grep (/^\(mutex-hot\) $kind: 4 x 20000 increments took \d+ ticks, with \d+ sleeps\.$/,
+		@output);
+    fail "The $kind did not keep the increments exclusive.\n"
+      if !grep (/^\(mutex-hot\) $kind: every increment was exclusive\.$/,
+		@output);
+}
+fail "The mutex never spun.\n"
+  if !grep (/^\(mutex-hot\) (mutex: some acquisitions spun instead of sleeping|Only one CPU, .*)\.$/,
+	    @output);
+pass;
@@ -0,0 +1,115 @@
+/* Checks that the page allocator does not stay fragmented.
+
+   We find the largest power-of-2 number of pages that can be
+   allocated at once, then allocate and free runs of assorted
+   lengths, in random order, many times over, checking that no
+   two runs overlap.  Once everything is freed, the buddy system
+   should have merged free memory back together, so the same
+   large allocation must succeed again. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <random.h>
+#include "tests/threads/tests.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+#define RUN_MAX 32              /* Runs allocated at once. */
+#define RUN_PAGES 9             /* Maximum pages in a run. */
+#define ITERATIONS 4000
+
+struct run
+  {
+    uint8_t *pages;             /* First page, or null. */
+    size_t page_cnt;            /* Number of pages. */
+  };
+
+static size_t largest_allocation (void);
+static void fill_run (struct run *, uint8_t value);
+static void check_run (struct run *, uint8_t value);
+
+void
+test_palloc_buddy (void)
+{
+  static struct run runs[RUN_MAX];
+  size_t largest;
+  int i;
+
+  largest = largest_allocation ();
+  if (largest == 0)
+    fail ("could not allocate even one page");
+
+  msg ("Allocating and freeing runs of pages.");
+  random_init (0);
+  for (i = 0; i < ITERATIONS; i++)
+    {
+      struct run *r = &runs[random_ulong () % RUN_MAX];
+
+      if (r->pages != NULL)
+        {
+          check_run (r, r - runs);
+          palloc_free_multiple (r->pages, r->page_cnt);
+          r->pages = NULL;
+        }
+      else
+        {
+          r->page_cnt = random_ulong () % RUN_PAGES + 1;
+          r->pages = palloc_get_multiple (0, r->page_cnt);
+          if (r->pages != NULL)
+            fill_run (r, r - runs);
+        }
+    }
+
+  msg ("Freeing all runs.");
+  for (i = 0; i < RUN_MAX; i++)
+    if (runs[i].pages != NULL)
+      {
+        check_run (&runs[i], i);
+        palloc_free_multiple (runs[i].pages, runs[i].page_cnt);
+      }
+
+  msg ("Allocating the largest block again.");
+  if (largest_allocation () < largest)
+    fail ("free memory was not merged back together");
+}
+
+/* Returns the largest power-of-2 number of pages that can be
+   allocated at once, or 0 if no page is available. */
+static size_t
+largest_allocation (void)
+{
+  size_t cnt;
+
+  for (cnt = (size_t) 1 << 14; cnt > 0; cnt /= 2)
+    {
+      void *pages = palloc_get_multiple (0, cnt);
+      if (pages != NULL)
+        {
+          palloc_free_multiple (pages, cnt);
+          return cnt;
+        }
+    }
+  return 0;
+}
+
+/* Fills every page of R with VALUE. */
+static void
+fill_run (struct run *r, uint8_t value)
+{
+  memset (r->pages, value, r->page_cnt * PGSIZE);
+}
+
+/* Checks that every page of R still holds VALUE at both ends. */
+static void
+check_run (struct run *r, uint8_t value)
+{
+  size_t i;
+
+  for (i = 0; i < r->page_cnt; i++)
+    {
+      uint8_t *page = r->pages + i * PGSIZE;
+      if (page[0] != value || page[PGSIZE - 1] != value)
+        fail ("page %zu of run %d was overwritten", i, (int) value);
+    }
+}
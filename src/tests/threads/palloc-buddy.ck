@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(palloc-buddy) begin
+(palloc-buddy) Allocating and freeing runs of pages.
+(palloc-buddy) Freeing all runs.
+(palloc-buddy) Allocating the largest block again.
+(palloc-buddy) end
+EOF
+pass;
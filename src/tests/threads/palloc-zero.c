@@ -0,0 +1,59 @@
+/* Checks that pages allocated with PAL_ZERO are entirely zero,
+   whether they come from the stock of pages zeroed ahead of time
+   by idle CPUs or are zeroed on demand.
+
+   Each round, we sleep so that the idle thread gets a chance to
+   refill the stock, then allocate more PAL_ZERO pages than the
+   stock holds, check every byte of each, scribble on them, and
+   free them, so that the next round's pages are dirty unless
+   they were zeroed again. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "tests/threads/tests.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+#include "devices/timer.h"
+
+#define ROUNDS 4
+#define PAGE_CNT 64
+
+static bool is_zero (const uint8_t *page);
+
+void
+test_palloc_zero (void)
+{
+  static uint8_t *pages[PAGE_CNT];
+  int round, i;
+
+  for (round = 0; round < ROUNDS; round++)
+    {
+      msg ("Round %d.", round);
+      timer_sleep (TIMER_FREQ / 10);
+
+      for (i = 0; i < PAGE_CNT; i++)
+        {
+          pages[i] = palloc_get_page (PAL_ZERO);
+          if (pages[i] == NULL)
+            fail ("out of pages");
+          if (!is_zero (pages[i]))
+            fail ("page %d of round %d is not zeroed", i, round);
+          memset (pages[i], 0x5a, PGSIZE);
+        }
+      for (i = 0; i < PAGE_CNT; i++)
+        palloc_free_page (pages[i]);
+    }
+}
+
+/* Returns true if every byte of PAGE is zero. */
+static bool
+is_zero (const uint8_t *page)
+{
+  size_t i;
+
+  for (i = 0; i < PGSIZE; i++)
+    if (page[i] != 0)
+      return false;
+  return true;
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(palloc-zero) begin
+(palloc-zero) Round 0.
+(palloc-zero) Round 1.
+(palloc-zero) Round 2.
+(palloc-zero) Round 3.
+(palloc-zero) end
+EOF
+pass;
@@ -0,0 +1,65 @@
+/* The main thread acquires a readers-writer lock for reading.
+   Then it creates a higher-priority writer, which blocks because
+   of the reader, and a still higher-priority reader, which
+   blocks behind the waiting writer.  Both must donate their
+   priorities to the main thread.  When the main thread releases
+   the lock, the writer acquires it and must receive the waiting
+   reader's priority in turn, and when the writer releases it,
+   the reader must run at once. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+static thread_func writer_thread_func;
+static thread_func reader_thread_func;
+
+void
+test_priority_donate_rw (void)
+{
+  struct rwlock rw;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  /* Make sure our priority is the default. */
+  ASSERT (thread_get_priority () == PRI_DEFAULT);
+
+  rw_init (&rw);
+  rw_read_acquire (&rw);
+  thread_create ("writer", PRI_DEFAULT + 1, writer_thread_func, &rw);
+  msg ("This thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 1, thread_get_priority ());
+  thread_create ("reader", PRI_DEFAULT + 2, reader_thread_func, &rw);
+  msg ("This thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 2, thread_get_priority ());
+  rw_read_release (&rw);
+  msg ("writer, reader must already have finished.");
+  msg ("This thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT, thread_get_priority ());
+}
+
+static void
+writer_thread_func (void *rw_)
+{
+  struct rwlock *rw = rw_;
+
+  rw_write_acquire (rw);
+  msg ("writer: got the lock.  It should have priority %d.  "
+       "Actual priority: %d.", PRI_DEFAULT + 2, thread_get_priority ());
+  rw_write_release (rw);
+  msg ("writer: done");
+}
+
+static void
+reader_thread_func (void *rw_)
+{
+  struct rwlock *rw = rw_;
+
+  rw_read_acquire (rw);
+  msg ("reader: got the lock");
+  rw_read_release (rw);
+  msg ("reader: done");
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(priority-sema-requeue) begin
+(priority-sema-requeue) Thread L acquired lock.
+(priority-sema-requeue) Thread L downed semaphore.
+(priority-sema-requeue) Thread H acquired lock.
+(priority-sema-requeue) Thread H finished.
+(priority-sema-requeue) Thread L finished.
+(priority-sema-requeue) Thread M finished.
+(priority-sema-requeue) Main thread finished.
+(priority-sema-requeue) end
+EOF
+pass;
@@ -0,0 +1,270 @@
+/* Checks that RCU defers freeing an unlinked object until every
+   reader that might see it is done, on a list searched the way
+   inode_open() searches the open inodes.
+
+   First, with one object unlinked and handed to call_rcu() from
+   inside a read-side critical section, the callback must not
+   run until the critical section ends, and then it must run.
+
+   Then READER_CNT threads each look up every key in a list of
+   OBJ_CNT objects LOOKUP_ROUNDS times, while this thread keeps
+   replacing the objects, each key in turn, and freeing the old
+   copies through call_rcu().  While a reader is looking at an
+   object, it says so in its slot of HOLDING[].  When an object
+   is freed, no reader may be holding it and it must no longer
+   be on the list; a reader that meets a freed object also fails
+   the test.  For comparison, the same is done with the readers
+   taking the writers' lock instead, and we print how long each
+   took; with more than one CPU ("pintos --smp=4", as the test
+   is run), RCU's readers do not wait for each other. */
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <list.h>
+#include "tests/threads/tests.h"
+#include "threads/malloc.h"
+#include "threads/rcu.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define READER_CNT 4
+#define OBJ_CNT 16
+#define LOOKUP_ROUNDS 500
+
+#define OBJ_MAGIC 0x4f424a45
+#define OBJ_FREED 0xdeadbeef
+
+/* A list entry, standing in for a struct inode. */
+struct obj
+  {
+    struct list_elem elem;
+    int key;
+    unsigned magic;
+    struct rcu_head rcu;
+  };
+
+static struct list objs;
+static struct lock objs_lock;   /* Serializes writers of OBJS. */
+static bool readers_use_rcu;
+
+/* The object each reader is looking at, if any.  The last slot
+   belongs to the test's own thread. */
+static struct obj *volatile holding[READER_CNT + 1];
+
+static volatile int freed;
+static int readers_done;
+static struct semaphore start_gate;
+
+static void check_deferral (void);
+static void churn (bool use_rcu);
+static struct obj *new_obj (int key);
+static struct obj *lookup (int key);
+static thread_func reader;
+static rcu_func free_obj;
+
+void
+test_rcu_lookup (void)
+{
+  int i;
+
+  list_init (&objs);
+  lock_init (&objs_lock);
+  for (i = OBJ_CNT - 1; i >= 0; i--)
+    list_push_front (&objs, &new_obj (i)->elem);
+
+  check_deferral ();
+  churn (false);
+  churn (true);
+}
+
+/* Unlinks an object from within a read-side critical section
+   and checks that its callback waits for the section to end. */
+static void
+check_deferral (void)
+{
+  enum intr_level old_level;
+  struct obj *o;
+  int i;
+
+  /* No other thread uses the list yet, so we may unlink without
+     objs_lock, which the callback needs. */
+  old_level = rcu_read_lock ();
+  o = lookup (0);
+  holding[READER_CNT] = o;
+  rcu_list_remove (&o->elem);
+  call_rcu (&o->rcu, free_obj);
+
+  /* Give another CPU plenty of time to run the callback, if it
+     wrongly would. */
+  for (i = 0; i < 1000000; i++)
+    asm volatile ("pause" : : : "memory");
+  if (freed != 0 || o->magic != OBJ_MAGIC)
+    fail ("object freed during the read-side critical section");
+  holding[READER_CNT] = NULL;
+  rcu_read_unlock (old_level);
+  rcu_list_push_front (&objs, &new_obj (0)->elem);
+  msg ("Callback held off while we were reading the unlinked object.");
+
+  for (i = 0; i < TIMER_FREQ && freed == 0; i++)
+    timer_sleep (1);
+  if (freed != 1)
+    fail ("callback did not run after the read-side critical section");
+  msg ("Callback ran once we were done.");
+}
+
+/* Runs the readers, using RCU if USE_RCU or otherwise the
+   writers' lock, while replacing objects, and checks and
+   reports how it went. */
+static void
+churn (bool use_rcu)
+{
+  const char *name = use_rcu ? "rcu" : "lock";
+  int replaced = 0;
+  int freed_before = freed;
+  int64_t start;
+  int i;
+
+  readers_use_rcu = use_rcu;
+  readers_done = 0;
+  sema_init (&start_gate, 0);
+  for (i = 0; i < READER_CNT; i++)
+    thread_create ("reader", PRI_DEFAULT, reader, (void *) i);
+
+  start = timer_ticks ();
+  for (i = 0; i < READER_CNT; i++)
+    sema_up (&start_gate);
+  for (;;)
+    {
+      struct obj *new = new_obj (replaced % OBJ_CNT);
+      struct obj *old;
+      bool all_done;
+
+      /* Publish the new copy before unlinking the old one, so
+         that a reader starting from the front finds one of
+         them. */
+      lock_acquire (&objs_lock);
+      old = lookup (new->key);
+      rcu_list_push_front (&objs, &new->elem);
+      rcu_list_remove (&old->elem);
+      all_done = readers_done == READER_CNT;
+      lock_release (&objs_lock);
+      replaced++;
+
+      if (use_rcu)
+        call_rcu (&old->rcu, free_obj);
+      else
+        free_obj (&old->rcu);
+      if (all_done)
+        break;
+      thread_yield ();
+    }
+
+  for (i = 0; i < TIMER_FREQ && freed - freed_before < replaced; i++)
+    timer_sleep (1);
+  if (freed - freed_before != replaced)
+    fail ("%s: %d objects replaced but %d freed",
+          name, replaced, freed - freed_before);
+  msg ("%s: %d readers did %d lookups each in %"PRId64" ticks, "
+       "during %d replacements.", name, READER_CNT,
+       LOOKUP_ROUNDS * OBJ_CNT, timer_elapsed (start), replaced);
+  msg ("%s: no reader met a freed object.", name);
+}
+
+/* Returns a new object with KEY. */
+static struct obj *
+new_obj (int key)
+{
+  struct obj *o = malloc (sizeof *o);
+
+  ASSERT (o != NULL);
+  o->key = key;
+  o->magic = OBJ_MAGIC;
+  return o;
+}
+
+/* Returns the object with KEY, or a null pointer if there is
+   none.  The caller must hold objs_lock or be in an RCU
+   read-side critical section.  Fails if it comes across a freed
+   object. */
+static struct obj *
+lookup (int key)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&objs); e != list_end (&objs); e = list_next (e))
+    {
+      struct obj *o = list_entry (e, struct obj, elem);
+      if (o->magic != OBJ_MAGIC)
+        fail ("met freed object %p", o);
+      if (o->key == key)
+        return o;
+    }
+  return NULL;
+}
+
+/* Looks up every key LOOKUP_ROUNDS times, noting the object it
+   finds in its slot, SLOT_, of HOLDING[] for as long as it looks
+   at it.  Under RCU, a key may be briefly missing while its
+   object is replaced. */
+static void
+reader (void *slot_)
+{
+  int slot = (int) slot_;
+  int i;
+
+  sema_down (&start_gate);
+  for (i = 0; i < LOOKUP_ROUNDS * OBJ_CNT; i++)
+    {
+      enum intr_level old_level = INTR_ON;
+      struct obj *o;
+
+      if (readers_use_rcu)
+        old_level = rcu_read_lock ();
+      else
+        lock_acquire (&objs_lock);
+
+      o = lookup (i % OBJ_CNT);
+      if (o != NULL)
+        {
+          holding[slot] = o;
+          if (o->magic != OBJ_MAGIC || o->key != i % OBJ_CNT)
+            fail ("object changed under a reader");
+          holding[slot] = NULL;
+        }
+      else if (!readers_use_rcu)
+        fail ("key %d missing under the lock", i % OBJ_CNT);
+
+      if (readers_use_rcu)
+        rcu_read_unlock (old_level);
+      else
+        lock_release (&objs_lock);
+    }
+
+  lock_acquire (&objs_lock);
+  readers_done++;
+  lock_release (&objs_lock);
+}
+
+/* Checks that nothing can reach the object that contains HEAD,
+   then poisons and frees it. */
+static void
+free_obj (struct rcu_head *head)
+{
+  struct obj *o = rcu_entry (head, struct obj, rcu);
+  struct list_elem *e;
+  int i;
+
+  lock_acquire (&objs_lock);
+  for (e = list_begin (&objs); e != list_end (&objs); e = list_next (e))
+    if (e == &o->elem)
+      fail ("freeing object %d while it is still on the list", o->key);
+  for (i = 0; i < READER_CNT + 1; i++)
+    if (holding[i] == o)
+      fail ("freeing object %d while a reader holds it", o->key);
+  lock_release (&objs_lock);
+
+  o->magic = OBJ_FREED;
+  free (o);
+  freed++;
+}
@@ -0,0 +1,26 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+
+# The timings vary from run to run, so we check the lines that
+# report them only for their form and then set them aside.
+my ($timing) = qr/^\(rcu-lookup\) (rcu|lock): 4 readers did 8000 lookups each in \d+ ticks, during \d+ replacements\.$/;
+my (@timings) = grep (/$timing/, @output);
+fail "Expected 2 timing lines, found " . scalar (@timings) . ".\n"
+  if @timings != 2;
+@output = grep (!/$timing/, @output);
+
+compare_output ("run", \@output, [<<'EOF']);
+(rcu-lookup) begin
+(rcu-lookup) Callback held off while we were reading the unlinked object.
+(rcu-lookup) Callback ran once we were done.
+(rcu-lookup) lock: no reader met a freed object.
+(rcu-lookup) rcu: no reader met a freed object.
+(rcu-lookup) end
+EOF
+pass;
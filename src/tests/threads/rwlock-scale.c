@@ -0,0 +1,258 @@
+/* Checks that a readers-writer lock lets readers share it and
+   keeps writers to themselves, then compares how long a mix of
+   readers and writers takes under it and under a plain lock.
+
+   The first part is deterministic.  While this thread holds the
+   lock for reading, another reader must get in, a writer must
+   not, and a writer that blocks must stay out until we leave.
+   While we hold it for writing, nobody else may get in.
+
+   The second part lets READER_CNT readers and WRITER_CNT writers
+   loose on the lock at once, each for a fixed number of turns.
+   Everyone keeps a census of who is inside: a writer must always
+   be alone.  With more than one CPU ("pintos --smp=4", as the
+   test is run), readers should also find each other inside, and
+   the readers-writer lock should get through the same work in
+   fewer ticks than the plain lock, though neither is checked,
+   since both depend on timing. */
+
+#include <stdio.h>
+#include <inttypes.h>
+#include "tests/threads/tests.h"
+#include "threads/interrupt.h"
+#include "threads/spinlock.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define READER_CNT 4
+#define WRITER_CNT 2
+#define READ_TURNS 5000
+#define WRITE_TURNS 200
+
+static struct rwlock rwlock;
+static struct lock lock;
+static struct semaphore answered;
+
+static void check_sharing (void);
+static void mix (bool on_rwlock);
+
+void
+test_rwlock_scale (void)
+{
+  rw_init (&rwlock);
+  lock_init (&lock);
+  sema_init (&answered, 0);
+
+  check_sharing ();
+  mix (true);
+  mix (false);
+}
+
+/* Part one: probes RWLOCK from other threads while this thread
+   holds it. */
+
+static bool read_ok, write_ok;
+static volatile bool writer_got_in;
+
+/* Tries to acquire RWLOCK both ways without blocking and reports
+   which succeeded in READ_OK and WRITE_OK. */
+static void
+try_both (void *aux UNUSED)
+{
+  read_ok = rw_read_try_acquire (&rwlock);
+  if (read_ok)
+    rw_read_release (&rwlock);
+  write_ok = rw_write_try_acquire (&rwlock);
+  if (write_ok)
+    rw_write_release (&rwlock);
+  sema_up (&answered);
+}
+
+/* Acquires RWLOCK for reading, blocking if need be. */
+static void
+second_reader (void *aux UNUSED)
+{
+  rw_read_acquire (&rwlock);
+  rw_read_release (&rwlock);
+  sema_up (&answered);
+}
+
+/* Acquires RWLOCK for writing, blocking if need be, and says so
+   in WRITER_GOT_IN. */
+static void
+blocked_writer (void *aux UNUSED)
+{
+  rw_write_acquire (&rwlock);
+  writer_got_in = true;
+  rw_write_release (&rwlock);
+  sema_up (&answered);
+}
+
+static void
+check_sharing (void)
+{
+  rw_read_acquire (&rwlock);
+
+  thread_create ("second reader", PRI_DEFAULT, second_reader, NULL);
+  sema_down (&answered);
+  msg ("Holding it for reading, a second reader got in.");
+
+  thread_create ("try both", PRI_DEFAULT, try_both, NULL);
+  sema_down (&answered);
+  if (!read_ok || write_ok)
+    fail ("holding it for reading, read try %s and write try %s",
+          read_ok ? "succeeded" : "failed",
+          write_ok ? "succeeded" : "failed");
+  msg ("Holding it for reading, a reader could try in, a writer not.");
+
+  thread_create ("blocked writer", PRI_DEFAULT, blocked_writer, NULL);
+  timer_sleep (TIMER_FREQ / 10);
+  if (writer_got_in)
+    fail ("writer got in while we were reading");
+  rw_read_release (&rwlock);
+  sema_down (&answered);
+  if (!writer_got_in)
+    fail ("writer did not get in after we stopped reading");
+  msg ("A blocked writer got in only after we stopped reading.");
+
+  rw_write_acquire (&rwlock);
+  thread_create ("try both", PRI_DEFAULT, try_both, NULL);
+  sema_down (&answered);
+  if (read_ok || write_ok)
+    fail ("holding it for writing, read try %s and write try %s",
+          read_ok ? "succeeded" : "failed",
+          write_ok ? "succeeded" : "failed");
+  rw_write_release (&rwlock);
+  msg ("Holding it for writing, neither a reader nor a writer got in.");
+}
+
+/* Part two: a mix of readers and writers.  Who is inside the
+   lock under test is counted under CENSUS_LOCK. */
+
+static bool mix_on_rwlock;
+static struct spinlock census_lock;
+static int readers_inside, writers_inside;
+static int most_readers_inside;
+static bool writer_had_company;
+static struct semaphore start_gate, finish_line;
+
+/* Records that the running thread entered the lock under test,
+   as a writer if WRITER. */
+static void
+enter (bool writer)
+{
+  enum intr_level old_level = intr_disable ();
+
+  spinlock_acquire (&census_lock);
+  if (writer)
+    {
+      if (readers_inside > 0 || writers_inside > 0)
+        writer_had_company = true;
+      writers_inside++;
+    }
+  else
+    {
+      if (writers_inside > 0)
+        writer_had_company = true;
+      if (++readers_inside > most_readers_inside)
+        most_readers_inside = readers_inside;
+    }
+  spinlock_release (&census_lock);
+  intr_set_level (old_level);
+}
+
+/* Records that the running thread left the lock under test. */
+static void
+leave (bool writer)
+{
+  enum intr_level old_level = intr_disable ();
+
+  spinlock_acquire (&census_lock);
+  if (writer)
+    writers_inside--;
+  else
+    readers_inside--;
+  spinlock_release (&census_lock);
+  intr_set_level (old_level);
+}
+
+static void
+reader (void *aux UNUSED)
+{
+  int i;
+
+  sema_down (&start_gate);
+  for (i = 0; i < READ_TURNS; i++)
+    {
+      if (mix_on_rwlock)
+        rw_read_acquire (&rwlock);
+      else
+        lock_acquire (&lock);
+      enter (false);
+      leave (false);
+      if (mix_on_rwlock)
+        rw_read_release (&rwlock);
+      else
+        lock_release (&lock);
+    }
+  sema_up (&finish_line);
+}
+
+static void
+writer (void *aux UNUSED)
+{
+  int i;
+
+  sema_down (&start_gate);
+  for (i = 0; i < WRITE_TURNS; i++)
+    {
+      if (mix_on_rwlock)
+        rw_write_acquire (&rwlock);
+      else
+        lock_acquire (&lock);
+      enter (true);
+      leave (true);
+      if (mix_on_rwlock)
+        rw_write_release (&rwlock);
+      else
+        lock_release (&lock);
+      thread_yield ();
+    }
+  sema_up (&finish_line);
+}
+
+/* Runs the mix on RWLOCK, if ON_RWLOCK, or otherwise on LOCK,
+   and checks and reports how it went. */
+static void
+mix (bool on_rwlock)
+{
+  const char *name = on_rwlock ? "rwlock" : "lock";
+  int64_t start;
+  int i;
+
+  mix_on_rwlock = on_rwlock;
+  spinlock_init (&census_lock);
+  most_readers_inside = 0;
+  writer_had_company = false;
+  sema_init (&start_gate, 0);
+  sema_init (&finish_line, 0);
+  for (i = 0; i < READER_CNT; i++)
+    thread_create ("reader", PRI_DEFAULT, reader, NULL);
+  for (i = 0; i < WRITER_CNT; i++)
+    thread_create ("writer", PRI_DEFAULT, writer, NULL);
+
+  start = timer_ticks ();
+  for (i = 0; i < READER_CNT + WRITER_CNT; i++)
+    sema_up (&start_gate);
+  for (i = 0; i < READER_CNT + WRITER_CNT; i++)
+    sema_down (&finish_line);
+
+  msg ("%s: %d readers and %d writers finished in %"PRId64" ticks; "
+       "at most %d readers were inside at once.",
+       name, READER_CNT, WRITER_CNT, timer_elapsed (start),
+       most_readers_inside);
+  if (writer_had_company)
+    fail ("%s: a writer was inside along with someone else", name);
+  msg ("%s: writers were always alone.", name);
+}
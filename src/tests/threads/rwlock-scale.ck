@@ -0,0 +1,28 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+
+# The timings vary from run to run, so we check the lines that
+# report them only for their form and then set them aside.
+my ($timing) = qr/^\(rwlock-scale\) (rw)?lock: 4 readers and 2 writers finished in \d+ ticks; at most \d+ readers were inside at once\.$/;
+my (@timings) = grep (/$timing/, @output);
+fail "Expected 2 timing lines, found " . scalar (@timings) . ".\n"
+  if @timings != 2;
+@output = grep (!/$timing/, @output);
+
+compare_output ("run", \@output, [<<'EOF']);
+(rwlock-scale) begin
+(rwlock-scale) Holding it for reading, a second reader got in.
+(rwlock-scale) Holding it for reading, a reader could try in, a writer not.
+(rwlock-scale) A blocked writer got in only after we stopped reading.
+(rwlock-scale) Holding it for writing, neither a reader nor a writer got in.
+(rwlock-scale) rwlock: writers were always alone.
+(rwlock-scale) lock: writers were always alone.
+(rwlock-scale) end
+EOF
+pass;
@@ -0,0 +1,72 @@
+/* Measures the cost of a thread switch between two threads that
+   take turns.
+
+   The main thread and a partner thread pass control back and
+   forth with a pair of semaphores until BENCH_TICKS timer ticks
+   have passed, and report the resulting switch rate.  Each
+   round trip is two thread switches.
+
+   This covers only the path through schedule(), switch_threads,
+   and schedule_tail() between kernel threads.  This kernel has
+   no page directories at all, so it says nothing about the cost
+   of reloading CR3.  For that, the userprog kernel prints a
+   "Paging:" line at shutdown with the number of CR3 loads and
+   the number that pagedir_activate() skipped because the page
+   directory was already loaded; their sum is how many loads
+   there would have been without the skip. */
+
+#include <stdio.h>
+#include <inttypes.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define BENCH_TICKS (2 * TIMER_FREQ)
+
+static thread_func pong_thread;
+static struct semaphore ping_sema, pong_sema;
+static volatile bool done;
+
+void
+test_sched_pingpong (void) 
+{
+  long long round_trips = 0;
+  int64_t start, elapsed;
+
+  sema_init (&ping_sema, 0);
+  sema_init (&pong_sema, 0);
+  done = false;
+
+  thread_create ("pong", PRI_DEFAULT, pong_thread, NULL);
+
+  msg ("Passing control back and forth for %d ticks...", BENCH_TICKS);
+  start = timer_ticks ();
+  while (timer_elapsed (start) < BENCH_TICKS) 
+    {
+      sema_up (&pong_sema);
+      sema_down (&ping_sema);
+      round_trips++;
+    }
+  elapsed = timer_elapsed (start);
+  done = true;
+  sema_up (&pong_sema);
+  sema_down (&ping_sema);
+
+  msg ("%lld round trips in %"PRId64" ticks.", round_trips, elapsed);
+  msg ("%lld switches per second.", round_trips * 2 * TIMER_FREQ / elapsed);
+}
+
+static void
+pong_thread (void *aux UNUSED) 
+{
+  for (;;) 
+    {
+      sema_down (&pong_sema);
+      if (done)
+        break;
+      sema_up (&ping_sema);
+    }
+  sema_up (&ping_sema);
+}
@@ -0,0 +1,87 @@
+/* Measures the cost of a thread switch with a long run queue.
+
+   Creates THREAD_CNT threads at the default priority, each of
+   which calls thread_yield() in a loop until BENCH_TICKS timer
+   ticks have passed, and reports the resulting switch rate.
+   With a constant-time run queue the rate should not depend on
+   the number of ready threads.
+
+   Needs more than the default 4 MB of RAM for all the thread
+   stacks. */
+
+#include <stdio.h>
+#include <inttypes.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define THREAD_CNT 1000
+#define BENCH_TICKS (2 * TIMER_FREQ)
+
+static thread_func yield_thread;
+static struct semaphore done_sema;
+static int64_t deadline;
+
+void
+test_sched_switch (void) 
+{
+  int *yield_cnts;
+  long long total;
+  int64_t start, elapsed;
+  int i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  yield_cnts = malloc (sizeof *yield_cnts * THREAD_CNT);
+  ASSERT (yield_cnts != NULL);
+  sema_init (&done_sema, 0);
+
+  /* Outrank the yielding threads so that none of them runs
+     until all of them exist and the deadline is set. */
+  thread_set_priority (PRI_DEFAULT + 1);
+
+  msg ("Creating %d threads...", THREAD_CNT);
+  for (i = 0; i < THREAD_CNT; i++) 
+    {
+      char name[16];
+
+      yield_cnts[i] = 0;
+      snprintf (name, sizeof name, "yield %d", i);
+      if (thread_create (name, PRI_DEFAULT, yield_thread, &yield_cnts[i])
+          == TID_ERROR)
+        fail ("could not create thread %d", i);
+    }
+
+  msg ("Yielding for %d ticks...", BENCH_TICKS);
+  start = timer_ticks ();
+  deadline = start + BENCH_TICKS;
+  for (i = 0; i < THREAD_CNT; i++) 
+    sema_down (&done_sema);
+  elapsed = timer_elapsed (start);
+
+  total = 0;
+  for (i = 0; i < THREAD_CNT; i++) 
+    total += yield_cnts[i];
+  msg ("%lld switches in %"PRId64" ticks.", total, elapsed);
+  msg ("%lld switches per second.", total * TIMER_FREQ / elapsed);
+
+  thread_set_priority (PRI_DEFAULT);
+  free (yield_cnts);
+}
+
+static void
+yield_thread (void *yield_cnt_) 
+{
+  int *yield_cnt = yield_cnt_;
+
+  while (timer_ticks () < deadline) 
+    {
+      ++*yield_cnt;
+      thread_yield ();
+    }
+  sema_up (&done_sema);
+}
@@ -0,0 +1,201 @@
+/* Checks that seqlock readers never see a write half done, on a
+   64-bit count read the way every CPU reads timer_ticks().
+
+   First, a read with a write in the middle of it must be told to
+   retry, and one without must not.
+
+   Then a writer counts from 0 to WRITE_CNT, storing each number
+   in both 32-bit halves of VALUE, while READER_CNT readers read
+   VALUE as fast as they can.  A read with unequal halves was
+   torn, and a read smaller than the one before went back in
+   time; either fails the test.  Once the writer is done, every
+   reader must see exactly WRITE_CNT.
+
+   The same is done with a spinlock with interrupts off, as
+   timer_ticks() used to take, and for each we print how many
+   reads the readers made in how many ticks.  With more than one
+   CPU ("pintos --smp=4", as the test is run), the spinlock's
+   cache line bounces between the readers, whereas seqlock
+   readers only share it. */
+
+#include <stdio.h>
+#include <inttypes.h>
+#include "tests/threads/tests.h"
+#include "threads/interrupt.h"
+#include "threads/spinlock.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define READER_CNT 4
+#define WRITE_CNT 100000
+
+static struct seqlock seq;
+static struct spinlock spin;
+static bool on_seqlock;
+
+static volatile uint64_t value;
+static volatile bool writer_done;
+static long long reads[READER_CNT];
+static struct semaphore start_gate, finish_line;
+
+static void check_retry (void);
+static void count (bool on_seqlock);
+static thread_func reader, writer;
+
+void
+test_seqlock_read (void)
+{
+  seqlock_init (&seq);
+  spinlock_init (&spin);
+
+  check_retry ();
+  count (false);
+  count (true);
+}
+
+/* Checks seqlock_read_retry() with and without a write during
+   the read. */
+static void
+check_retry (void)
+{
+  enum intr_level old_level;
+  unsigned s;
+
+  s = seqlock_read_begin (&seq);
+  if (seqlock_read_retry (&seq, s))
+    fail ("read with no write was told to retry");
+
+  s = seqlock_read_begin (&seq);
+  old_level = intr_disable ();
+  seqlock_write_begin (&seq);
+  seqlock_write_end (&seq);
+  intr_set_level (old_level);
+  if (!seqlock_read_retry (&seq, s))
+    fail ("read with a write in the middle was not told to retry");
+
+  msg ("Only a read that overlapped a write was told to retry.");
+}
+
+/* Runs the writer and readers on the seqlock, if ON_SEQLOCK_, or
+   else on the spinlock, and checks and reports how it went. */
+static void
+count (bool on_seqlock_)
+{
+  const char *name = on_seqlock_ ? "seqlock" : "spinlock";
+  long long total = 0;
+  int64_t start;
+  int i;
+
+  on_seqlock = on_seqlock_;
+  value = 0;
+  writer_done = false;
+  sema_init (&start_gate, 0);
+  sema_init (&finish_line, 0);
+  thread_create ("writer", PRI_DEFAULT, writer, NULL);
+  for (i = 0; i < READER_CNT; i++)
+    thread_create ("reader", PRI_DEFAULT, reader, (void *) i);
+
+  start = timer_ticks ();
+  for (i = 0; i < READER_CNT + 1; i++)
+    sema_up (&start_gate);
+  for (i = 0; i < READER_CNT + 1; i++)
+    sema_down (&finish_line);
+
+  for (i = 0; i < READER_CNT; i++)
+    total += reads[i];
+  msg ("%s: %d readers made %lld reads during %d writes, in %"PRId64
+       " ticks.", name, READER_CNT, total, WRITE_CNT,
+       timer_elapsed (start));
+  msg ("%s: every read was whole and in order, and ended at %d.",
+       name, WRITE_CNT);
+}
+
+/* Returns a copy of VALUE, read under the lock being tested. */
+static uint64_t
+read_value (void)
+{
+  uint64_t v;
+
+  if (on_seqlock)
+    {
+      unsigned s;
+
+      do
+        {
+          s = seqlock_read_begin (&seq);
+          v = value;
+        }
+      while (seqlock_read_retry (&seq, s));
+    }
+  else
+    {
+      enum intr_level old_level = intr_disable ();
+      spinlock_acquire (&spin);
+      v = value;
+      spinlock_release (&spin);
+      intr_set_level (old_level);
+    }
+  return v;
+}
+
+/* Reads VALUE until the writer is done, and then once more,
+   checking every copy, and counts its reads in READS[SLOT_]. */
+static void
+reader (void *slot_)
+{
+  int slot = (int) slot_;
+  uint64_t last = 0;
+  bool done;
+
+  sema_down (&start_gate);
+  reads[slot] = 0;
+  do
+    {
+      uint64_t v;
+
+      done = writer_done;
+      v = read_value ();
+      if ((uint32_t) v != (uint32_t) (v >> 32))
+        fail ("read torn value %#"PRIx64, v);
+      if (v < last)
+        fail ("read %"PRIu32" after %"PRIu32,
+              (uint32_t) v, (uint32_t) last);
+      last = v;
+      reads[slot]++;
+    }
+  while (!done);
+
+  if ((uint32_t) last != WRITE_CNT)
+    fail ("writer done, but read %"PRIu32, (uint32_t) last);
+  sema_up (&finish_line);
+}
+
+/* Counts VALUE up to WRITE_CNT, yielding now and then so that on
+   a single CPU the readers get to run. */
+static void
+writer (void *aux UNUSED)
+{
+  int i;
+
+  sema_down (&start_gate);
+  for (i = 1; i <= WRITE_CNT; i++)
+    {
+      enum intr_level old_level = intr_disable ();
+      if (on_seqlock)
+        seqlock_write_begin (&seq);
+      else
+        spinlock_acquire (&spin);
+      value = ((uint64_t) i << 32) | i;
+      if (on_seqlock)
+        seqlock_write_end (&seq);
+      else
+        spinlock_release (&spin);
+      intr_set_level (old_level);
+
+      if (i % 64 == 0)
+        thread_yield ();
+    }
+  writer_done = true;
+  sema_up (&finish_line);
+}
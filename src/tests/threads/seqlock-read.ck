@@ -0,0 +1,26 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+
+# The read counts and timings vary from run to run, so we check
+# the lines that report them only for their form and then set
+# them aside.
+my ($timing) = qr/^\(seqlock-read\) (seq|spin)lock: 4 readers made \d+ reads during 100000 writes, in \d+ ticks\.$/;
+my (@timings) = grep (/$timing/, @output);
+fail "Expected 2 timing lines, found " . scalar (@timings) . ".\n"
+  if @timings != 2;
+@output = grep (!/$timing/, @output);
+
+compare_output ("run", \@output, [<<'EOF']);
+(seqlock-read) begin
+(seqlock-read) Only a read that overlapped a write was told to retry.
+(seqlock-read) spinlock: every read was whole and in order, and ended at 100000.
+(seqlock-read) seqlock: every read was whole and in order, and ended at 100000.
+(seqlock-read) end
+EOF
+pass;
@@ -0,0 +1,117 @@
+/* Checks the object cache allocator.
+
+   We fill three slabs of a cache of 100-byte objects, which
+   must be packed at exactly that stride, and check that the
+   constructor ran once per object and that successive slabs are
+   coloured differently.  Then we free everything and check that
+   freed objects keep their constructed state, that all but one
+   empty slab went back to the page allocator, and that the
+   destructor ran once for each object in those slabs. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include "tests/threads/tests.h"
+#include "threads/slab.h"
+#include "threads/vaddr.h"
+
+#define OBJ_SIZE 100
+#define OBJ_MAGIC 0x0b7ec7ed
+#define SLAB_CNT 3
+#define OBJ_MAX 256
+
+struct obj
+  {
+    unsigned magic;
+    uint8_t payload[OBJ_SIZE - sizeof (unsigned)];
+  };
+
+static int ctor_cnt, dtor_cnt;
+
+static kmem_ctor obj_ctor;
+static kmem_dtor obj_dtor;
+
+void
+test_slab_cache (void)
+{
+  static struct obj *objs[OBJ_MAX];
+  struct kmem_cache *cache;
+  size_t per_slab, obj_cnt;
+  bool coloured = false;
+  size_t i;
+
+  cache = kmem_cache_create ("slab-cache", sizeof (struct obj), 0,
+                             obj_ctor, obj_dtor);
+  if (cache == NULL)
+    fail ("kmem_cache_create failed");
+  per_slab = cache->per_slab;
+  obj_cnt = per_slab * SLAB_CNT;
+  if (obj_cnt > OBJ_MAX)
+    fail ("%zu objects per slab is too many for this test", per_slab);
+
+  msg ("Allocating %d slabs' worth of objects.", SLAB_CNT);
+  for (i = 0; i < obj_cnt; i++)
+    {
+      objs[i] = kmem_cache_alloc (cache);
+      if (objs[i] == NULL)
+        fail ("allocation %zu failed", i);
+      if (objs[i]->magic != OBJ_MAGIC)
+        fail ("object %zu was not constructed", i);
+      if (i % per_slab != 0
+          && (uint8_t *) objs[i] - (uint8_t *) objs[i - 1] != OBJ_SIZE)
+        fail ("object %zu is not packed after object %zu", i, i - 1);
+      if (i % per_slab == 0 && i > 0
+          && pg_ofs (objs[i]) != pg_ofs (objs[i - per_slab]))
+        coloured = true;
+    }
+  if (ctor_cnt != (int) obj_cnt)
+    fail ("constructor ran %d times for %zu objects", ctor_cnt, obj_cnt);
+  if (cache->slab_cnt != SLAB_CNT)
+    fail ("%zu slabs in use, expected %d", cache->slab_cnt, SLAB_CNT);
+  if (cache->colour_cnt > 1 && !coloured)
+    fail ("slabs were not coloured");
+
+  msg ("Freeing all objects.");
+  for (i = 0; i < obj_cnt; i++)
+    {
+      kmem_cache_free (cache, objs[i]);
+      if (i < per_slab && objs[i]->magic != OBJ_MAGIC)
+        fail ("object %zu lost its constructed state", i);
+    }
+  if (cache->slab_cnt != 1)
+    fail ("%zu empty slabs kept, expected 1", cache->slab_cnt);
+  if (dtor_cnt != (int) (obj_cnt - per_slab))
+    fail ("destructor ran %d times, expected %zu",
+          dtor_cnt, obj_cnt - per_slab);
+
+  msg ("Reallocating from the empty slab.");
+  objs[0] = kmem_cache_alloc (cache);
+  if (objs[0] == NULL || objs[0]->magic != OBJ_MAGIC)
+    fail ("reallocated object not in constructed state");
+  if (ctor_cnt != (int) obj_cnt)
+    fail ("constructor ran again for a cached object");
+  kmem_cache_free (cache, objs[0]);
+
+  msg ("Destroying cache.");
+  kmem_cache_destroy (cache);
+  if (dtor_cnt != ctor_cnt)
+    fail ("destructor ran %d times for %d objects", dtor_cnt, ctor_cnt);
+}
+
+static void
+obj_ctor (void *obj_)
+{
+  struct obj *obj = obj_;
+
+  obj->magic = OBJ_MAGIC;
+  ctor_cnt++;
+}
+
+static void
+obj_dtor (void *obj_)
+{
+  struct obj *obj = obj_;
+
+  ASSERT (obj->magic == OBJ_MAGIC);
+  obj->magic = 0;
+  dtor_cnt++;
+}
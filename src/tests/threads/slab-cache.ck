@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(slab-cache) begin
+(slab-cache) Allocating 3 slabs' worth of objects.
+(slab-cache) Freeing all objects.
+(slab-cache) Reallocating from the empty slab.
+(slab-cache) Destroying cache.
+(slab-cache) end
+EOF
+pass;
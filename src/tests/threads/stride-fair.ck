@@ -0,0 +1,35 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+@output = get_core_output ("run", @output);
+
+my (@tickets, @ticks);
+foreach (@output) {
+    next if !/Thread (\d+) with (\d+) tickets received (\d+) ticks\./;
+    $tickets[$1] = $2;
+    $ticks[$1] = $3;
+}
+fail "Missing tick counts.\n" if @ticks != 3 || grep (!defined, @ticks);
+
+my ($total_tickets, $total_ticks) = (0, 0);
+$total_tickets += $_ foreach @tickets;
+$total_ticks += $_ foreach @ticks;
+fail "Threads received no ticks.\n" if $total_ticks == 0;
+
+my ($bad) = 0;
+for my $i (0...$#ticks) {
+    my ($expected) = $tickets[$i] / $total_tickets * 100;
+    my ($actual) = $ticks[$i] / $total_ticks * 100;
+    if (abs ($actual - $expected) > 2) {
+	print sprintf ("Thread %d received %.1f%% of the ticks, "
+		       . "expected %.1f%%.\n", $i, $actual, $expected);
+	$bad = 1;
+    }
+}
+fail "Some shares off by more than 2 percentage points.\n" if $bad;
+pass;
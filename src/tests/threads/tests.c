@@ -25,6 +25,8 @@ static const struct test tests[] =
     {"priority-donate-sema", test_priority_donate_sema},
     {"priority-donate-lower", test_priority_donate_lower},
     {"priority-donate-chain", test_priority_donate_chain},
+    {"priority-sema-requeue", test_priority_sema_requeue},
+    {"priority-donate-rw", test_priority_donate_rw},
     {"priority-fifo", test_priority_fifo},
     {"priority-preempt", test_priority_preempt},
     {"priority-sema", test_priority_sema},
@@ -38,6 +40,22 @@ static const struct test tests[] =
     {"mlfqs-nice-2", test_mlfqs_nice_2},
     {"mlfqs-nice-10", test_mlfqs_nice_10},
     {"mlfqs-block", test_mlfqs_block},
+    {"sched-switch", test_sched_switch},
+    {"sched-pingpong", test_sched_pingpong},
+    {"edf-throttle", test_edf_throttle},
+    {"stride-fair", test_stride_fair},
+    {"rwlock-scale", test_rwlock_scale},
+    {"mutex-hot", test_mutex_hot},
+    {"cond-broadcast", test_cond_broadcast},
+    {"cond-timeout", test_cond_timeout},
+    {"rcu-lookup", test_rcu_lookup},
+    {"seqlock-read", test_seqlock_read},
+    {"slab-cache", test_slab_cache},
+    {"malloc-scale", test_malloc_scale},
+    {"palloc-buddy", test_palloc_buddy},
+    {"palloc-zero", test_palloc_zero},
+    {"bitmap-scan", test_bitmap_scan},
+    {"lockdep-inversion", test_lockdep_inversion},
   };
 
 static const char *test_name;
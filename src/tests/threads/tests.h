@@ -19,6 +19,8 @@ extern test_func test_priority_donate_sema;
 extern test_func test_priority_donate_nest;
 extern test_func test_priority_donate_lower;
 extern test_func test_priority_donate_chain;
+extern test_func test_priority_sema_requeue;
+extern test_func test_priority_donate_rw;
 extern test_func test_priority_fifo;
 extern test_func test_priority_preempt;
 extern test_func test_priority_sema;
@@ -32,6 +34,22 @@ extern test_func test_mlfqs_fair_20;
 extern test_func test_mlfqs_nice_2;
 extern test_func test_mlfqs_nice_10;
 extern test_func test_mlfqs_block;
+extern test_func test_sched_switch;
+extern test_func test_sched_pingpong;
+extern test_func test_edf_throttle;
+extern test_func test_stride_fair;
+extern test_func test_rwlock_scale;
+extern test_func test_mutex_hot;
+extern test_func test_cond_broadcast;
+extern test_func test_cond_timeout;
+extern test_func test_rcu_lookup;
+extern test_func test_seqlock_read;
+extern test_func test_slab_cache;
+extern test_func test_malloc_scale;
+extern test_func test_palloc_buddy;
+extern test_func test_palloc_zero;
+extern test_func test_bitmap_scan;
+extern test_func test_lockdep_inversion;
 
 void msg (const char *, ...);
 void fail (const char *, ...);
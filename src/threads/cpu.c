@@ -0,0 +1,422 @@
+#include "threads/cpu.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/lapic.h"
+#include "devices/timer.h"
+#include "threads/flags.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/io.h"
+#include "threads/loader.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/vaddr.h"
+#ifdef USERPROG
+#include "userprog/gdt.h"
+#include "userprog/pagedir.h"
+#endif
+
+/* Multiprocessor support.
+
+   At boot, only the bootstrap processor (BSP) runs.  cpu_init()
+   finds the other CPUs, the application processors (APs), by
+   reading the MP configuration table that the BIOS leaves in
+   memory, and cpu_start_aps() wakes them up.  See [MP] for the
+   table formats and the start-up protocol.
+
+   All device interrupts still go through the 8259A PICs to the
+   BSP only.  The BSP forwards each timer tick to the APs as an
+   inter-processor interrupt, and a CPU that wakes up a thread
+   queued on another, idle or lower-priority, CPU sends it a
+   reschedule interrupt.  With a single CPU, or without an MP
+   table, none of this is set up and Pintos runs exactly as a
+   uniprocessor kernel.
+
+   The MP table parsing, the IMCR switch, the local APIC
+   inter-processor interrupts, and the AP start-up code have not
+   yet been run on any emulator or machine, so by default
+   cpu_init() leaves all of it alone and only the BSP runs.  The
+   "-smp" kernel option turns it on. */
+
+/* All the CPUs. */
+struct cpu cpus[CPU_MAX];
+
+/* Number of CPUs found by cpu_init(). */
+int cpu_cnt = 1;
+
+/* If false (default), run on the BSP only.
+   If true, find and start the application processors.
+   Controlled by kernel command-line option "-smp". */
+bool cpu_smp;
+
+/* True once any application processor has started. */
+static bool aps_started;
+
+/* MP floating pointer structure.  See [MP] 4.1. */
+struct mp_fp
+  {
+    char signature[4];          /* "_MP_". */
+    uint32_t config;            /* Physical address of mp_config. */
+    uint8_t length;             /* Length in 16-byte units (1). */
+    uint8_t spec_rev;           /* MP specification revision. */
+    uint8_t checksum;           /* Makes all bytes sum to 0. */
+    uint8_t features[5];        /* Feature information bytes. */
+  };
+
+/* Bit in mp_fp's features[1]: IMCR present, PIC mode in use. */
+#define MP_FEATURE_IMCRP 0x80
+
+/* MP configuration table header.  See [MP] 4.2. */
+struct mp_config
+  {
+    char signature[4];          /* "PCMP". */
+    uint16_t length;            /* Length of base table, in bytes. */
+    uint8_t spec_rev;           /* MP specification revision. */
+    uint8_t checksum;           /* Makes base table sum to 0. */
+    char oem_id[8];             /* OEM identifier. */
+    char product_id[12];        /* Product identifier. */
+    uint32_t oem_table;         /* Physical address of OEM table. */
+    uint16_t oem_table_size;    /* Size of OEM table. */
+    uint16_t entry_cnt;         /* Number of entries after header. */
+    uint32_t lapic_paddr;       /* Physical address of local APICs. */
+    uint16_t ext_length;        /* Length of extended entries. */
+    uint8_t ext_checksum;       /* Checksum of extended entries. */
+    uint8_t reserved;
+  };
+
+/* MP configuration table processor entry.  See [MP] 4.3.1.
+   Every other type of entry is 8 bytes long. */
+#define MP_PROC 0               /* Entry type of a processor. */
+struct mp_proc
+  {
+    uint8_t type;               /* MP_PROC. */
+    uint8_t apic_id;            /* Local APIC ID. */
+    uint8_t apic_version;       /* Local APIC version. */
+    uint8_t flags;              /* MP_PROC_* flags. */
+    uint32_t signature;         /* CPU signature. */
+    uint32_t features;          /* CPU feature flags. */
+    uint32_t reserved[2];
+  };
+#define MP_PROC_EN 0x01         /* Processor usable. */
+#define MP_PROC_BP 0x02         /* Bootstrap processor. */
+
+static struct mp_fp *mp_find (void);
+static struct mp_fp *mp_search (uintptr_t paddr, size_t size);
+static bool checksum_ok (const void *, size_t size);
+static intr_handler_func tick_interrupt;
+static intr_handler_func resched_interrupt;
+static intr_handler_func halt_interrupt;
+#ifdef USERPROG
+static intr_handler_func pagedir_interrupt;
+#endif
+static intr_handler_func spurious_interrupt;
+void cpu_ap_main (void) NO_RETURN;
+
+/* Finds the CPUs in the system and initializes the BSP's local
+   APIC.  Must be called after paging_init(), since it changes
+   the kernel page tables. */
+void
+cpu_init (void)
+{
+  struct mp_fp *fp;
+  struct mp_config *conf;
+  uint8_t *p, *end;
+  int i;
+
+  cpus[0].started = true;
+  if (!cpu_smp)
+    return;
+
+  fp = mp_find ();
+  if (fp == NULL || fp->config == 0
+      || fp->config + sizeof *conf > ram_pages * PGSIZE)
+    return;
+  conf = ptov (fp->config);
+  if (memcmp (conf->signature, "PCMP", 4)
+      || conf->length < sizeof *conf
+      || fp->config + conf->length > ram_pages * PGSIZE
+      || !checksum_ok (conf, conf->length))
+    return;
+
+  /* Find the application processors. */
+  p = (uint8_t *) (conf + 1);
+  end = (uint8_t *) conf + conf->length;
+  for (i = 0; i < conf->entry_cnt && p < end; i++)
+    if (*p == MP_PROC)
+      {
+        struct mp_proc *proc = (struct mp_proc *) p;
+        if ((proc->flags & MP_PROC_EN) && !(proc->flags & MP_PROC_BP))
+          {
+            if (cpu_cnt < CPU_MAX)
+              cpus[cpu_cnt++].apic_id = proc->apic_id;
+            else
+              printf ("cpu: ignoring CPU with APIC ID %d, "
+                      "only %d CPUs supported\n", proc->apic_id, CPU_MAX);
+          }
+        p += sizeof *proc;
+      }
+    else
+      p += 8;
+
+  if (cpu_cnt == 1)
+    return;
+  for (i = 0; i < cpu_cnt; i++)
+    cpus[i].id = i;
+
+  /* If the BIOS left the PICs wired directly to the BSP, route
+     them through its local APIC instead, by way of the IMCR.
+     See [MP] 3.6.2.1 "PIC Mode". */
+  if (fp->features[1] & MP_FEATURE_IMCRP)
+    {
+      outb (0x22, 0x70);
+      outb (0x23, inb (0x23) | 1);
+    }
+
+  lapic_map (conf->lapic_paddr);
+  lapic_init (true);
+  cpus[0].apic_id = lapic_id ();
+}
+
+/* Starts all the application processors found by cpu_init(),
+   one at a time.  Must be called with interrupts on, after the
+   timer has been calibrated. */
+void
+cpu_start_aps (void)
+{
+  extern char ap_start[], ap_start_end[];
+  extern uint32_t ap_cr3, ap_esp;
+  uint8_t *code = ptov (AP_START_PADDR);
+  uint32_t *pd;
+  int started = 1;
+  int i;
+
+  ASSERT (intr_get_level () == INTR_ON);
+
+  if (cpu_cnt == 1)
+    return;
+
+  intr_register_ext (LAPIC_VEC_TICK, tick_interrupt, "LAPIC Tick");
+  intr_register_ext (LAPIC_VEC_RESCHED, resched_interrupt, "LAPIC Resched");
+  intr_register_ext (LAPIC_VEC_HALT, halt_interrupt, "LAPIC Halt");
+#ifdef USERPROG
+  intr_register_ext (LAPIC_VEC_PAGEDIR, pagedir_interrupt, "LAPIC Pagedir");
+#endif
+  intr_register_ext (LAPIC_VEC_SPURIOUS, spurious_interrupt,
+                     "LAPIC Spurious");
+
+  /* The APs turn on paging while still executing the start-up
+     code at its physical address, so they need a page directory
+     that maps the bottom 4 MB of physical memory at virtual
+     address 0 as well as at PHYS_BASE. */
+  pd = palloc_get_page (PAL_ASSERT);
+  memcpy (pd, base_page_dir, PGSIZE);
+  pd[0] = pd[pd_no (PHYS_BASE)];
+
+  /* Copy the start-up code into place. */
+  memcpy (code, ap_start, ap_start_end - ap_start);
+  *(uint32_t *) (code + ((char *) &ap_cr3 - ap_start)) = vtop (pd);
+
+  for (i = 1; i < cpu_cnt; i++)
+    {
+      struct cpu *c = &cpus[i];
+      struct thread *idle = thread_create_idle (c);
+      int64_t start;
+
+      if (idle == NULL)
+        {
+          printf ("cpu: out of memory starting CPU %d\n", i);
+          break;
+        }
+
+      /* Start the AP on its idle thread's stack and wait up to a
+         second for it to come up.  It must be done with the
+         start-up code before we can start the next one. */
+      *(uint32_t *) (code + ((char *) &ap_esp - ap_start))
+        = (uintptr_t) idle + PGSIZE;
+      lapic_start_ap (c->apic_id, AP_START_PADDR);
+      start = timer_ticks ();
+      while (!c->started && timer_elapsed (start) < TIMER_FREQ)
+        timer_msleep (1);
+      if (c->started)
+        started++;
+      else
+        printf ("cpu: CPU %d (APIC ID %d) did not start\n", i, c->apic_id);
+    }
+  palloc_free_page (pd);
+
+  aps_started = started > 1;
+  printf ("%d CPUs online.\n", started);
+  if (aps_started && timer_tickless)
+    printf ("cpu: -tickless has no effect with more than one CPU\n");
+}
+
+/* C entry point for application processors, called by the
+   start-up code in start.S on the stack of the processor's idle
+   thread, with interrupts off. */
+void
+cpu_ap_main (void)
+{
+  struct cpu *c = cpu_current ();
+
+  /* Switch to the kernel's own page directory, dropping the
+     identity mapping the start-up code needed. */
+  asm volatile ("movl %0, %%cr3" : : "r" (vtop (base_page_dir)) : "memory");
+  c->pagedir = base_page_dir;
+  cpu_enable_global_pages ();
+
+#ifdef USERPROG
+  gdt_load ();
+#endif
+  intr_load_idt ();
+  lapic_init (false);
+
+  c->started = true;
+  thread_start_ap ();
+}
+
+/* Returns true if any application processor has started. */
+bool
+cpu_aps_started (void)
+{
+  return aps_started;
+}
+
+/* Asks CPU C, which must not be the running CPU, to check
+   whether it should switch to a higher-priority thread. */
+void
+cpu_kick (struct cpu *c)
+{
+  ASSERT (c != cpu_current ());
+
+  if (c->started)
+    lapic_send_ipi (c->apic_id, LAPIC_VEC_RESCHED);
+}
+
+/* Asks CPU C, which must not be the running CPU, to stop using
+   any page directory that its running thread does not own.  See
+   pagedir_release(). */
+void
+cpu_release_pagedir (struct cpu *c)
+{
+  ASSERT (c != cpu_current ());
+
+  if (c->started)
+    lapic_send_ipi (c->apic_id, LAPIC_VEC_PAGEDIR);
+}
+
+/* Turns on global pages on the running CPU, so that the kernel
+   mappings, which paging_init() marks global, stay in the TLB
+   when CR3 is reloaded.  See [IA32-v3a] 3.12 "Translation
+   Lookaside Buffers (TLBs)". */
+void
+cpu_enable_global_pages (void)
+{
+  uint32_t cr4;
+
+  asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+  asm volatile ("movl %0, %%cr4" : : "r" (cr4 | CR4_PGE) : "memory");
+}
+
+/* Forwards the current timer tick to all the other CPUs.
+   Called by the timer interrupt handler on the BSP. */
+void
+cpu_tick_others (void)
+{
+  if (aps_started)
+    lapic_broadcast_ipi (LAPIC_VEC_TICK);
+}
+
+/* Stops all the other CPUs.  Used when the kernel panics. */
+void
+cpu_halt_others (void)
+{
+  if (aps_started)
+    lapic_broadcast_ipi (LAPIC_VEC_HALT);
+}
+
+/* Timer tick forwarded from the BSP. */
+static void
+tick_interrupt (struct intr_frame *args UNUSED)
+{
+  thread_tick ();
+}
+
+/* Reschedule request from another CPU. */
+static void
+resched_interrupt (struct intr_frame *args UNUSED)
+{
+  thread_preempt ();
+}
+
+/* Another CPU panicked.  Stop for good. */
+static void
+halt_interrupt (struct intr_frame *args UNUSED)
+{
+  for (;;)
+    asm volatile ("cli; hlt" : : : "memory");
+}
+
+#ifdef USERPROG
+/* Request from another CPU to let go of a page directory. */
+static void
+pagedir_interrupt (struct intr_frame *args UNUSED)
+{
+  pagedir_release ();
+}
+#endif
+
+/* Local APIC spurious interrupt.  These must not be
+   acknowledged, so interrupt.c does not send an EOI for them,
+   and there is nothing else to do. */
+static void
+spurious_interrupt (struct intr_frame *args UNUSED)
+{
+}
+
+/* Looks for the MP floating pointer structure in each of the
+   three places [MP] 4 says it may be: the first kilobyte of the
+   extended BIOS data area, the last kilobyte of base memory, and
+   the BIOS ROM between 0xf0000 and 0xfffff. */
+static struct mp_fp *
+mp_find (void)
+{
+  uint16_t ebda_seg = *(uint16_t *) ptov (0x40e);
+  uint16_t base_kb = *(uint16_t *) ptov (0x413);
+  struct mp_fp *fp = NULL;
+
+  if (ebda_seg != 0)
+    fp = mp_search ((uintptr_t) ebda_seg << 4, 1024);
+  if (fp == NULL && base_kb != 0)
+    fp = mp_search (base_kb * 1024 - 1024, 1024);
+  if (fp == NULL)
+    fp = mp_search (0xf0000, 0x10000);
+  return fp;
+}
+
+/* Looks for the MP floating pointer structure, which is always
+   16-byte aligned, in the SIZE bytes starting at physical
+   address PADDR. */
+static struct mp_fp *
+mp_search (uintptr_t paddr, size_t size)
+{
+  uint8_t *p = ptov (paddr);
+  uint8_t *end = p + size;
+
+  for (; p + sizeof (struct mp_fp) <= end; p += 16)
+    if (!memcmp (p, "_MP_", 4) && checksum_ok (p, sizeof (struct mp_fp)))
+      return (struct mp_fp *) p;
+  return NULL;
+}
+
+/* Returns true if the SIZE bytes at P sum to 0, modulo 256. */
+static bool
+checksum_ok (const void *p_, size_t size)
+{
+  const uint8_t *p = p_;
+  uint8_t sum = 0;
+
+  while (size-- > 0)
+    sum += *p++;
+  return sum == 0;
+}
@@ -0,0 +1,99 @@
+#ifndef THREADS_CPU_H
+#define THREADS_CPU_H
+
+#include <heap.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "threads/spinlock.h"
+#include "threads/thread.h"
+
+/* Maximum number of CPUs supported. */
+#define CPU_MAX 8
+
+/* A CPU's run queue: the threads in THREAD_READY state that
+   will run on that CPU.  There is one FIFO list per priority
+   level, and bit P of MASK is set if and only if LISTS[P] is
+   nonempty, so that both enqueuing a thread and finding the
+   highest-priority ready thread take constant time.
+
+   With the stride scheduler, the lists are not used.  Instead,
+   HEAP orders the ready threads by pass, and TICKETS and PASS
+   are the total tickets of the threads that are running or
+   ready on the CPU and the CPU's global pass.
+
+   Threads in the earliest-deadline-first class are kept apart,
+   on EDF if they have budget left in the current period and on
+   EDF_WAITING if they must wait for the next one.  Both lists
+   are short, since admission control limits how many such
+   threads a CPU can take.  See thread_create_deadline().
+
+   Owned by thread.c and protected by LOCK. */
+struct run_queue
+  {
+    struct spinlock lock;               /* Protects this run queue. */
+    struct list lists[PRI_MAX + 1];     /* Ready threads, by priority. */
+    uint64_t mask;                      /* Nonempty lists. */
+    int cnt;                            /* Total # of threads in lists. */
+    struct heap heap;                   /* Ready threads, by pass. */
+    int tickets;                        /* Total tickets. */
+    int64_t pass;                       /* Global pass. */
+    struct list edf;                    /* EDF threads, by deadline. */
+    struct list edf_waiting;            /* Throttled EDF threads, by
+                                           start of next period. */
+  };
+
+/* A CPU.
+
+   Members other than the run queue are only ever accessed by
+   the CPU itself, with interrupts off, except where noted, so
+   they need no locking. */
+struct cpu
+  {
+    /* Set up by cpu_init(), then read-only. */
+    int id;                             /* Index in cpus[]. */
+    uint8_t apic_id;                    /* Local APIC ID. */
+    volatile bool started;              /* Running Pintos yet? */
+
+    /* Owned by thread.c. */
+    struct run_queue rq;                /* Run queue. */
+    struct thread *idle_thread;         /* This CPU's idle thread. */
+    struct thread *curr;                /* Running thread (under rq.lock). */
+    unsigned thread_ticks;              /* # of timer ticks since last yield. */
+    long long idle_ticks;               /* # of timer ticks spent idle. */
+    long long kernel_ticks;             /* # of timer ticks in kernel threads. */
+    long long user_ticks;               /* # of timer ticks in user programs. */
+    long long steals;                   /* # of threads stolen from others. */
+    int edf_util;                       /* Reserved by EDF threads, in
+                                           0.1% units (under edf_lock). */
+
+    /* Owned by threads/rcu.c.  Read by other CPUs. */
+    unsigned rcu_qs;                    /* # of quiescent states passed. */
+
+    /* Owned by userprog/pagedir.c. */
+    uint32_t *pagedir;                  /* Page directory in CR3, if known. */
+    long long cr3_loads;                /* # of times CR3 was loaded. */
+    long long cr3_skips;                /* # of loads skipped, PD in CR3. */
+
+    /* Owned by interrupt.c. */
+    bool in_external_intr;              /* Processing an external interrupt? */
+    bool yield_on_return;               /* Yield on interrupt return? */
+  };
+
+/* All the CPUs.  cpus[0] is the bootstrap processor, which runs
+   main(); the others are application processors. */
+extern struct cpu cpus[CPU_MAX];
+extern int cpu_cnt;
+extern bool cpu_smp;
+
+void cpu_init (void);
+void cpu_start_aps (void);
+struct cpu *cpu_current (void);
+bool cpu_aps_started (void);
+void cpu_kick (struct cpu *);
+void cpu_release_pagedir (struct cpu *);
+void cpu_enable_global_pages (void);
+void cpu_tick_others (void);
+void cpu_halt_others (void);
+
+#endif /* threads/cpu.h */
@@ -0,0 +1,121 @@
+#ifndef THREADS_FIXED_POINT_H
+#define THREADS_FIXED_POINT_H
+
+#include <debug.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Signed 17.14 fixed-point real arithmetic, as used by the
+   multi-level feedback queue scheduler.
+
+   A fixed_point_t holds a real number X as the integer
+   X * 2**FIX_F_BITS, giving 17 bits before the binary point, 14
+   bits after it, and a sign bit.  The value is wrapped in a
+   structure so that the compiler catches any attempt to mix
+   fixed-point and integer values without a conversion. */
+
+/* Number of bits after the binary point. */
+#define FIX_F_BITS 14
+
+/* Fixed-point 1, i.e. 2**FIX_F_BITS. */
+#define FIX_ONE (1 << FIX_F_BITS)
+
+/* A fixed-point number. */
+typedef struct
+  {
+    int f;
+  }
+fixed_point_t;
+
+/* Returns a fixed-point number with F as its internal value. */
+static inline fixed_point_t
+__mk_fix (int f)
+{
+  fixed_point_t x;
+  x.f = f;
+  return x;
+}
+
+/* Returns integer N as a fixed-point number. */
+static inline fixed_point_t
+fix_int (int n)
+{
+  return __mk_fix (n * FIX_ONE);
+}
+
+/* Returns the fraction N / D as a fixed-point number. */
+static inline fixed_point_t
+fix_frac (int n, int d)
+{
+  return __mk_fix ((int64_t) n * FIX_ONE / d);
+}
+
+/* Returns X + Y. */
+static inline fixed_point_t
+fix_add (fixed_point_t x, fixed_point_t y)
+{
+  return __mk_fix (x.f + y.f);
+}
+
+/* Returns X - Y. */
+static inline fixed_point_t
+fix_sub (fixed_point_t x, fixed_point_t y)
+{
+  return __mk_fix (x.f - y.f);
+}
+
+/* Returns X * N, for integer N. */
+static inline fixed_point_t
+fix_scale (fixed_point_t x, int n)
+{
+  return __mk_fix (x.f * n);
+}
+
+/* Returns X / N, for integer N. */
+static inline fixed_point_t
+fix_unscale (fixed_point_t x, int n)
+{
+  return __mk_fix (x.f / n);
+}
+
+/* Returns X * Y.  The product is formed in 64 bits so that it
+   cannot overflow before being scaled back down. */
+static inline fixed_point_t
+fix_mul (fixed_point_t x, fixed_point_t y)
+{
+  return __mk_fix ((int64_t) x.f * y.f >> FIX_F_BITS);
+}
+
+/* Returns X / Y. */
+static inline fixed_point_t
+fix_div (fixed_point_t x, fixed_point_t y)
+{
+  ASSERT (y.f != 0);
+  return __mk_fix (((int64_t) x.f << FIX_F_BITS) / y.f);
+}
+
+/* Returns X truncated toward zero to an integer. */
+static inline int
+fix_trunc (fixed_point_t x)
+{
+  return x.f / FIX_ONE;
+}
+
+/* Returns X rounded to the nearest integer, with halves rounded
+   away from zero. */
+static inline int
+fix_round (fixed_point_t x)
+{
+  return (x.f >= 0
+          ? (x.f + FIX_ONE / 2) / FIX_ONE
+          : (x.f - FIX_ONE / 2) / FIX_ONE);
+}
+
+/* Returns true if X and Y are equal. */
+static inline bool
+fix_equal (fixed_point_t x, fixed_point_t y)
+{
+  return x.f == y.f;
+}
+
+#endif /* threads/fixed-point.h */
@@ -13,17 +13,22 @@
 #include "devices/serial.h"
 #include "devices/timer.h"
 #include "devices/vga.h"
+#include "threads/cpu.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/loader.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/pte.h"
+#include "threads/rcu.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
 #include "userprog/gdt.h"
+#include "userprog/pagedir.h"
 #include "userprog/syscall.h"
 #include "userprog/tss.h"
 #else
@@ -86,8 +91,12 @@ main (void)
   /* Initialize memory system. */
   palloc_init ();
   malloc_init ();
+  kmem_init ();
   paging_init ();
 
+  /* Find the other CPUs. */
+  cpu_init ();
+
   /* Segmentation. */
 #ifdef USERPROG
   tss_init ();
@@ -106,8 +115,10 @@ main (void)
 
   /* Start thread scheduler and enable interrupts. */
   thread_start ();
+  rcu_init ();
   serial_init_queue ();
   timer_calibrate ();
+  cpu_start_aps ();
 
 #ifdef FILESYS
   /* Initialize file system. */
@@ -175,7 +186,7 @@ paging_init (void)
           pd[pde_idx] = pde_create (pt);
         }
 
-      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text);
+      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text) | PTE_G;
     }
 
   /* Store the physical address of the page directory into CR3
@@ -184,6 +195,10 @@ paging_init (void)
      to/from Control Registers" and [IA32-v3a] 3.7.5 "Base Address
      of the Page Directory". */
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (base_page_dir)));
+
+  /* The kernel's mappings are the same in every page directory,
+     so keep them in the TLB across page directory switches. */
+  cpu_enable_global_pages ();
 }
 
 /* Breaks the kernel command line into words and returns them as
@@ -244,6 +259,32 @@ parse_options (char **argv)
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+      else if (!strcmp (name, "-stride"))
+        thread_stride = true;
+      else if (!strcmp (name, "-smp"))
+        cpu_smp = true;
+      else if (!strcmp (name, "-tickless"))
+        timer_tickless = true;
+      else if (!strcmp (name, "-zl"))
+        palloc_zero_low = atoi (value);
+      else if (!strcmp (name, "-zh"))
+        palloc_zero_high = atoi (value);
+      else if (!strcmp (name, "-o"))
+        {
+          if (value != NULL && !strcmp (value, "schedstat"))
+            thread_schedstat = true;
+          else if (value != NULL && !strcmp (value, "kmemstat"))
+            kmemstat = true;
+          else if (value != NULL && !strcmp (value, "pallocstat"))
+            pallocstat = true;
+#ifdef LOCKSTAT
+          else if (value != NULL && !strcmp (value, "lockstat"))
+            lockstat = true;
+#endif
+          else
+            PANIC ("unknown output `%s' (use -h for help)",
+                   value != NULL ? value : "");
+        }
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
@@ -349,6 +390,19 @@ usage (void)
           "  -f                 Format file system disk during startup.\n"
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -stride            Use stride scheduler.\n"
+          "  -smp               Start the other CPUs (not yet booted).\n"
+          "  -tickless          Stop the timer interrupt while idle, for at\n"
+          "                     most 55 ms (the PIT's limit) at a time.\n"
+          "                     Ignored once other CPUs start (-smp).\n"
+          "  -zl=COUNT          Zero pages while idle below COUNT ready.\n"
+          "  -zh=COUNT          Keep up to COUNT pages zeroed ahead.\n"
+          "  -o=schedstat       Print per-thread scheduler statistics.\n"
+          "  -o=kmemstat        Print object cache statistics.\n"
+          "  -o=pallocstat      Print page allocator fragmentation.\n"
+#ifdef LOCKSTAT
+          "  -o=lockstat        Print the most contended locks, semaphores.\n"
+#endif
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
 #endif
@@ -387,6 +441,10 @@ print_stats (void)
 {
   timer_print_stats ();
   thread_print_stats ();
+  thread_print_schedstats ();
+  lock_print_stats ();
+  kmem_print_stats ();
+  palloc_print_stats ();
 #ifdef FILESYS
   disk_print_stats ();
 #endif
@@ -394,5 +452,6 @@ print_stats (void)
   kbd_print_stats ();
 #ifdef USERPROG
   exception_print_stats ();
+  pagedir_print_stats ();
 #endif
 }
@@ -23,6 +23,12 @@
 #define LOADER_ARG_CNT (LOADER_ARGS - LOADER_ARG_CNT_LEN) /* Number of args. */
 #define LOADER_RAM_PGS (LOADER_ARG_CNT - LOADER_RAM_PGS_LEN) /* # RAM pages. */
 
+/* Physical address at which application processors begin
+   executing, in real mode, when they start up.  This page lies
+   below the loader and is not otherwise used once the kernel is
+   running.  See cpu_start_aps(). */
+#define AP_START_PADDR 0x8000
+
 /* Sizes of loader data structures. */
 #define LOADER_SIG_LEN 2
 #define LOADER_ARGS_LEN 128
@@ -0,0 +1,297 @@
+#include "threads/lockdep.h"
+#ifdef LOCKDEP
+#include <debug.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/spinlock.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Lock order validator.
+
+   A deadlock between locks needs two threads that take the same
+   locks in opposite orders, and a bad enough interleaving for
+   both to block, which may take days to turn up.  Instead, we
+   record, for every lock acquired, which locks the thread was
+   already holding: "A before B" for each held lock A and the
+   lock B being acquired.  These orders form a directed graph,
+   and any cycle in it is a possible deadlock, even if no thread
+   ever actually deadlocked.  So, whenever a thread is about to
+   establish an order that is not yet in the graph, we check
+   that the reverse path does not exist, and if it does, we
+   report both the current call stack and the one that
+   established the reverse order.
+
+   The graph is kept for classes of locks rather than for
+   individual locks, so that an order established between, say,
+   an inode's lock and the free map's lock applies to all inodes.
+   A class is all the locks initialized by one lock_init() call
+   in the source, so locks that merely share a name, such as two
+   structures' "&p->lock", are kept apart.  Holding one lock of
+   a class while acquiring another of the same class is not
+   checked: such locks, like the elements of an array, are
+   usually taken in an order that the validator cannot see, such
+   as by index, and reporting every such nesting would bury real
+   inversions in false ones.
+
+   After the first report, the validator turns itself off, since
+   the graph is suspect from then on.  Everything is kept in
+   static arrays, because lock_acquire() must not allocate
+   memory.  Build with "make LOCKDEP=1". */
+
+/* Maximum number of lock classes.  Locks whose names do not fit
+   are not validated. */
+#define LOCKDEP_CLASS_MAX 128
+
+/* Maximum number of distinct orders between classes. */
+#define LOCKDEP_EDGE_MAX 1024
+
+/* Number of call stack addresses saved with each order. */
+#define LOCKDEP_FRAMES 8
+
+/* A class of locks. */
+struct lockdep_class
+  {
+    const char *name;           /* Name of the locks. */
+    const char *file;           /* Source file that initializes them. */
+    int line;                   /* Line number in FILE. */
+  };
+
+/* "FROM before TO", with the call stack that first did it. */
+struct lockdep_edge
+  {
+    uint8_t from, to;                   /* Class indexes. */
+    size_t frame_cnt;                   /* Number of FRAMES. */
+    void *frames[LOCKDEP_FRAMES];       /* Call stack. */
+  };
+
+static struct lockdep_class classes[LOCKDEP_CLASS_MAX];
+static int class_cnt;
+
+static struct lockdep_edge edges[LOCKDEP_EDGE_MAX];
+static int edge_cnt;
+
+/* edge_idx[A][B] is 1 + the index in edges[] of "A before B",
+   or 0 if there is no such order. */
+static uint16_t edge_idx[LOCKDEP_CLASS_MAX][LOCKDEP_CLASS_MAX];
+
+/* Protects all the above. */
+static struct spinlock lockdep_lock;
+
+/* Set after the first report, or if we run out of room. */
+static bool lockdep_off;
+
+/* A possible deadlock found by lockdep_check(), copied out so
+   that it can be printed after releasing lockdep_lock. */
+struct lockdep_report
+  {
+    int held, acquiring;                /* Class indexes. */
+    int path[LOCKDEP_CLASS_MAX];        /* Edges from ACQUIRING to HELD. */
+    int path_len;                       /* Number of edges in PATH. */
+  };
+static struct lockdep_report report;
+
+static int class_index (const struct lock *);
+static void print_class (int);
+static bool find_path (int from, int to, int path[], int *path_len);
+static void print_report (void);
+
+/* Assigns LOCK, named NAME and initialized at line LINE of
+   FILE, to its class. */
+void
+lockdep_init_lock (struct lock *lock, const char *name,
+                   const char *file, int line)
+{
+  enum intr_level old_level;
+  int i;
+
+  old_level = intr_disable ();
+  spinlock_acquire (&lockdep_lock);
+  for (i = 0; i < class_cnt; i++)
+    if (classes[i].line == line && !strcmp (classes[i].file, file))
+      break;
+  if (i == class_cnt && class_cnt < LOCKDEP_CLASS_MAX)
+    {
+      struct lockdep_class *c = &classes[class_cnt++];
+      c->name = name;
+      c->file = file;
+      c->line = line;
+    }
+  lock->dep_class = i < LOCKDEP_CLASS_MAX ? &classes[i] : NULL;
+  spinlock_release (&lockdep_lock);
+  intr_set_level (old_level);
+}
+
+/* Checks that the running thread may acquire LOCK, given the
+   locks it already holds, and records the new orders.  Called
+   before lock_acquire() might block, so that a possible
+   deadlock is reported even if it is about to happen. */
+void
+lockdep_check (struct lock *lock)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  bool found = false;
+  int to = class_index (lock);
+  int i;
+
+  if (to < 0 || lockdep_off)
+    return;
+
+  old_level = intr_disable ();
+  spinlock_acquire (&lockdep_lock);
+  for (i = 0; i < cur->held_lock_cnt && !lockdep_off; i++)
+    {
+      int from = class_index (cur->held_locks[i]);
+      struct lockdep_edge *e;
+
+      if (from < 0 || from == to || edge_idx[from][to] != 0)
+        continue;
+
+      /* A new order.  It must not close a cycle. */
+      if (find_path (to, from, report.path, &report.path_len))
+        {
+          report.held = from;
+          report.acquiring = to;
+          lockdep_off = found = true;
+          break;
+        }
+
+      if (edge_cnt >= LOCKDEP_EDGE_MAX)
+        {
+          lockdep_off = true;
+          break;
+        }
+      e = &edges[edge_cnt++];
+      e->from = from;
+      e->to = to;
+      e->frame_cnt = debug_backtrace_save (e->frames, LOCKDEP_FRAMES);
+      edge_idx[from][to] = edge_cnt;
+    }
+  spinlock_release (&lockdep_lock);
+  intr_set_level (old_level);
+
+  /* printf() acquires the console lock, so we must not hold
+     lockdep_lock here.  Since we are now off, that acquisition
+     is not checked. */
+  if (found)
+    print_report ();
+}
+
+/* Records that the running thread now holds LOCK. */
+void
+lockdep_acquired (struct lock *lock)
+{
+  struct thread *cur = thread_current ();
+
+  ASSERT (cur->held_lock_cnt < LOCKDEP_HELD_MAX);
+  cur->held_locks[cur->held_lock_cnt++] = lock;
+}
+
+/* Records that the running thread no longer holds LOCK.  Locks
+   need not be released in the reverse order of acquisition. */
+void
+lockdep_released (struct lock *lock)
+{
+  struct thread *cur = thread_current ();
+  int i;
+
+  for (i = cur->held_lock_cnt - 1; i >= 0; i--)
+    if (cur->held_locks[i] == lock)
+      {
+        memmove (&cur->held_locks[i], &cur->held_locks[i + 1],
+                 (cur->held_lock_cnt - i - 1) * sizeof *cur->held_locks);
+        cur->held_lock_cnt--;
+        return;
+      }
+  NOT_REACHED ();
+}
+
+/* Returns the index of LOCK's class in classes[], or -1 if it
+   has none. */
+static int
+class_index (const struct lock *lock)
+{
+  return lock->dep_class != NULL ? lock->dep_class - classes : -1;
+}
+
+/* Searches depth-first for a path of orders from class FROM to
+   class TO.  If one exists, stores the indexes in edges[] of its
+   orders in PATH, sets *PATH_LEN to their number, and returns
+   true.  Otherwise, returns false.  lockdep_lock must be held. */
+static bool
+find_path (int from, int to, int path[], int *path_len)
+{
+  static bool visited[LOCKDEP_CLASS_MAX];
+  static int stack[LOCKDEP_CLASS_MAX];
+  static int next[LOCKDEP_CLASS_MAX];
+  int depth = 0;
+
+  memset (visited, 0, sizeof visited);
+  visited[from] = true;
+  stack[0] = from;
+  next[0] = 0;
+  while (depth >= 0)
+    {
+      int c = stack[depth];
+      int n = next[depth]++;
+
+      if (n >= class_cnt)
+        depth--;
+      else if (edge_idx[c][n] != 0 && !visited[n])
+        {
+          path[depth] = edge_idx[c][n] - 1;
+          if (n == to)
+            {
+              *path_len = depth + 1;
+              return true;
+            }
+          visited[n] = true;
+          depth++;
+          stack[depth] = n;
+          next[depth] = 0;
+        }
+    }
+  return false;
+}
+
+/* Prints the possible deadlock in `report'. */
+static void
+print_report (void)
+{
+  struct thread *cur = thread_current ();
+  int i;
+
+  printf ("Lockdep: possible deadlock in thread \"%s\".\n", cur->name);
+  printf ("It is acquiring a lock of class ");
+  print_class (report.acquiring);
+  printf (" while holding one of class ");
+  print_class (report.held);
+  printf (", at:\n");
+  debug_backtrace ();
+  for (i = 0; i < report.path_len; i++)
+    {
+      struct lockdep_edge *e = &edges[report.path[i]];
+
+      printf ("Earlier, a lock of class ");
+      print_class (e->to);
+      printf (" was acquired while holding one of class ");
+      print_class (e->from);
+      printf (", at:\n");
+      debug_backtrace_print (e->frames, e->frame_cnt);
+    }
+  printf ("Lockdep: further checking disabled.\n");
+}
+
+/* Prints the name of class C and where its locks are
+   initialized. */
+static void
+print_class (int c)
+{
+  printf ("\"%s\" (%s:%d)", classes[c].name, classes[c].file,
+          classes[c].line);
+}
+#endif /* LOCKDEP */
@@ -0,0 +1,29 @@
+#ifndef THREADS_LOCKDEP_H
+#define THREADS_LOCKDEP_H
+
+/* Lock order validator.
+
+   Built only with "make LOCKDEP=1".  Otherwise the hooks below
+   are empty and lock_acquire() costs exactly what it did.  See
+   lockdep.c. */
+
+struct lock;
+
+/* Maximum number of locks that one thread may hold at once
+   while the validator is compiled in. */
+#define LOCKDEP_HELD_MAX 16
+
+#ifdef LOCKDEP
+void lockdep_init_lock (struct lock *, const char *name,
+                        const char *file, int line);
+void lockdep_check (struct lock *);
+void lockdep_acquired (struct lock *);
+void lockdep_released (struct lock *);
+#else
+#define lockdep_init_lock(LOCK, NAME, FILE, LINE) ((void) 0)
+#define lockdep_check(LOCK) ((void) 0)
+#define lockdep_acquired(LOCK) ((void) 0)
+#define lockdep_released(LOCK) ((void) 0)
+#endif
+
+#endif /* threads/lockdep.h */
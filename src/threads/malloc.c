@@ -5,6 +5,8 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/cpu.h"
+#include "threads/interrupt.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -32,15 +34,43 @@
    because they're too big to fit in a single page with a
    descriptor.  We handle those by allocating contiguous pages
    with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   the beginning of the allocated block's arena header.
+
+   Taking the descriptor's lock on every malloc() and free()
+   would serialize all the CPUs, so in front of each
+   descriptor's free list, which we call its "depot", each CPU
+   has a "magazine": a small stack of free blocks that only that
+   CPU uses, with interrupts off instead of a lock.  malloc()
+   pops a block from the magazine and free() pushes one, so the
+   common case never touches the depot.  Only when the magazine
+   is empty, or full, do we take the lock, and then we move half
+   a magazine's worth of blocks at once.  Blocks in a magazine
+   count as allocated as far as their arena is concerned.  This
+   is after "Magazines and Vmem" by Jeff Bonwick and Jonathan
+   Adams. */
 
 /* Descriptor. */
 struct desc
   {
     size_t block_size;          /* Size of each element in bytes. */
     size_t blocks_per_arena;    /* Number of blocks in an arena. */
-    struct list free_list;      /* List of free blocks. */
-    struct lock lock;           /* Lock. */
+    size_t mag_size;            /* Capacity of each magazine. */
+    struct list free_list;      /* Depot: list of free blocks. */
+    struct lock lock;           /* Protects the depot. */
+  };
+
+/* Maximum number of descriptors. */
+#define DESC_MAX 10
+
+/* Maximum capacity of a magazine. */
+#define MAG_MAX 32
+
+/* A CPU's magazine for one descriptor.  Only accessed by that
+   CPU, with interrupts off. */
+struct magazine
+  {
+    size_t cnt;                 /* Number of blocks in ROUNDS. */
+    struct block *rounds[MAG_MAX];  /* Free blocks, most recent last. */
   };
 
 /* Magic number for detecting arena corruption. */
@@ -61,9 +91,17 @@ struct block
   };
 
 /* Our set of descriptors. */
-static struct desc descs[10];   /* Descriptors. */
+static struct desc descs[DESC_MAX]; /* Descriptors. */
 static size_t desc_cnt;         /* Number of descriptors. */
 
+/* Magazines, indexed by CPU and descriptor. */
+static struct magazine mags[CPU_MAX][DESC_MAX];
+
+static struct block *mag_pop (struct desc *);
+static struct block *mag_refill (struct desc *);
+static void mag_push (struct desc *, struct block *);
+static size_t depot_get (struct desc *, struct block *[], size_t cnt);
+static void depot_put (struct desc *, struct block *[], size_t cnt);
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
 
@@ -79,6 +117,10 @@ malloc_init (void)
       ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
       d->block_size = block_size;
       d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
+      /* Let each magazine hold about a page's worth. */
+      d->mag_size = PGSIZE / block_size;
+      if (d->mag_size > MAG_MAX)
+        d->mag_size = MAG_MAX;
       list_init (&d->free_list);
       lock_init (&d->lock);
     }
@@ -119,37 +161,11 @@ malloc (size_t size)
       return a + 1;
     }
 
-  lock_acquire (&d->lock);
-
-  /* If the free list is empty, create a new arena. */
-  if (list_empty (&d->free_list))
-    {
-      size_t i;
-
-      /* Allocate a page. */
-      a = palloc_get_page (0);
-      if (a == NULL) 
-        {
-          lock_release (&d->lock);
-          return NULL; 
-        }
-
-      /* Initialize arena and add its blocks to the free list. */
-      a->magic = ARENA_MAGIC;
-      a->desc = d;
-      a->free_cnt = d->blocks_per_arena;
-      for (i = 0; i < d->blocks_per_arena; i++) 
-        {
-          struct block *b = arena_to_block (a, i);
-          list_push_back (&d->free_list, &b->free_elem);
-        }
-    }
-
-  /* Get a block from free list and return it. */
-  b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
-  a = block_to_arena (b);
-  a->free_cnt--;
-  lock_release (&d->lock);
+  /* Take a block from this CPU's magazine, or failing that,
+     from the depot. */
+  b = mag_pop (d);
+  if (b == NULL)
+    b = mag_refill (d);
   return b;
 }
 
@@ -233,26 +249,8 @@ free (void *p)
           memset (b, 0xcc, d->block_size);
 #endif
   
-          lock_acquire (&d->lock);
-
-          /* Add block to free list. */
-          list_push_front (&d->free_list, &b->free_elem);
-
-          /* If the arena is now entirely unused, free it. */
-          if (++a->free_cnt >= d->blocks_per_arena) 
-            {
-              size_t i;
-
-              ASSERT (a->free_cnt == d->blocks_per_arena);
-              for (i = 0; i < d->blocks_per_arena; i++) 
-                {
-                  struct block *b = arena_to_block (a, i);
-                  list_remove (&b->free_elem);
-                }
-              palloc_free_page (a);
-            }
-
-          lock_release (&d->lock);
+          /* Return it to this CPU's magazine. */
+          mag_push (d, b);
         }
       else
         {
@@ -263,6 +261,166 @@ free (void *p)
     }
 }
 
+/* Returns the magazine for descriptor D on the running CPU.
+   Interrupts must be off. */
+static struct magazine *
+cur_mag (struct desc *d) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  return &mags[cpu_current ()->id][d - descs];
+}
+
+/* Pops a block from the running CPU's magazine for D and returns
+   it, or returns a null pointer if the magazine is empty. */
+static struct block *
+mag_pop (struct desc *d) 
+{
+  enum intr_level old_level = intr_disable ();
+  struct magazine *m = cur_mag (d);
+  struct block *b = m->cnt > 0 ? m->rounds[--m->cnt] : NULL;
+  intr_set_level (old_level);
+  return b;
+}
+
+/* Takes half a magazine's worth of blocks from D's depot,
+   returns one of them, and loads the rest into the running
+   CPU's magazine.  Returns a null pointer if memory is not
+   available. */
+static struct block *
+mag_refill (struct desc *d) 
+{
+  struct block *batch[MAG_MAX];
+  enum intr_level old_level;
+  struct magazine *m;
+  struct block *b;
+  size_t cnt;
+
+  cnt = depot_get (d, batch, d->mag_size / 2);
+  if (cnt == 0)
+    return NULL;
+  b = batch[--cnt];
+
+  /* We may have been preempted, or moved to another CPU, while
+     we held the depot lock, so the magazine may no longer be
+     empty.  Give back whatever does not fit. */
+  old_level = intr_disable ();
+  m = cur_mag (d);
+  while (cnt > 0 && m->cnt < d->mag_size)
+    m->rounds[m->cnt++] = batch[--cnt];
+  intr_set_level (old_level);
+  if (cnt > 0)
+    depot_put (d, batch, cnt);
+
+  return b;
+}
+
+/* Pushes block B onto the running CPU's magazine for D.  If the
+   magazine is full, first moves its older half to the depot. */
+static void
+mag_push (struct desc *d, struct block *b) 
+{
+  struct block *batch[MAG_MAX];
+  enum intr_level old_level;
+  struct magazine *m;
+  size_t cnt = 0;
+
+  old_level = intr_disable ();
+  m = cur_mag (d);
+  if (m->cnt >= d->mag_size)
+    {
+      cnt = d->mag_size / 2;
+      memcpy (batch, m->rounds, cnt * sizeof *batch);
+      memmove (m->rounds, m->rounds + cnt,
+               (m->cnt - cnt) * sizeof *m->rounds);
+      m->cnt -= cnt;
+    }
+  m->rounds[m->cnt++] = b;
+  intr_set_level (old_level);
+
+  if (cnt > 0)
+    depot_put (d, batch, cnt);
+}
+
+/* Takes up to CNT blocks from D's depot, creating arenas as
+   needed, and stores them in BATCH.  Returns the number of
+   blocks obtained, which is less than CNT only if memory ran
+   out. */
+static size_t
+depot_get (struct desc *d, struct block *batch[], size_t cnt) 
+{
+  size_t got;
+
+  lock_acquire (&d->lock);
+  for (got = 0; got < cnt; got++)
+    {
+      struct block *b;
+      struct arena *a;
+
+      /* If the free list is empty, create a new arena. */
+      if (list_empty (&d->free_list))
+        {
+          size_t i;
+
+          /* Allocate a page. */
+          a = palloc_get_page (0);
+          if (a == NULL) 
+            break;
+
+          /* Initialize arena and add its blocks to the free list. */
+          a->magic = ARENA_MAGIC;
+          a->desc = d;
+          a->free_cnt = d->blocks_per_arena;
+          for (i = 0; i < d->blocks_per_arena; i++) 
+            {
+              struct block *b = arena_to_block (a, i);
+              list_push_back (&d->free_list, &b->free_elem);
+            }
+        }
+
+      /* Get a block from free list. */
+      b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
+      a = block_to_arena (b);
+      a->free_cnt--;
+      batch[got] = b;
+    }
+  lock_release (&d->lock);
+
+  return got;
+}
+
+/* Returns the CNT blocks in BATCH to D's depot, freeing any
+   arena that becomes entirely unused. */
+static void
+depot_put (struct desc *d, struct block *batch[], size_t cnt) 
+{
+  size_t i;
+
+  lock_acquire (&d->lock);
+  for (i = 0; i < cnt; i++)
+    {
+      struct block *b = batch[i];
+      struct arena *a = block_to_arena (b);
+
+      /* Add block to free list. */
+      list_push_front (&d->free_list, &b->free_elem);
+
+      /* If the arena is now entirely unused, free it. */
+      if (++a->free_cnt >= d->blocks_per_arena) 
+        {
+          size_t j;
+
+          ASSERT (a->free_cnt == d->blocks_per_arena);
+          for (j = 0; j < d->blocks_per_arena; j++) 
+            {
+              struct block *b = arena_to_block (a, j);
+              list_remove (&b->free_elem);
+            }
+          palloc_free_page (a);
+        }
+    }
+  lock_release (&d->lock);
+}
+
 /* Returns the arena that block B is inside. */
 static struct arena *
 block_to_arena (struct block *b)
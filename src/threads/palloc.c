@@ -2,14 +2,16 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/loader.h"
-#include "threads/synch.h"
+#include "threads/spinlock.h"
 #include "threads/vaddr.h"
 
 /* Page allocator.  Hands out memory in page-size (or
@@ -24,14 +26,72 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Within a pool, free memory is managed by a binary buddy
+   system.  Free memory is kept in blocks of 2**K pages, for
+   "order" K, each aligned on a multiple of its size relative to
+   the pool's base, with one free list per order.  To allocate
+   2**K pages, we take a block from the smallest nonempty list
+   of order K or greater, and split it in half repeatedly,
+   freeing the unused halves, until it is the right size.  When
+   a block is freed, if its "buddy", the other half of the block
+   it was split from, is also free, the two are merged, and so
+   on up, so that free memory does not stay broken up into small
+   pieces.  Both take time proportional to the number of orders.
+   A request for a number of pages that is not a power of 2 is
+   satisfied from a block of the next larger power of 2, and the
+   pages at its end that are not needed are freed right away.
+
+   Each pool also keeps a bitmap of the pages in use, which is
+   not needed for allocation but lets us check that pages being
+   freed were allocated.
+
+   Zeroing a page for PAL_ZERO takes a while, and some callers,
+   such as thread_create(), are in a hurry.  So each pool also
+   keeps a stock of pages zeroed ahead of time, which idle CPUs
+   fill up, by calling palloc_zero_idle(), whenever it drops
+   below palloc_zero_low pages, until it reaches
+   palloc_zero_high.  Single-page PAL_ZERO requests take a page
+   from the stock if there is one.  Pages in the stock are
+   allocated as far as the buddy system is concerned, so if an
+   allocation would fail, the stock is given back first. */
+
+/* Number of block orders.  A block of the largest order is 64
+   MB, all the RAM the loader supports. */
+#define ORDER_CNT 15
 
 /* A memory pool. */
 struct pool
   {
-    struct lock lock;                   /* Mutual exclusion. */
+    struct spinlock lock;               /* Mutual exclusion. */
     struct bitmap *used_map;            /* Bitmap of free pages. */
     uint8_t *base;                      /* Base of pool. */
+    size_t page_cnt;                    /* Number of pages in pool. */
+
+    /* Buddy system. */
+    uint8_t *orders;                    /* For each page that begins a
+                                           free block, 1 + its order;
+                                           otherwise 0. */
+    struct list free_lists[ORDER_CNT];  /* Free blocks, by order. */
+    size_t free_cnts[ORDER_CNT];        /* Length of each free list. */
+
+    /* Pages zeroed ahead of time. */
+    struct list zeroed;                 /* Zeroed pages. */
+    size_t zeroed_cnt;                  /* Number of pages in ZEROED. */
+    bool refilling;                     /* Zeroing up to high watermark? */
+    long long zero_hits;                /* PAL_ZERO pages from ZEROED. */
+    long long zero_misses;              /* PAL_ZERO pages zeroed on demand. */
+    long long idle_zeroed;              /* Pages zeroed by idle CPUs. */
+    uint64_t idle_cycles;               /* Time spent on them, in cycles. */
+  };
+
+/* A free block, or a page in a pool's stock of zeroed pages.
+   Stored in the first page, and in the latter case cleared when
+   the page is handed out. */
+struct free_block
+  {
+    struct list_elem elem;              /* Element in free or zeroed list. */
   };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -40,9 +100,24 @@ struct pool kernel_pool, user_pool;
 /* Maximum number of pages to put in user pool. */
 size_t user_page_limit = SIZE_MAX;
 
+/* Watermarks for each pool's stock of zeroed pages. */
+size_t palloc_zero_low = 8;
+size_t palloc_zero_high = 32;
+
+/* If true, print a fragmentation report at shutdown.
+   Controlled by kernel command-line option "-o=pallocstat". */
+bool pallocstat;
+
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static size_t alloc_pages (struct pool *, size_t page_cnt);
+static void free_pages (struct pool *, size_t page_idx, size_t page_cnt);
+static void free_block (struct pool *, size_t page_idx, int order);
+static void *take_zeroed (struct pool *);
+static void flush_zeroed (struct pool *);
+static bool zero_one (struct pool *);
+static void print_pool_stats (struct pool *, const char *name);
 
 /* Initializes the page allocator. */
 void
@@ -61,6 +136,8 @@ palloc_init (void)
   if (user_pages > user_page_limit)
     user_pages = user_page_limit;
   kernel_pages = free_pages - user_pages;
+  if (palloc_zero_low > palloc_zero_high)
+    palloc_zero_low = palloc_zero_high;
 
   /* Give half of memory to kernel, half to user. */
   init_pool (&kernel_pool, free_start, kernel_pages, "kernel pool");
@@ -78,24 +155,43 @@ void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 {
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
-  void *pages;
+  bool want_zero = (flags & PAL_ZERO) != 0;
+  enum intr_level old_level;
+  void *pages = NULL;
   size_t page_idx;
 
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
-
-  if (page_idx != BITMAP_ERROR)
-    pages = pool->base + PGSIZE * page_idx;
-  else
-    pages = NULL;
+  old_level = intr_disable ();
+  spinlock_acquire (&pool->lock);
+  if (want_zero && page_cnt == 1 && pool->zeroed_cnt > 0) 
+    {
+      pages = take_zeroed (pool);
+      pool->zero_hits++;
+      want_zero = false;
+    }
+  else 
+    {
+      page_idx = alloc_pages (pool, page_cnt);
+      if (page_idx == BITMAP_ERROR && pool->zeroed_cnt > 0) 
+        {
+          flush_zeroed (pool);
+          page_idx = alloc_pages (pool, page_cnt);
+        }
+      if (page_idx != BITMAP_ERROR) 
+        {
+          pages = pool->base + PGSIZE * page_idx;
+          if (want_zero)
+            pool->zero_misses += page_cnt;
+        }
+    }
+  spinlock_release (&pool->lock);
+  intr_set_level (old_level);
 
   if (pages != NULL) 
     {
-      if (flags & PAL_ZERO)
+      if (want_zero)
         memset (pages, 0, PGSIZE * page_cnt);
     }
   else 
@@ -125,6 +221,7 @@ void
 palloc_free_multiple (void *pages, size_t page_cnt) 
 {
   struct pool *pool;
+  enum intr_level old_level;
   size_t page_idx;
 
   ASSERT (pg_ofs (pages) == 0);
@@ -144,8 +241,13 @@ palloc_free_multiple (void *pages, size_t page_cnt)
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
+  old_level = intr_disable ();
+  spinlock_acquire (&pool->lock);
   ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
   bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  free_pages (pool, page_idx, page_cnt);
+  spinlock_release (&pool->lock);
+  intr_set_level (old_level);
 }
 
 /* Frees the page at PAGE. */
@@ -155,27 +257,67 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Zeroes a free page ahead of time for a later PAL_ZERO
+   request, if a pool's stock of zeroed pages needs filling up.
+   Returns true if it zeroed a page, false if there was nothing
+   to do.  Called by idle threads, with interrupts on, so that
+   zeroing does not delay any thread that becomes ready. */
+bool
+palloc_zero_idle (void) 
+{
+  return zero_one (&kernel_pool) || zero_one (&user_pool);
+}
+
+/* Prints a fragmentation report for each pool, if requested. */
+void
+palloc_print_stats (void) 
+{
+  if (!pallocstat)
+    return;
+
+  print_pool_stats (&kernel_pool, "kernel pool");
+  print_pool_stats (&user_pool, "user pool");
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
 init_pool (struct pool *p, void *base, size_t page_cnt, const char *name) 
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
-     and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
-  if (bm_pages > page_cnt)
+  /* We'll put the pool's used_map and order array at its base.
+     Calculate the space needed for them and subtract it from the
+     pool's size. */
+  size_t bm_size = bitmap_buf_size (page_cnt);
+  size_t meta_pages = DIV_ROUND_UP (bm_size + page_cnt, PGSIZE);
+  int order;
+
+  if (meta_pages > page_cnt)
     PANIC ("Not enough memory in %s for bitmap.", name);
-  page_cnt -= bm_pages;
+  page_cnt -= meta_pages;
 
   printf ("%zu pages available in %s.\n", page_cnt, name);
 
   /* Initialize the pool. */
-  lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
-  p->base = base + bm_pages * PGSIZE;
-}
+  spinlock_init (&p->lock);
+  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_size);
+  p->orders = (uint8_t *) base + bm_size;
+  memset (p->orders, 0, page_cnt);
+  p->base = (uint8_t *) base + meta_pages * PGSIZE;
+  p->page_cnt = page_cnt;
+  for (order = 0; order < ORDER_CNT; order++) 
+    {
+      list_init (&p->free_lists[order]);
+      p->free_cnts[order] = 0;
+    }
+  list_init (&p->zeroed);
+  p->zeroed_cnt = 0;
+  p->refilling = false;
+  p->zero_hits = p->zero_misses = p->idle_zeroed = 0;
+  p->idle_cycles = 0;
 
+  /* Everything starts out free. */
+  free_pages (p, 0, page_cnt);
+}
 /* Returns true if PAGE was allocated from POOL,
    false otherwise. */
 static bool
@@ -187,3 +329,236 @@ page_from_pool (const struct pool *pool, void *page)
 
   return page_no >= start_page && page_no < end_page;
 }
+
+/* Returns the address of the page at PAGE_IDX in POOL. */
+static struct free_block *
+idx_to_block (struct pool *pool, size_t page_idx) 
+{
+  return (struct free_block *) (pool->base + PGSIZE * page_idx);
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL and returns the
+   index of the first one, or BITMAP_ERROR if there is no large
+   enough free block.  POOL's lock must be held. */
+static size_t
+alloc_pages (struct pool *pool, size_t page_cnt) 
+{
+  struct free_block *b;
+  size_t page_idx;
+  int order, k;
+
+  /* Find the smallest order that is big enough, then the
+     smallest nonempty free list of at least that order. */
+  for (order = 0; ((size_t) 1 << order) < page_cnt; order++)
+    if (order + 1 >= ORDER_CNT)
+      return BITMAP_ERROR;
+  for (k = order; k < ORDER_CNT; k++)
+    if (!list_empty (&pool->free_lists[k]))
+      break;
+  if (k >= ORDER_CNT)
+    return BITMAP_ERROR;
+
+  /* Take the block off its free list. */
+  b = list_entry (list_pop_front (&pool->free_lists[k]),
+                  struct free_block, elem);
+  pool->free_cnts[k]--;
+  page_idx = pg_no (b) - pg_no (pool->base);
+  ASSERT (pool->orders[page_idx] == k + 1);
+  pool->orders[page_idx] = 0;
+
+  /* Split it down to size, freeing the upper halves. */
+  while (k > order) 
+    {
+      k--;
+      free_block (pool, page_idx + ((size_t) 1 << k), k);
+    }
+
+  /* Give back the pages at the end that we don't need. */
+  free_pages (pool, page_idx + page_cnt, ((size_t) 1 << order) - page_cnt);
+
+  ASSERT (!bitmap_any (pool->used_map, page_idx, page_cnt));
+  bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+  return page_idx;
+}
+
+/* Frees the PAGE_CNT pages in POOL starting at PAGE_IDX, as the
+   largest aligned blocks that they can be divided into.  POOL's
+   lock must be held. */
+static void
+free_pages (struct pool *pool, size_t page_idx, size_t page_cnt) 
+{
+  while (page_cnt > 0) 
+    {
+      int order = 0;
+
+      while (order + 1 < ORDER_CNT
+             && page_idx % ((size_t) 2 << order) == 0
+             && ((size_t) 2 << order) <= page_cnt)
+        order++;
+      free_block (pool, page_idx, order);
+      page_idx += (size_t) 1 << order;
+      page_cnt -= (size_t) 1 << order;
+    }
+}
+
+/* Frees the block of the given ORDER at PAGE_IDX in POOL,
+   merging it with its buddy as long as the buddy is free too.
+   POOL's lock must be held. */
+static void
+free_block (struct pool *pool, size_t page_idx, int order) 
+{
+  while (order + 1 < ORDER_CNT) 
+    {
+      size_t buddy = page_idx ^ ((size_t) 1 << order);
+
+      if (buddy + ((size_t) 1 << order) > pool->page_cnt
+          || pool->orders[buddy] != order + 1)
+        break;
+
+      /* Merge with the buddy. */
+      list_remove (&idx_to_block (pool, buddy)->elem);
+      pool->free_cnts[order]--;
+      pool->orders[buddy] = 0;
+      if (buddy < page_idx)
+        page_idx = buddy;
+      order++;
+    }
+
+  list_push_front (&pool->free_lists[order],
+                   &idx_to_block (pool, page_idx)->elem);
+  pool->free_cnts[order]++;
+  pool->orders[page_idx] = order + 1;
+}
+
+/* Removes a page from POOL's stock of zeroed pages and returns
+   it, all zeros.  POOL's lock must be held. */
+static void *
+take_zeroed (struct pool *pool) 
+{
+  struct free_block *b;
+
+  ASSERT (pool->zeroed_cnt > 0);
+  b = list_entry (list_pop_front (&pool->zeroed), struct free_block, elem);
+  pool->zeroed_cnt--;
+  memset (b, 0, sizeof *b);
+  return b;
+}
+
+/* Gives all of POOL's zeroed pages back to the buddy system.
+   POOL's lock must be held. */
+static void
+flush_zeroed (struct pool *pool) 
+{
+  while (pool->zeroed_cnt > 0) 
+    {
+      void *page = take_zeroed (pool);
+      size_t page_idx = pg_no (page) - pg_no (pool->base);
+
+      bitmap_reset (pool->used_map, page_idx);
+      free_pages (pool, page_idx, 1);
+    }
+  pool->refilling = false;
+}
+
+/* Reads the CPU's time-stamp counter. */
+static inline uint64_t
+rdtsc (void) 
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+/* Zeroes one page for POOL's stock, if it has dropped below
+   the low watermark or is still being filled up to the high
+   watermark.  Returns true if it zeroed a page. */
+static bool
+zero_one (struct pool *pool) 
+{
+  enum intr_level old_level;
+  size_t page_idx = BITMAP_ERROR;
+  struct free_block *b;
+  uint64_t start, cycles;
+
+  old_level = intr_disable ();
+  spinlock_acquire (&pool->lock);
+  if (pool->zeroed_cnt < palloc_zero_low)
+    pool->refilling = true;
+  if (pool->refilling && pool->zeroed_cnt < palloc_zero_high)
+    page_idx = alloc_pages (pool, 1);
+  if (page_idx == BITMAP_ERROR)
+    pool->refilling = false;
+  spinlock_release (&pool->lock);
+  intr_set_level (old_level);
+  if (page_idx == BITMAP_ERROR)
+    return false;
+
+  /* Zero the page without holding the lock. */
+  b = (struct free_block *) (pool->base + PGSIZE * page_idx);
+  start = rdtsc ();
+  memset (b, 0, PGSIZE);
+  cycles = rdtsc () - start;
+
+  old_level = intr_disable ();
+  spinlock_acquire (&pool->lock);
+  list_push_front (&pool->zeroed, &b->elem);
+  if (++pool->zeroed_cnt >= palloc_zero_high)
+    pool->refilling = false;
+  pool->idle_zeroed++;
+  pool->idle_cycles += cycles;
+  spinlock_release (&pool->lock);
+  intr_set_level (old_level);
+  return true;
+}
+
+/* Prints POOL's free blocks by order, and how fragmented its
+   free memory is: the percentage of free pages that are not in
+   the largest free block, which a large allocation could use. */
+static void
+print_pool_stats (struct pool *pool, const char *name) 
+{
+  size_t free_cnts[ORDER_CNT];
+  size_t free_total = 0, largest = 0;
+  size_t zeroed_cnt;
+  long long hits, misses, idle_zeroed;
+  uint64_t idle_cycles, saved;
+  enum intr_level old_level;
+  int order;
+
+  /* printf() may sleep, so take a snapshot first. */
+  old_level = intr_disable ();
+  spinlock_acquire (&pool->lock);
+  memcpy (free_cnts, pool->free_cnts, sizeof free_cnts);
+  zeroed_cnt = pool->zeroed_cnt;
+  hits = pool->zero_hits;
+  misses = pool->zero_misses;
+  idle_zeroed = pool->idle_zeroed;
+  idle_cycles = pool->idle_cycles;
+  spinlock_release (&pool->lock);
+  intr_set_level (old_level);
+
+  printf ("%s: free blocks by order:", name);
+  for (order = 0; order < ORDER_CNT; order++) 
+    {
+      printf (" %zu", free_cnts[order]);
+      free_total += free_cnts[order] << order;
+      if (free_cnts[order] > 0)
+        largest = (size_t) 1 << order;
+    }
+  printf ("\n");
+  printf ("%s: %zu of %zu pages free, largest free block %zu pages, "
+          "%zu%% fragmented\n",
+          name, free_total, pool->page_cnt, largest,
+          free_total > 0 ? 100 - largest * 100 / free_total : 0);
+
+  /* Each hit saved zeroing a page on demand, which we estimate
+     took as long as the average page zeroed in idle time. */
+  saved = idle_zeroed > 0 ? hits * (idle_cycles / idle_zeroed) : 0;
+  printf ("%s: %zu zeroed pages ready, %lld hits, %lld misses, "
+          "%lld%% hit rate\n",
+          name, zeroed_cnt, hits, misses,
+          hits + misses > 0 ? hits * 100 / (hits + misses) : 0);
+  printf ("%s: %lld pages zeroed while idle, "
+          "about %"PRIu64" cycles saved\n",
+          name, idle_zeroed, saved);
+}
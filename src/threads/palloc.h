@@ -1,6 +1,7 @@
 #ifndef THREADS_PALLOC_H
 #define THREADS_PALLOC_H
 
+#include <stdbool.h>
 #include <stddef.h>
 
 /* How to allocate pages. */
@@ -19,5 +20,18 @@ void *palloc_get_page (enum palloc_flags);
 void *palloc_get_multiple (enum palloc_flags, size_t page_cnt);
 void palloc_free_page (void *);
 void palloc_free_multiple (void *, size_t page_cnt);
+bool palloc_zero_idle (void);
+void palloc_print_stats (void);
+
+/* Watermarks for each pool's stock of pages zeroed ahead of
+   time for PAL_ZERO.  Idle CPUs start zeroing pages when the
+   stock drops below the low watermark, and keep on until it
+   reaches the high one. */
+extern size_t palloc_zero_low;
+extern size_t palloc_zero_high;
+
+/* If true, print a fragmentation report at shutdown.
+   Controlled by kernel command-line option "-o=pallocstat". */
+extern bool pallocstat;
 
 #endif /* threads/palloc.h */
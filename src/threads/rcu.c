@@ -0,0 +1,200 @@
+#include "threads/rcu.h"
+#include <debug.h>
+#include "devices/timer.h"
+#include "threads/cpu.h"
+#include "threads/spinlock.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Read-copy update.  See rcu.h for an overview.
+
+   Each CPU counts its quiescent states in its rcu_qs member.
+   synchronize_rcu() snapshots every other CPU's count and waits
+   until each has moved on, or until that CPU is idle: an idle
+   CPU is not inside any read-side critical section and will
+   pass through schedule_tail() before it runs anything else.
+   The running CPU needs no check, because it cannot be inside a
+   read-side critical section while it is in synchronize_rcu().
+
+   Callbacks queued by call_rcu() are run in batches by the
+   "rcu" kernel thread, one grace period per batch, so that a
+   writer never has to sleep to free an object. */
+
+/* Callbacks waiting for a grace period. */
+static struct list callbacks;
+static struct spinlock callbacks_lock;
+
+/* Upped when callbacks are queued. */
+static struct semaphore callbacks_sema;
+
+static thread_func rcu_thread;
+
+/* Executes a full memory barrier.  Any locked instruction
+   serves; see [IA32-v3a] 8.2.2 "Memory Ordering in P6 and More
+   Recent Processor Families". */
+static inline void
+full_barrier (void)
+{
+  asm volatile ("lock; addl $0, (%%esp)" : : : "memory", "cc");
+}
+
+/* Initializes RCU and starts the thread that runs call_rcu()
+   callbacks.  Must be called after thread_start(). */
+void
+rcu_init (void)
+{
+  list_init (&callbacks);
+  spinlock_init (&callbacks_lock);
+  sema_init (&callbacks_sema, 0);
+  thread_create ("rcu", PRI_DEFAULT, rcu_thread, NULL);
+}
+
+/* Notes that the running CPU is in a quiescent state: it is not
+   inside any read-side critical section, so it holds no
+   reference to anything that a writer unlinked before now.
+   Called by the scheduler on every context switch and timer
+   tick. */
+void
+rcu_quiescent (void)
+{
+  struct cpu *c = cpu_current ();
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  /* Make sure that the reads in any critical section we just
+     left are done before the new count becomes visible. */
+  full_barrier ();
+  c->rcu_qs++;
+}
+
+/* Waits until every read-side critical section that was in
+   progress when it was called has ended.  After it returns, an
+   object that was unlinked before the call may be freed.  May
+   sleep, so it must not be called from an interrupt handler or
+   with interrupts off. */
+void
+synchronize_rcu (void)
+{
+  unsigned snapshot[CPU_MAX];
+  struct cpu *self;
+  enum intr_level old_level;
+  int i;
+
+  ASSERT (!intr_context ());
+  ASSERT (intr_get_level () == INTR_ON);
+
+  /* Make the writer's unlinking visible before looking at any
+     CPU's count. */
+  full_barrier ();
+  old_level = intr_disable ();
+  self = cpu_current ();
+  intr_set_level (old_level);
+  for (i = 0; i < cpu_cnt; i++)
+    snapshot[i] = *(volatile unsigned *) &cpus[i].rcu_qs;
+
+  for (;;)
+    {
+      bool done = true;
+
+      for (i = 0; i < cpu_cnt; i++)
+        {
+          struct cpu *c = &cpus[i];
+
+          if (c != self && c->started
+              && *(volatile unsigned *) &c->rcu_qs == snapshot[i]
+              && *(struct thread * volatile *) &c->curr != c->idle_thread)
+            done = false;
+        }
+      if (done)
+        break;
+      timer_sleep (1);
+    }
+  full_barrier ();
+}
+
+/* Arranges for FUNC to be called with HEAD, in a kernel thread,
+   once every read-side critical section in progress now has
+   ended.  Typically HEAD is embedded in an object that the
+   caller just unlinked and that FUNC frees.  Does not sleep, so
+   it may be called with interrupts off or while holding a
+   spinlock. */
+void
+call_rcu (struct rcu_head *head, rcu_func *func)
+{
+  enum intr_level old_level;
+  bool was_empty;
+
+  head->func = func;
+  old_level = intr_disable ();
+  spinlock_acquire (&callbacks_lock);
+  was_empty = list_empty (&callbacks);
+  list_push_back (&callbacks, &head->elem);
+  spinlock_release (&callbacks_lock);
+  if (was_empty)
+    sema_up (&callbacks_sema);
+  intr_set_level (old_level);
+}
+
+/* Runs the callbacks queued by call_rcu(), a batch at a time. */
+static void
+rcu_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      struct list batch;
+      enum intr_level old_level;
+
+      sema_down (&callbacks_sema);
+
+      /* Take every callback queued so far.  Anything queued
+         later ups the semaphore again and goes into the next
+         batch. */
+      list_init (&batch);
+      old_level = intr_disable ();
+      spinlock_acquire (&callbacks_lock);
+      if (!list_empty (&callbacks))
+        list_splice (list_end (&batch), list_begin (&callbacks),
+                     list_end (&callbacks));
+      spinlock_release (&callbacks_lock);
+      intr_set_level (old_level);
+
+      synchronize_rcu ();
+
+      while (!list_empty (&batch))
+        {
+          struct rcu_head *head = list_entry (list_pop_front (&batch),
+                                              struct rcu_head, elem);
+          head->func (head);
+        }
+    }
+}
+
+/* Inserts ELEM at the front of LIST, which readers may be
+   traversing concurrently.  ELEM is fully linked before it is
+   published, so a reader sees either the old list or the new
+   one.  The caller must hold the lock that serializes writers
+   of LIST. */
+void
+rcu_list_push_front (struct list *list, struct list_elem *elem)
+{
+  struct list_elem *before = list_begin (list);
+
+  elem->prev = before->prev;
+  elem->next = before;
+  barrier ();
+  before->prev->next = elem;
+  before->prev = elem;
+}
+
+/* Removes ELEM from its list, which readers may be traversing
+   concurrently.  ELEM's own links are left alone, so a reader
+   that is already looking at ELEM can still move on to the rest
+   of the list; ELEM must not be freed or reused until a grace
+   period has passed.  The caller must hold the lock that
+   serializes writers of the list. */
+void
+rcu_list_remove (struct list_elem *elem)
+{
+  barrier ();
+  list_remove (elem);
+}
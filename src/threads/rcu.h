@@ -0,0 +1,73 @@
+#ifndef THREADS_RCU_H
+#define THREADS_RCU_H
+
+#include <list.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "threads/interrupt.h"
+
+/* Read-copy update (RCU).
+
+   RCU lets readers traverse a shared data structure without
+   taking any lock or writing to any shared memory.  A reader
+   brackets its traversal with rcu_read_lock() and
+   rcu_read_unlock() and must not sleep in between.  A writer,
+   serialized against other writers by an ordinary lock, makes
+   its change visible with a single pointer store (see
+   rcu_list_push_front() below) and, if it unlinked an object,
+   must not free the object until every reader that might still
+   see it is done.  synchronize_rcu() waits for that; call_rcu()
+   arranges for a function to be called afterward without
+   waiting.
+
+   A read-side critical section in Pintos is simply a stretch of
+   code with interrupts off, so a CPU that has switched threads
+   or taken a timer tick with interrupts on since a writer
+   unlinked an object can no longer be looking at it.  Such a
+   point is called a quiescent state.  Once every other CPU has
+   passed through one, the grace period is over and the object
+   may be freed. */
+
+/* A deferred call to FUNC, embedded in the object that FUNC
+   frees. */
+struct rcu_head;
+typedef void rcu_func (struct rcu_head *);
+struct rcu_head
+  {
+    struct list_elem elem;      /* Element in callback list. */
+    rcu_func *func;             /* Function to call. */
+  };
+
+/* Converts pointer to rcu_head HEAD into a pointer to the
+   structure that HEAD is embedded inside.  Supply the name of
+   the outer structure STRUCT and the member name MEMBER of the
+   rcu_head. */
+#define rcu_entry(HEAD, STRUCT, MEMBER)                         \
+        ((STRUCT *) ((uint8_t *) &(HEAD)->elem                  \
+                     - offsetof (STRUCT, MEMBER.elem)))
+
+/* Begins a read-side critical section and returns the previous
+   interrupt level, to be passed to rcu_read_unlock(). */
+static inline enum intr_level
+rcu_read_lock (void)
+{
+  return intr_disable ();
+}
+
+/* Ends a read-side critical section begun by rcu_read_lock(),
+   which returned OLD_LEVEL. */
+static inline void
+rcu_read_unlock (enum intr_level old_level)
+{
+  intr_set_level (old_level);
+}
+
+void rcu_init (void);
+void rcu_quiescent (void);
+void synchronize_rcu (void);
+void call_rcu (struct rcu_head *, rcu_func *);
+
+void rcu_list_push_front (struct list *, struct list_elem *);
+void rcu_list_remove (struct list_elem *);
+
+#endif /* threads/rcu.h */
@@ -0,0 +1,399 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* Object caches.
+
+   malloc() rounds every request up to a power of 2, and hands
+   back raw memory that the caller must initialize from scratch
+   every time.  A cache instead holds objects of exactly one
+   size, packed as tightly as their alignment allows, and can
+   keep them initialized between uses: the optional constructor
+   runs once, when an object's memory is obtained, and the
+   destructor once, when it is given back, so an object that is
+   freed must be returned to its constructed state.
+
+   Each cache obtains memory a page at a time from the page
+   allocator.  Such a page is called a "slab".  Its header, at
+   the beginning of the page, is followed by an array of the
+   indexes of its free objects, used as a stack, and then by the
+   objects themselves.  Keeping the free list outside the
+   objects means that freeing an object does not overwrite any
+   of its constructed state.
+
+   Slabs whose objects are all in use are kept on the cache's
+   "full" list, those with some in use on the "partial" list,
+   and those with none on the "empty" list.  Allocation prefers
+   partial slabs, so that objects are packed into as few slabs
+   as possible and empty slabs can go back to the page allocator.
+   We keep a few empty slabs around so that a cache whose use
+   hovers around a slab boundary does not call the page
+   allocator on every allocation.
+
+   The space left over at the end of a slab is used to
+   "colour" it: successive slabs start their objects at
+   successively larger offsets, a cache line apart, so that the
+   objects at the same index in different slabs, which are
+   often used together, do not all map to the same cache sets. */
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* Colours are offsets in units of this many bytes. */
+#define CACHE_LINE 64
+
+/* Maximum number of empty slabs kept by a cache. */
+#define EMPTY_MAX 1
+
+/* A slab. */
+struct slab
+  {
+    unsigned magic;             /* Always set to SLAB_MAGIC. */
+    struct kmem_cache *cache;   /* Owning cache. */
+    struct list_elem elem;      /* Element in full, partial, or empty. */
+    uint8_t *objs;              /* First object. */
+    size_t free_cnt;            /* Number of free objects. */
+    uint16_t free[];            /* Indexes of free objects. */
+  };
+
+/* If true, print statistics for every cache at shutdown. */
+bool kmemstat;
+
+/* The cache from which caches are allocated. */
+static struct kmem_cache cache_cache;
+
+/* All caches, for statistics. */
+static struct list caches;
+static struct lock caches_lock;
+
+static void cache_setup (struct kmem_cache *, const char *name,
+                         size_t size, size_t align,
+                         kmem_ctor *, kmem_dtor *);
+static size_t slab_header_size (size_t per_slab, size_t align);
+static struct slab *slab_create (struct kmem_cache *, size_t colour);
+static void slab_destroy (struct kmem_cache *, struct slab *);
+
+/* Initializes the object cache allocator. */
+void
+kmem_init (void)
+{
+  list_init (&caches);
+  lock_init (&caches_lock);
+  cache_setup (&cache_cache, "kmem_cache", sizeof (struct kmem_cache),
+               0, NULL, NULL);
+  list_push_back (&caches, &cache_cache.elem);
+}
+
+/* Creates and returns a cache named NAME for objects of SIZE
+   bytes, each aligned on a multiple of ALIGN bytes, which must
+   be a power of 2, or 0 for word alignment.  If CTOR is
+   nonnull, it is called for each object when memory for it is
+   obtained; if DTOR is nonnull, it is called for each object
+   before its memory is given back.  Returns a null pointer if
+   memory is not available. */
+struct kmem_cache *
+kmem_cache_create (const char *name, size_t size, size_t align,
+                   kmem_ctor *ctor, kmem_dtor *dtor)
+{
+  struct kmem_cache *cache;
+
+  ASSERT (name != NULL);
+  ASSERT (size > 0);
+  ASSERT ((align & (align - 1)) == 0);
+
+  cache = kmem_cache_alloc (&cache_cache);
+  if (cache == NULL)
+    return NULL;
+  cache_setup (cache, name, size, align, ctor, dtor);
+
+  lock_acquire (&caches_lock);
+  list_push_back (&caches, &cache->elem);
+  lock_release (&caches_lock);
+  return cache;
+}
+
+/* Destroys CACHE, which must have no objects in use. */
+void
+kmem_cache_destroy (struct kmem_cache *cache)
+{
+  ASSERT (cache != NULL && cache != &cache_cache);
+  ASSERT (list_empty (&cache->full));
+  ASSERT (list_empty (&cache->partial));
+
+  lock_acquire (&caches_lock);
+  list_remove (&cache->elem);
+  lock_release (&caches_lock);
+
+  kmem_cache_shrink (cache);
+  kmem_cache_free (&cache_cache, cache);
+}
+
+/* Obtains and returns an object from CACHE, in its constructed
+   state.  Returns a null pointer if memory is not available. */
+void *
+kmem_cache_alloc (struct kmem_cache *cache)
+{
+  struct slab *s;
+  void *obj;
+
+  ASSERT (cache != NULL);
+  ASSERT (!intr_context ());
+
+  lock_acquire (&cache->lock);
+  if (!list_empty (&cache->partial))
+    s = list_entry (list_pop_front (&cache->partial), struct slab, elem);
+  else if (!list_empty (&cache->empty))
+    {
+      s = list_entry (list_pop_front (&cache->empty), struct slab, elem);
+      cache->empty_cnt--;
+    }
+  else
+    {
+      /* Create a new slab.  Constructors may take a while, and
+         may even use other caches, so don't hold the lock. */
+      size_t colour = cache->colour_next;
+      cache->colour_next = (colour + 1) % cache->colour_cnt;
+      lock_release (&cache->lock);
+
+      s = slab_create (cache, colour);
+      if (s == NULL)
+        return NULL;
+
+      lock_acquire (&cache->lock);
+      cache->slab_cnt++;
+      cache->grow_cnt++;
+    }
+
+  obj = s->objs + s->free[--s->free_cnt] * cache->stride;
+  list_push_front (s->free_cnt > 0 ? &cache->partial : &cache->full,
+                   &s->elem);
+  cache->in_use++;
+  cache->alloc_cnt++;
+  lock_release (&cache->lock);
+
+  return obj;
+}
+
+/* Returns OBJ, which must have been obtained from CACHE and
+   must be in its constructed state, to CACHE.  If OBJ is a null
+   pointer, does nothing. */
+void
+kmem_cache_free (struct kmem_cache *cache, void *obj)
+{
+  struct slab *s, *reap = NULL;
+  size_t idx;
+
+  if (obj == NULL)
+    return;
+
+  s = pg_round_down (obj);
+  ASSERT (s->magic == SLAB_MAGIC);
+  ASSERT (s->cache == cache);
+  idx = ((uint8_t *) obj - s->objs) / cache->stride;
+  ASSERT ((uint8_t *) obj == s->objs + idx * cache->stride);
+  ASSERT (idx < cache->per_slab);
+
+#ifndef NDEBUG
+  /* Clear the object to help detect use-after-free bugs, unless
+     it has constructed state that we must preserve. */
+  if (cache->ctor == NULL)
+    memset (obj, 0xcc, cache->size);
+#endif
+
+  lock_acquire (&cache->lock);
+  ASSERT (s->free_cnt < cache->per_slab);
+  list_remove (&s->elem);
+  s->free[s->free_cnt++] = idx;
+  if (s->free_cnt < cache->per_slab)
+    list_push_front (&cache->partial, &s->elem);
+  else if (cache->empty_cnt < EMPTY_MAX)
+    {
+      list_push_front (&cache->empty, &s->elem);
+      cache->empty_cnt++;
+    }
+  else
+    {
+      reap = s;
+      cache->slab_cnt--;
+      cache->reap_cnt++;
+    }
+  cache->in_use--;
+  cache->free_cnt++;
+  lock_release (&cache->lock);
+
+  if (reap != NULL)
+    slab_destroy (cache, reap);
+}
+
+/* Gives all of CACHE's empty slabs back to the page allocator. */
+void
+kmem_cache_shrink (struct kmem_cache *cache)
+{
+  struct list reap;
+
+  list_init (&reap);
+  lock_acquire (&cache->lock);
+  while (!list_empty (&cache->empty))
+    {
+      list_push_back (&reap, list_pop_front (&cache->empty));
+      cache->slab_cnt--;
+      cache->reap_cnt++;
+    }
+  cache->empty_cnt = 0;
+  lock_release (&cache->lock);
+
+  while (!list_empty (&reap))
+    slab_destroy (cache, list_entry (list_pop_front (&reap),
+                                     struct slab, elem));
+}
+
+/* Prints statistics for CACHE. */
+void
+kmem_cache_print_stats (struct kmem_cache *cache)
+{
+  struct kmem_cache snap;
+
+  /* printf() acquires the console lock, so take a snapshot
+     first. */
+  lock_acquire (&cache->lock);
+  snap.slab_cnt = cache->slab_cnt;
+  snap.empty_cnt = cache->empty_cnt;
+  snap.in_use = cache->in_use;
+  snap.alloc_cnt = cache->alloc_cnt;
+  snap.free_cnt = cache->free_cnt;
+  snap.grow_cnt = cache->grow_cnt;
+  snap.reap_cnt = cache->reap_cnt;
+  lock_release (&cache->lock);
+
+  printf ("%-16s %6zu %5zu %4zu %7zu %6zu %6zu %9lld %9lld %6lld %6lld\n",
+          cache->name, cache->size, cache->per_slab, cache->colour_cnt,
+          snap.slab_cnt, snap.empty_cnt, snap.in_use,
+          snap.alloc_cnt, snap.free_cnt, snap.grow_cnt, snap.reap_cnt);
+}
+
+/* Prints statistics for every cache, if requested. */
+void
+kmem_print_stats (void)
+{
+  struct list_elem *e;
+
+  if (!kmemstat)
+    return;
+
+  printf ("Object caches:\n");
+  printf ("%-16s %6s %5s %4s %7s %6s %6s %9s %9s %6s %6s\n",
+          "name", "size", "/slab", "clrs", "slabs", "empty", "in use",
+          "allocs", "frees", "grows", "reaps");
+  lock_acquire (&caches_lock);
+  for (e = list_begin (&caches); e != list_end (&caches); e = list_next (e))
+    kmem_cache_print_stats (list_entry (e, struct kmem_cache, elem));
+  lock_release (&caches_lock);
+}
+
+/* Initializes CACHE as a cache named NAME for SIZE-byte objects
+   with the given ALIGN, CTOR, and DTOR, and lays out its
+   slabs. */
+static void
+cache_setup (struct kmem_cache *cache, const char *name,
+             size_t size, size_t align, kmem_ctor *ctor, kmem_dtor *dtor)
+{
+  size_t leftover;
+
+  if (align < sizeof (void *))
+    align = sizeof (void *);
+
+  strlcpy (cache->name, name, sizeof cache->name);
+  cache->size = size;
+  cache->align = align;
+  cache->stride = ROUND_UP (size, align);
+  cache->ctor = ctor;
+  cache->dtor = dtor;
+
+  /* Fit as many objects as we can after the header, which
+     itself grows by one free list entry per object. */
+  cache->per_slab = (PGSIZE - sizeof (struct slab))
+                    / (cache->stride + sizeof (uint16_t));
+  while (cache->per_slab > 0
+         && (slab_header_size (cache->per_slab, align)
+             + cache->per_slab * cache->stride) > PGSIZE)
+    cache->per_slab--;
+  ASSERT (cache->per_slab > 0);
+
+  /* Colour with whatever space is left over. */
+  leftover = PGSIZE - slab_header_size (cache->per_slab, align)
+             - cache->per_slab * cache->stride;
+  cache->colour_step = align > CACHE_LINE ? align : CACHE_LINE;
+  cache->colour_cnt = leftover / cache->colour_step + 1;
+  cache->colour_next = 0;
+
+  lock_init (&cache->lock);
+  list_init (&cache->full);
+  list_init (&cache->partial);
+  list_init (&cache->empty);
+  cache->empty_cnt = 0;
+
+  cache->slab_cnt = cache->in_use = 0;
+  cache->alloc_cnt = cache->free_cnt = 0;
+  cache->grow_cnt = cache->reap_cnt = 0;
+}
+
+/* Returns the offset of the first object in an uncoloured slab
+   of PER_SLAB objects aligned on ALIGN bytes. */
+static size_t
+slab_header_size (size_t per_slab, size_t align)
+{
+  return ROUND_UP (sizeof (struct slab) + per_slab * sizeof (uint16_t),
+                   align);
+}
+
+/* Obtains a page for a new slab for CACHE with the given COLOUR,
+   and constructs its objects.  Returns a null pointer if memory
+   is not available. */
+static struct slab *
+slab_create (struct kmem_cache *cache, size_t colour)
+{
+  struct slab *s;
+  size_t i;
+
+  s = palloc_get_page (0);
+  if (s == NULL)
+    return NULL;
+
+  s->magic = SLAB_MAGIC;
+  s->cache = cache;
+  s->objs = ((uint8_t *) s + slab_header_size (cache->per_slab, cache->align)
+             + colour * cache->colour_step);
+  s->free_cnt = cache->per_slab;
+
+  /* Hand out objects from the start of the slab first. */
+  for (i = 0; i < cache->per_slab; i++)
+    {
+      s->free[i] = cache->per_slab - i - 1;
+      if (cache->ctor != NULL)
+        cache->ctor (s->objs + i * cache->stride);
+    }
+  return s;
+}
+
+/* Destroys the objects in slab S, which belongs to CACHE and has
+   none in use, and frees its page. */
+static void
+slab_destroy (struct kmem_cache *cache, struct slab *s)
+{
+  size_t i;
+
+  ASSERT (s->magic == SLAB_MAGIC);
+  ASSERT (s->free_cnt == cache->per_slab);
+
+  if (cache->dtor != NULL)
+    for (i = 0; i < cache->per_slab; i++)
+      cache->dtor (s->objs + i * cache->stride);
+  s->magic = 0;
+  palloc_free_page (s);
+}
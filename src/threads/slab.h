@@ -0,0 +1,62 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "threads/synch.h"
+
+/* Object caches, after "The Slab Allocator: An Object-Caching
+   Kernel Memory Allocator" by Jeff Bonwick.  See slab.c. */
+
+/* Constructor and destructor for a cache's objects. */
+typedef void kmem_ctor (void *obj);
+typedef void kmem_dtor (void *obj);
+
+/* A cache of objects of one type.  Treat as opaque. */
+struct kmem_cache
+  {
+    char name[16];              /* Name, for statistics. */
+    size_t size;                /* Object size, as requested. */
+    size_t align;               /* Object alignment. */
+    size_t stride;              /* Distance between objects in a slab. */
+    size_t per_slab;            /* Objects per slab. */
+    size_t colour_cnt;          /* Number of distinct colours. */
+    size_t colour_step;         /* Bytes between colours. */
+    size_t colour_next;         /* Colour of the next slab. */
+    kmem_ctor *ctor;            /* Constructor, or null. */
+    kmem_dtor *dtor;            /* Destructor, or null. */
+
+    struct lock lock;           /* Protects all of the below. */
+    struct list full;           /* Slabs with no free objects. */
+    struct list partial;        /* Slabs with some free objects. */
+    struct list empty;          /* Slabs with no objects in use. */
+    size_t empty_cnt;           /* Number of slabs in EMPTY. */
+
+    /* Statistics. */
+    size_t slab_cnt;            /* Slabs currently allocated. */
+    size_t in_use;              /* Objects currently allocated. */
+    long long alloc_cnt;        /* Total objects allocated. */
+    long long free_cnt;         /* Total objects freed. */
+    long long grow_cnt;         /* Total slabs created. */
+    long long reap_cnt;         /* Total slabs given back. */
+
+    struct list_elem elem;      /* Element in list of all caches. */
+  };
+
+void kmem_init (void);
+struct kmem_cache *kmem_cache_create (const char *name, size_t size,
+                                      size_t align,
+                                      kmem_ctor *, kmem_dtor *);
+void kmem_cache_destroy (struct kmem_cache *);
+void *kmem_cache_alloc (struct kmem_cache *);
+void kmem_cache_free (struct kmem_cache *, void *);
+void kmem_cache_shrink (struct kmem_cache *);
+void kmem_cache_print_stats (struct kmem_cache *);
+void kmem_print_stats (void);
+
+/* If true, print statistics for every cache at shutdown.
+   Controlled by kernel command-line option "-o=kmemstat". */
+extern bool kmemstat;
+
+#endif /* threads/slab.h */
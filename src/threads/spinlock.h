@@ -0,0 +1,79 @@
+#ifndef THREADS_SPINLOCK_H
+#define THREADS_SPINLOCK_H
+
+#include <debug.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "threads/interrupt.h"
+
+/* A spinlock.
+
+   Spinlocks protect data shared between CPUs for short critical
+   sections that must not sleep, such as the run queues and
+   semaphore wait lists.  A spinlock may only be held with
+   interrupts disabled: otherwise an interrupt handler on the
+   same CPU could try to acquire the lock while the interrupted
+   code holds it, and spin forever.
+
+   Spinlocks are not recursive.  A thread must release every
+   spinlock it holds before it blocks, except that
+   thread_block_spin() releases one for it. */
+struct spinlock
+  {
+    volatile uint32_t locked;   /* 1 if held, 0 if free. */
+  };
+
+/* Initializer for a static spinlock, which may also simply be
+   zero-initialized. */
+#define SPINLOCK_INITIALIZER { 0 }
+
+/* Initializes LOCK as free. */
+static inline void
+spinlock_init (struct spinlock *lock)
+{
+  lock->locked = 0;
+}
+
+/* Tries to acquire LOCK without spinning.  Returns true if
+   successful, false if LOCK is already held.
+
+   "xchg" with a memory operand is implicitly locked and acts as
+   a full memory barrier.  See [IA32-v2b] "XCHG". */
+static inline bool
+spinlock_try_acquire (struct spinlock *lock)
+{
+  uint32_t old = 1;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  asm volatile ("xchgl %0, %1" : "+r" (old), "+m" (lock->locked)
+                : : "memory");
+  return old == 0;
+}
+
+/* Acquires LOCK, spinning until it becomes free.  Interrupts
+   must be off.
+
+   While waiting we only read the lock, so that its cache line
+   stays shared instead of bouncing between the waiting CPUs,
+   and we execute "pause" to tell the CPU that this is a
+   spin-wait loop.  See [IA32-v2b] "PAUSE". */
+static inline void
+spinlock_acquire (struct spinlock *lock)
+{
+  while (!spinlock_try_acquire (lock))
+    while (lock->locked)
+      asm volatile ("pause" : : : "memory");
+}
+
+/* Releases LOCK, which the running CPU must hold.  On x86,
+   stores are not reordered with older loads or stores, so a
+   compiler barrier followed by a plain store suffices. */
+static inline void
+spinlock_release (struct spinlock *lock)
+{
+  ASSERT (lock->locked);
+  asm volatile ("" : : : "memory");
+  lock->locked = 0;
+}
+
+#endif /* threads/spinlock.h */
@@ -36,4 +36,10 @@ void switch_thunk (void);
 #define SWITCH_CUR      20
 #define SWITCH_NEXT     24
 
+/* Offset of `stack' member within `struct thread'.  switch.S
+   can't figure it out on its own, and having it as a constant
+   saves a memory load on every thread switch.  thread_init()
+   checks that it is right. */
+#define SWITCH_STACK_OFS 24
+
 #endif /* threads/switch.h */
@@ -27,10 +27,24 @@
 */
 
 #include "threads/synch.h"
+#include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
 #include "threads/interrupt.h"
+#include "threads/lockdep.h"
 #include "threads/thread.h"
+#include "devices/timer.h"
+
+static heap_less_func waiter_less;
+static struct heap_elem *waiter_pop (struct heap *);
+static void sema_wait_done (void);
+static void requeue_waiter (struct thread *);
+#ifdef LOCKSTAT
+struct lock_class;
+static struct lock_class *lock_class_lookup (const char *name);
+static void lock_class_count (struct lock_class *, bool contended,
+                              int64_t wait);
+#endif
 
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
@@ -40,14 +54,30 @@
      decrement it.
 
    - up or "V": increment the value (and wake up one waiting
-     thread, if any). */
+     thread, if any).
+
+   Waiting threads are kept in a heap ordered by priority, and
+   then by order of arrival, so that both up and down take
+   O(lg n) time even with many waiters.  A waiter whose priority
+   changes through donation is moved within the heap; see
+   requeue_waiter().  Under the MLFQS, a waiter's priority may
+   change without it being moved; see waiter_pop().
+
+   NAME is for lock statistics.  Use the sema_init() macro, which
+   supplies it, instead of calling this function directly. */
 void
-sema_init (struct semaphore *sema, unsigned value) 
+sema_init_named (struct semaphore *sema, unsigned value,
+                 const char *name UNUSED) 
 {
   ASSERT (sema != NULL);
 
   sema->value = value;
-  list_init (&sema->waiters);
+  heap_init (&sema->waiters, waiter_less, NULL);
+  sema->seq = 0;
+  spinlock_init (&sema->lock);
+#ifdef LOCKSTAT
+  sema->class = lock_class_lookup (name);
+#endif
 }
 
 /* Down or "P" operation on a semaphore.  Waits for SEMA's value
@@ -62,17 +92,39 @@ void
 sema_down (struct semaphore *sema) 
 {
   enum intr_level old_level;
+#ifdef LOCKSTAT
+  bool waited = false;
+  int64_t start = 0;
+#endif
 
   ASSERT (sema != NULL);
   ASSERT (!intr_context ());
 
   old_level = intr_disable ();
+  spinlock_acquire (&sema->lock);
   while (sema->value == 0) 
     {
-      list_push_back (&sema->waiters, &thread_current ()->elem);
-      thread_block ();
+      struct thread *cur = thread_current ();
+
+#ifdef LOCKSTAT
+      if (!waited) 
+        {
+          waited = true;
+          start = timer_ticks ();
+        }
+#endif
+      cur->waiting_sema = sema;
+      cur->wait_seq = sema->seq++;
+      heap_push (&sema->waiters, &cur->heap_elem);
+      thread_block_spin (&sema->lock, WCHAN_SEMA);
+      sema_wait_done ();
+      spinlock_acquire (&sema->lock);
     }
   sema->value--;
+  spinlock_release (&sema->lock);
+#ifdef LOCKSTAT
+  lock_class_count (sema->class, waited, waited ? timer_elapsed (start) : 0);
+#endif
   intr_set_level (old_level);
 }
 
@@ -90,6 +142,7 @@ sema_try_down (struct semaphore *sema)
   ASSERT (sema != NULL);
 
   old_level = intr_disable ();
+  spinlock_acquire (&sema->lock);
   if (sema->value > 0) 
     {
       sema->value--;
@@ -97,13 +150,21 @@ sema_try_down (struct semaphore *sema)
     }
   else
     success = false;
+  spinlock_release (&sema->lock);
+#ifdef LOCKSTAT
+  if (success)
+    lock_class_count (sema->class, false, 0);
+#endif
   intr_set_level (old_level);
 
   return success;
 }
 
 /* Up or "V" operation on a semaphore.  Increments SEMA's value
-   and wakes up one thread of those waiting for SEMA, if any.
+   and wakes up the highest-priority thread of those waiting for
+   SEMA, if any, yielding to it if it should preempt the running
+   thread.  If interrupts were already off, the caller must call
+   thread_preempt() itself once it is ready to yield.
 
    This function may be called from an interrupt handler. */
 void
@@ -114,11 +175,20 @@ sema_up (struct semaphore *sema)
   ASSERT (sema != NULL);
 
   old_level = intr_disable ();
-  if (!list_empty (&sema->waiters)) 
-    thread_unblock (list_entry (list_pop_front (&sema->waiters),
-                                struct thread, elem));
+  spinlock_acquire (&sema->lock);
+  if (!heap_empty (&sema->waiters)) 
+    {
+      struct thread *t = heap_entry (waiter_pop (&sema->waiters),
+                                     struct thread, heap_elem);
+      t->waiting_sema = NULL;
+      thread_unblock (t);
+    }
   sema->value++;
+  spinlock_release (&sema->lock);
   intr_set_level (old_level);
+
+  if (old_level == INTR_ON || intr_context ())
+    thread_preempt ();
 }
 
 static void sema_test_helper (void *sema_);
@@ -158,33 +228,238 @@ sema_test_helper (void *sema_)
     }
 }
 
-/* Initializes LOCK.  A lock can be held by at most a single
-   thread at any given time.  Our locks are not "recursive", that
-   is, it is an error for the thread currently holding a lock to
-   try to acquire that lock.
-
-   A lock is a specialization of a semaphore with an initial
-   value of 1.  The difference between a lock and such a
-   semaphore is twofold.  First, a semaphore can have a value
-   greater than 1, but a lock can only be owned by a single
-   thread at a time.  Second, a semaphore does not have an owner,
-   meaning that one thread can "down" the semaphore and then
-   another one "up" it, but with a lock the same thread must both
-   acquire and release it.  When these restrictions prove
-   onerous, it's a good sign that a semaphore should be used,
-   instead of a lock. */
+static void lock_hand_off (struct lock *);
+static void lock_enqueue (struct lock *, struct thread *);
+static int rw_top_priority (const struct rwlock *);
+static void rw_donate (struct rwlock *);
+#ifdef LOCKSTAT
+static void lock_stat_acquired (struct lock *, bool contended, int64_t wait);
+static void lock_stat_released (struct lock *);
+#endif
+
+/* Priority donation.
+
+   When a thread waits for a lock, it donates its priority to the
+   lock's holder, and if the holder is itself waiting for a lock,
+   on to that lock's holder, and so on.  A thread's effective
+   priority is the higher of its base priority, set with
+   thread_set_priority(), and the priority of the highest-
+   priority thread waiting for any lock that it holds.
+
+   To keep this cheap, each lock keeps its waiting threads in a
+   heap ordered by priority, and each thread keeps the held locks
+   that have waiters in a heap, its donors, ordered by the
+   priority of each lock's top waiter.  A thread's donated
+   priority is then at the top of its donors, and a change in
+   one waiter's priority costs O(lg n) heap updates for each
+   lock along the chain of holders that it affects.  Locks that
+   no thread waits for never take part, so an uncontended lock
+   costs no more than a spinlock acquire and release.
+
+   All donation state, that is, every lock's waiters, every
+   thread's donors, waiting_lock, and wait_seq, and changes to
+   effective priorities, is protected by donation_lock.  A
+   lock's holder and waiters are also protected by the lock's
+   own spinlock, which must be acquired after donation_lock, so
+   that the fast paths need only the latter.  A lock that has
+   waiters is always held, since lock_release() hands it to a
+   waiter directly, so while holding donation_lock we can follow
+   a chain of holders without taking each lock's spinlock.
+
+   Readers-writer locks take part in the same way, except that
+   such a lock may have many holders, all of which its waiters
+   donate to.  Each holder keeps a struct rw_hold for every
+   readers-writer lock it holds, and those with waiters are its
+   rw_donors.  See rw_donate().
+
+   The multi-level feedback queue scheduler does not use
+   donation, since it computes priorities itself.  It does so
+   without moving blocked threads within the waiter heaps, which
+   leaves those and the donor heaps out of order, so then
+   waiter_pop() scans for the top waiter and donors go unused. */
+static struct spinlock donation_lock;
+
+/* Tiebreaker for waiters with equal priorities, so that they
+   acquire the lock in order of arrival. */
+static unsigned donation_seq;
+
+/* Returns true if waiting thread A should get its lock, or be
+   woken from its semaphore, before waiting thread B. */
+static bool
+waiter_less (const struct heap_elem *a_, const struct heap_elem *b_,
+             void *aux UNUSED) 
+{
+  const struct thread *a = heap_entry (a_, struct thread, heap_elem);
+  const struct thread *b = heap_entry (b_, struct thread, heap_elem);
+
+  if (a->priority != b->priority)
+    return a->priority > b->priority;
+  return (int) (a->wait_seq - b->wait_seq) < 0;
+}
+
+/* Removes and returns the first of WAITERS, a heap of waiters
+   ordered by priority, which must not be empty.
+
+   The multi-level feedback queue scheduler recomputes blocked
+   threads' priorities once a second, in the timer interrupt,
+   without moving them within the heaps that they wait in, which
+   would mean taking every wait list's lock there.  So with it,
+   WAITERS may be out of order, and we scan all of it instead. */
+static struct heap_elem *
+waiter_pop (struct heap *waiters) 
+{
+  struct heap_elem *first;
+
+  if (!thread_mlfqs)
+    return heap_pop (waiters);
+  first = heap_scan (waiters);
+  heap_remove (waiters, first);
+  return first;
+}
+
+/* Returns the priority of the highest-priority thread waiting
+   for LOCK, which must have waiters. */
+static int
+lock_top_priority (const struct lock *lock) 
+{
+  return heap_entry (heap_top (&lock->waiters),
+                     struct thread, heap_elem)->priority;
+}
+
+/* Returns true if held lock A's top waiter has a higher priority
+   than held lock B's.  Orders a thread's donors. */
+bool
+lock_donor_less (const struct heap_elem *a_, const struct heap_elem *b_,
+                 void *aux UNUSED) 
+{
+  const struct lock *a = heap_entry (a_, struct lock, donor_elem);
+  const struct lock *b = heap_entry (b_, struct lock, donor_elem);
+
+  return lock_top_priority (a) > lock_top_priority (b);
+}
+
+/* Recomputes T's effective priority from its base priority and
+   its donors and, if it changed and T is waiting for a lock,
+   passes the change along to the lock's holder, and so on.
+   donation_lock must be held. */
+static void
+donate (struct thread *t) 
+{
+  if (thread_mlfqs)
+    return;
+
+  for (;;) 
+    {
+      int priority = t->base_priority;
+      struct lock *lock;
+
+      if (!heap_empty (&t->donors)) 
+        {
+          int donated = lock_top_priority (heap_entry (heap_top (&t->donors),
+                                                       struct lock,
+                                                       donor_elem));
+          if (donated > priority)
+            priority = donated;
+        }
+      if (!heap_empty (&t->rw_donors)) 
+        {
+          int donated = rw_top_priority (heap_entry (heap_top (&t->rw_donors),
+                                                     struct rw_hold,
+                                                     donor_elem)->rw);
+          if (donated > priority)
+            priority = donated;
+        }
+      if (priority == t->priority)
+        break;
+      thread_set_effective_priority (t, priority);
+
+      lock = t->waiting_lock;
+      if (lock == NULL) 
+        {
+          struct rwlock *rw = t->waiting_rw;
+
+          if (rw != NULL) 
+            {
+              heap_update (t->waiting_rw_write
+                           ? &rw->write_waiters : &rw->read_waiters,
+                           &t->heap_elem);
+              rw_donate (rw);
+            }
+          else
+            requeue_waiter (t);
+          break;
+        }
+      heap_update (&lock->waiters, &t->heap_elem);
+      t = lock->holder;
+      heap_update (&t->donors, &lock->donor_elem);
+    }
+}
+
+/* Called by a thread that was waiting on a semaphore, after it
+   wakes up.  Waits until no donor that might have seen the
+   thread as waiting on the semaphore is still looking at it,
+   since a semaphore may be freed as soon as its last waiter
+   returns from sema_down().  See requeue_waiter(). */
+static void
+sema_wait_done (void) 
+{
+  if (!thread_mlfqs) 
+    {
+      spinlock_acquire (&donation_lock);
+      spinlock_release (&donation_lock);
+    }
+}
+
+/* Recomputes T's effective priority, after its base priority has
+   changed, and passes any change along to the holders of the
+   locks it is waiting for. */
+void
+lock_update_priority (struct thread *t) 
+{
+  enum intr_level old_level = intr_disable ();
+  spinlock_acquire (&donation_lock);
+  donate (t);
+  spinlock_release (&donation_lock);
+  intr_set_level (old_level);
+}
+
+/* Initializes LOCK, which is named NAME for the purpose of lock
+   statistics and is initialized at line LINE of FILE.  Use the
+   lock_init() macro instead of calling this function directly.
+   A lock can be held by at most a single thread at any given
+   time.  Our locks are not "recursive", that is, it is an error
+   for the thread currently holding a lock to try to acquire
+   that lock.
+
+   A lock is like a semaphore with an initial value of 1.  The
+   difference between a lock and such a semaphore is twofold.
+   First, a semaphore can have a value greater than 1, but a
+   lock can only be owned by a single thread at a time.  Second,
+   a semaphore does not have an owner, meaning that one thread
+   can "down" the semaphore and then another one "up" it, but
+   with a lock the same thread must both acquire and release it.
+   When these restrictions prove onerous, it's a good sign that a
+   semaphore should be used, instead of a lock.  Having an owner
+   is also what makes priority donation possible; see above. */
 void
-lock_init (struct lock *lock)
+lock_init_named (struct lock *lock, const char *name UNUSED,
+                 const char *file UNUSED, int line UNUSED)
 {
   ASSERT (lock != NULL);
 
   lock->holder = NULL;
-  sema_init (&lock->semaphore, 1);
+  spinlock_init (&lock->spin);
+  heap_init (&lock->waiters, waiter_less, NULL);
+  lockdep_init_lock (lock, name, file, line);
+#ifdef LOCKSTAT
+  lock->class = lock_class_lookup (name);
+#endif
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
-   necessary.  The lock must not already be held by the current
-   thread.
+   necessary, and donating the current thread's priority to the
+   holder meanwhile.  The lock must not already be held by the
+   current thread.
 
    This function may sleep, so it must not be called within an
    interrupt handler.  This function may be called with
@@ -193,12 +468,59 @@ lock_init (struct lock *lock)
 void
 lock_acquire (struct lock *lock)
 {
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+#ifdef LOCKSTAT
+  int64_t start;
+#endif
+
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (!lock_held_by_current_thread (lock));
+  lockdep_check (lock);
+
+  /* Fast path: the lock is free. */
+  old_level = intr_disable ();
+  spinlock_acquire (&lock->spin);
+  if (lock->holder == NULL)
+    goto acquired;
+  spinlock_release (&lock->spin);
 
-  sema_down (&lock->semaphore);
-  lock->holder = thread_current ();
+  /* Slow path.  Take the locks in the proper order and check
+     again. */
+  spinlock_acquire (&donation_lock);
+  spinlock_acquire (&lock->spin);
+  if (lock->holder == NULL) 
+    {
+      spinlock_release (&donation_lock);
+      goto acquired;
+    }
+
+  /* Wait for the lock, donating our priority to its holder. */
+  lock_enqueue (lock, cur);
+  spinlock_release (&donation_lock);
+#ifdef LOCKSTAT
+  start = timer_ticks ();
+#endif
+
+  /* lock_release() makes us the holder before waking us up. */
+  thread_block_spin (&lock->spin, WCHAN_SEMA);
+  intr_set_level (old_level);
+  ASSERT (lock->holder == cur);
+  lockdep_acquired (lock);
+#ifdef LOCKSTAT
+  lock_stat_acquired (lock, true, timer_elapsed (start));
+#endif
+  return;
+
+ acquired:
+  lock->holder = cur;
+  spinlock_release (&lock->spin);
+  intr_set_level (old_level);
+  lockdep_acquired (lock);
+#ifdef LOCKSTAT
+  lock_stat_acquired (lock, false, 0);
+#endif
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -210,19 +532,36 @@ lock_acquire (struct lock *lock)
 bool
 lock_try_acquire (struct lock *lock)
 {
+  enum intr_level old_level;
   bool success;
 
   ASSERT (lock != NULL);
   ASSERT (!lock_held_by_current_thread (lock));
 
-  success = sema_try_down (&lock->semaphore);
+  old_level = intr_disable ();
+  spinlock_acquire (&lock->spin);
+  success = lock->holder == NULL;
   if (success)
     lock->holder = thread_current ();
+  spinlock_release (&lock->spin);
+  intr_set_level (old_level);
+
+  /* A lock that is only ever tried cannot deadlock, so there is
+     no order to check, but it still counts as held. */
+  if (success)
+    lockdep_acquired (lock);
+#ifdef LOCKSTAT
+  if (success)
+    lock_stat_acquired (lock, false, 0);
+#endif
   return success;
 }
 
-/* Releases LOCK, which must be owned by the current thread.
-   This is lock_release function.
+/* Releases LOCK, which must be owned by the current thread.  If
+   any threads are waiting for LOCK, hands it to the one with the
+   highest priority, gives up the priority donated through LOCK,
+   and yields if that leaves the current thread without the
+   highest priority.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to release a lock within an interrupt
@@ -230,11 +569,88 @@ lock_try_acquire (struct lock *lock)
 void
 lock_release (struct lock *lock) 
 {
+  enum intr_level old_level;
+
   ASSERT (lock != NULL);
   ASSERT (lock_held_by_current_thread (lock));
 
-  lock->holder = NULL;
-  sema_up (&lock->semaphore);
+  lockdep_released (lock);
+#ifdef LOCKSTAT
+  lock_stat_released (lock);
+#endif
+
+  /* Fast path: no waiters. */
+  old_level = intr_disable ();
+  spinlock_acquire (&lock->spin);
+  if (heap_empty (&lock->waiters)) 
+    {
+      lock->holder = NULL;
+      spinlock_release (&lock->spin);
+      intr_set_level (old_level);
+      return;
+    }
+  spinlock_release (&lock->spin);
+
+  /* Slow path. */
+  spinlock_acquire (&donation_lock);
+  spinlock_acquire (&lock->spin);
+  lock_hand_off (lock);
+  spinlock_release (&lock->spin);
+  spinlock_release (&donation_lock);
+  intr_set_level (old_level);
+
+  thread_preempt ();
+}
+
+/* Releases LOCK, which the current thread holds, by handing it
+   to its top waiter, along with the donations of the threads
+   still waiting, or by marking it free if there are no waiters.
+   Does not yield.  donation_lock and LOCK's spinlock must be
+   held. */
+static void
+lock_hand_off (struct lock *lock) 
+{
+  struct thread *cur = thread_current ();
+  struct thread *next;
+
+  if (heap_empty (&lock->waiters)) 
+    {
+      lock->holder = NULL;
+      return;
+    }
+
+  next = heap_entry (waiter_pop (&lock->waiters), struct thread, heap_elem);
+  next->waiting_lock = NULL;
+  lock->holder = next;
+  heap_remove (&cur->donors, &lock->donor_elem);
+  if (!heap_empty (&lock->waiters))
+    heap_push (&next->donors, &lock->donor_elem);
+  donate (next);
+  donate (cur);
+  thread_unblock (next);
+}
+
+/* Makes blocked thread T wait for LOCK, or, if LOCK is free,
+   gives it LOCK and wakes it up.  donation_lock and LOCK's
+   spinlock must be held. */
+static void
+lock_enqueue (struct lock *lock, struct thread *t) 
+{
+  if (lock->holder == NULL) 
+    {
+      lock->holder = t;
+      thread_unblock (t);
+      return;
+    }
+
+  t->waiting_lock = lock;
+  t->wait_seq = donation_seq++;
+  heap_push (&lock->waiters, &t->heap_elem);
+  if (heap_size (&lock->waiters) == 1)
+    heap_push (&lock->holder->donors, &lock->donor_elem);
+  else
+    heap_update (&lock->holder->donors, &lock->donor_elem);
+  donate (lock->holder);
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -247,23 +663,798 @@ lock_held_by_current_thread (const struct lock *lock)
 
   return lock->holder == thread_current ();
 }
-
-/* One semaphore in a list. */
-struct semaphore_elem 
+
+/* Initializes MUTEX like lock_init_named().  Use the mutex_init()
+   macro instead of calling this function directly. */
+void
+mutex_init_named (struct mutex *mutex, const char *name,
+                  const char *file, int line)
+{
+  ASSERT (mutex != NULL);
+
+  lock_init_named (&mutex->lock, name, file, line);
+  mutex->spin_acquires = 0;
+}
+
+/* Maximum number of times mutex_acquire() checks on a running
+   holder before it gives up and sleeps.  Each check takes on the
+   order of a hundred cycles. */
+#define MUTEX_SPIN_MAX 1000
+
+/* Acquires MUTEX, like lock_acquire().
+
+   A thread that finds a lock held normally goes to sleep, which
+   for a critical section a few instructions long costs far more
+   than the wait itself: two thread switches, and another CPU's
+   attention to wake it.  So, if MUTEX's holder is running on
+   another CPU, and therefore likely to release MUTEX soon, we
+   instead spin until it does, for up to MUTEX_SPIN_MAX checks.
+   If the holder is not running, it cannot release MUTEX until
+   it gets a CPU, so we sleep right away, donating our priority
+   as usual.  On a uniprocessor, the holder can never be running
+   while we are, so mutex_acquire() behaves just like
+   lock_acquire().
+
+   Spinning only reads MUTEX's holder and that thread's status.
+   Even if the holder exits meanwhile, its page stays mapped, so
+   a stale read is harmless: the worst case is a wasted spin.
+   Acquisitions that waited out a running holder this way are
+   counted in MUTEX's spin_acquires, which is updated only while
+   MUTEX is held. */
+void
+mutex_acquire (struct mutex *mutex) 
+{
+  struct lock *lock = &mutex->lock;
+  bool waited = false;
+  int spins;
+
+  ASSERT (mutex != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (!lock_held_by_current_thread (lock));
+
+  /* Check the lock order up front, since lock_try_acquire() does
+     not.  If we end up in lock_acquire(), it checks again, but
+     finds the orders already recorded. */
+  lockdep_check (lock);
+
+  for (spins = 0; spins < MUTEX_SPIN_MAX; spins++) 
+    {
+      struct thread *holder = *(struct thread *volatile *) &lock->holder;
+
+      if (holder == NULL) 
+        {
+          if (lock_try_acquire (lock)) 
+            {
+              if (waited)
+                mutex->spin_acquires++;
+              return;
+            }
+        }
+      else if (*(volatile enum thread_status *) &holder->status
+               != THREAD_RUNNING)
+        break;
+      else
+        waited = true;
+      asm volatile ("pause" : : : "memory");
+    }
+  lock_acquire (lock);
+}
+
+/* Tries to acquire MUTEX without sleeping or spinning, like
+   lock_try_acquire(). */
+bool
+mutex_try_acquire (struct mutex *mutex) 
+{
+  ASSERT (mutex != NULL);
+
+  return lock_try_acquire (&mutex->lock);
+}
+
+/* Releases MUTEX, which must be owned by the current thread,
+   like lock_release(). */
+void
+mutex_release (struct mutex *mutex) 
+{
+  ASSERT (mutex != NULL);
+
+  lock_release (&mutex->lock);
+}
+
+/* Returns true if the current thread holds MUTEX, false
+   otherwise. */
+bool
+mutex_held_by_current_thread (const struct mutex *mutex) 
+{
+  ASSERT (mutex != NULL);
+
+  return lock_held_by_current_thread (&mutex->lock);
+}
+
+/* Initializes RW as a readers-writer lock.  Any number of
+   readers may hold a readers-writer lock at once, or a single
+   writer, but not both.
+
+   Waiting writers are preferred over arriving readers: once a
+   writer is waiting, new readers queue up behind it instead of
+   joining the readers that already hold the lock, so that a
+   steady stream of readers cannot starve writers.  In turn,
+   when a writer releases the lock with readers waiting, all of
+   them are admitted together, unless fewer than RW_WRITER_RUN
+   writers have been admitted in a row since they began waiting.
+   Thus neither readers nor writers can be starved.
+
+   Among waiting writers, the one with the highest priority is
+   admitted first.  Waiting readers and writers alike donate
+   their priority to every thread holding the lock, as with
+   lock_acquire().  Like a lock, a readers-writer lock must be
+   released by the thread that acquired it, and a thread may
+   hold at most RW_HOLD_MAX readers-writer locks at once.
+
+   Like a lock's, RW's waiters, and while it has waiters, its
+   holders, are protected by donation_lock as well as by RW's
+   spinlock, so that the fast paths need only the latter. */
+void
+rw_init (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  spinlock_init (&rw->lock);
+  rw->readers = 0;
+  rw->writer = NULL;
+  list_init (&rw->holders);
+  heap_init (&rw->read_waiters, waiter_less, NULL);
+  heap_init (&rw->write_waiters, waiter_less, NULL);
+  rw->writer_run = 0;
+}
+
+/* Returns true if readers may join RW right away.  RW's
+   spinlock must be held. */
+static bool
+rw_read_ready (struct rwlock *rw) 
+{
+  return rw->writer == NULL && heap_empty (&rw->write_waiters);
+}
+
+/* Returns true if a writer may take RW right away.  RW's
+   spinlock must be held. */
+static bool
+rw_write_ready (const struct rwlock *rw) 
+{
+  return rw->writer == NULL && rw->readers == 0;
+}
+
+/* Returns true if any thread is waiting for RW.  RW's spinlock
+   must be held. */
+static bool
+rw_has_waiters (const struct rwlock *rw) 
+{
+  return !heap_empty (&rw->read_waiters) || !heap_empty (&rw->write_waiters);
+}
+
+/* Returns the priority of the highest-priority thread waiting
+   for RW, which must have waiters. */
+static int
+rw_top_priority (const struct rwlock *rw) 
+{
+  int priority = PRI_MIN;
+
+  if (!heap_empty (&rw->read_waiters))
+    priority = heap_entry (heap_top (&rw->read_waiters),
+                           struct thread, heap_elem)->priority;
+  if (!heap_empty (&rw->write_waiters)) 
+    {
+      int writer = heap_entry (heap_top (&rw->write_waiters),
+                               struct thread, heap_elem)->priority;
+      if (writer > priority)
+        priority = writer;
+    }
+  return priority;
+}
+
+/* Returns true if the lock held through A has a higher-priority
+   top waiter than the one held through B.  Orders a thread's
+   rw_donors. */
+bool
+rw_donor_less (const struct heap_elem *a_, const struct heap_elem *b_,
+               void *aux UNUSED) 
+{
+  const struct rw_hold *a = heap_entry (a_, struct rw_hold, donor_elem);
+  const struct rw_hold *b = heap_entry (b_, struct rw_hold, donor_elem);
+
+  return rw_top_priority (a->rw) > rw_top_priority (b->rw);
+}
+
+/* Records that T now holds RW.  RW's spinlock must be held, and
+   if RW has waiters, donation_lock as well, and the caller must
+   call rw_donate() afterward. */
+static void
+rw_hold_add (struct rwlock *rw, struct thread *t) 
+{
+  struct rw_hold *h;
+
+  for (h = t->rw_holds; h->rw != NULL; h++)
+    ASSERT (h + 1 < t->rw_holds + RW_HOLD_MAX);
+  h->rw = rw;
+  h->thread = t;
+  h->donating = false;
+  list_push_back (&rw->holders, &h->elem);
+}
+
+/* Records that the current thread no longer holds RW, and
+   returns true if it had been receiving donations through RW,
+   in which case the caller must call donate() on it afterward.
+   RW's spinlock must be held, and if RW has waiters,
+   donation_lock as well. */
+static bool
+rw_hold_remove (struct rwlock *rw) 
+{
+  struct thread *cur = thread_current ();
+  struct rw_hold *h;
+  bool donating;
+
+  for (h = cur->rw_holds; h->rw != rw; h++)
+    ASSERT (h + 1 < cur->rw_holds + RW_HOLD_MAX);
+  donating = h->donating;
+  if (donating)
+    heap_remove (&cur->rw_donors, &h->donor_elem);
+  list_remove (&h->elem);
+  h->rw = NULL;
+  return donating;
+}
+
+/* Brings the donations from RW's waiters to each of its holders
+   up to date, after a change in RW's waiters or holders or in a
+   waiter's priority.  donation_lock must be held, and RW's
+   spinlock too unless RW has waiters, since then its holders
+   can change only under donation_lock. */
+static void
+rw_donate (struct rwlock *rw) 
+{
+  bool waiters = rw_has_waiters (rw);
+  struct list_elem *e;
+
+  for (e = list_begin (&rw->holders); e != list_end (&rw->holders);
+       e = list_next (e)) 
+    {
+      struct rw_hold *h = list_entry (e, struct rw_hold, elem);
+      struct heap *donors = &h->thread->rw_donors;
+
+      if (waiters && h->donating)
+        heap_update (donors, &h->donor_elem);
+      else if (waiters)
+        heap_push (donors, &h->donor_elem);
+      else if (h->donating)
+        heap_remove (donors, &h->donor_elem);
+      else
+        continue;
+      h->donating = waiters;
+      donate (h->thread);
+    }
+}
+
+/* Hands RW, which must be free, to its highest-priority waiting
+   writer and wakes it up.  donation_lock and RW's spinlock must
+   be held. */
+static void
+rw_wake_writer (struct rwlock *rw) 
+{
+  struct thread *t = heap_entry (waiter_pop (&rw->write_waiters),
+                                 struct thread, heap_elem);
+
+  t->waiting_rw = NULL;
+  rw->writer = t;
+  rw_hold_add (rw, t);
+  if (!heap_empty (&rw->read_waiters))
+    rw->writer_run++;
+  else
+    rw->writer_run = 0;
+  thread_unblock (t);
+}
+
+/* Hands RW, which must be free, to all of its waiting readers
+   and wakes them up.  donation_lock and RW's spinlock must be
+   held. */
+static void
+rw_wake_readers (struct rwlock *rw) 
+{
+  while (!heap_empty (&rw->read_waiters)) 
+    {
+      struct thread *t = heap_entry (waiter_pop (&rw->read_waiters),
+                                     struct thread, heap_elem);
+
+      t->waiting_rw = NULL;
+      rw->readers++;
+      rw_hold_add (rw, t);
+      thread_unblock (t);
+    }
+  rw->writer_run = 0;
+}
+
+/* Makes the current thread wait for RW, as a writer if WRITE is
+   true or as a reader otherwise, donating its priority to RW's
+   holders, until whoever releases RW hands it over.  Interrupts
+   must be off, and donation_lock and RW's spinlock held.
+   Releases both. */
+static void
+rw_wait (struct rwlock *rw, bool write) 
+{
+  struct thread *cur = thread_current ();
+
+  cur->waiting_rw = rw;
+  cur->waiting_rw_write = write;
+  cur->wait_seq = donation_seq++;
+  heap_push (write ? &rw->write_waiters : &rw->read_waiters, &cur->heap_elem);
+  rw_donate (rw);
+  spinlock_release (&donation_lock);
+  thread_block_spin (&rw->lock, WCHAN_SEMA);
+}
+
+/* Acquires RW for reading, sleeping until no writer holds or is
+   waiting for it if necessary, and donating the current
+   thread's priority to RW's holders meanwhile.  The current
+   thread must not hold RW for writing.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rw_read_acquire (struct rwlock *rw) 
+{
+  enum intr_level old_level;
+
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (!rw_write_held_by_current_thread (rw));
+
+  /* Fast path.  If readers may join, RW has no waiters. */
+  old_level = intr_disable ();
+  spinlock_acquire (&rw->lock);
+  if (rw_read_ready (rw))
+    goto acquired;
+  spinlock_release (&rw->lock);
+
+  /* Slow path.  Take the locks in the proper order and check
+     again. */
+  spinlock_acquire (&donation_lock);
+  spinlock_acquire (&rw->lock);
+  if (rw_read_ready (rw)) 
+    {
+      spinlock_release (&donation_lock);
+      goto acquired;
+    }
+
+  /* The releasing thread counts us as a reader before it wakes
+     us up. */
+  rw_wait (rw, false);
+  intr_set_level (old_level);
+  return;
+
+ acquired:
+  rw->readers++;
+  rw_hold_add (rw, thread_current ());
+  spinlock_release (&rw->lock);
+  intr_set_level (old_level);
+}
+
+/* Tries to acquire RW for reading without sleeping.  Returns
+   true if successful, false if a writer holds or is waiting for
+   RW.
+
+   This function will not sleep, so it may be called within an
+   interrupt handler. */
+bool
+rw_read_try_acquire (struct rwlock *rw) 
+{
+  enum intr_level old_level;
+  bool success;
+
+  ASSERT (rw != NULL);
+
+  old_level = intr_disable ();
+  spinlock_acquire (&rw->lock);
+  success = rw_read_ready (rw);
+  if (success) 
+    {
+      rw->readers++;
+      rw_hold_add (rw, thread_current ());
+    }
+  spinlock_release (&rw->lock);
+  intr_set_level (old_level);
+
+  return success;
+}
+
+/* Releases RW, which the current thread must hold for reading.
+   The last reader out hands RW to a waiting writer, if any.
+   Yields if giving up the priority donated through RW leaves
+   the current thread without the highest priority. */
+void
+rw_read_release (struct rwlock *rw) 
+{
+  enum intr_level old_level;
+
+  ASSERT (rw != NULL);
+
+  /* Fast path: no waiters. */
+  old_level = intr_disable ();
+  spinlock_acquire (&rw->lock);
+  ASSERT (rw->readers > 0);
+  if (!rw_has_waiters (rw)) 
+    {
+      rw->readers--;
+      rw_hold_remove (rw);
+      spinlock_release (&rw->lock);
+      intr_set_level (old_level);
+      return;
+    }
+  spinlock_release (&rw->lock);
+
+  /* Slow path. */
+  spinlock_acquire (&donation_lock);
+  spinlock_acquire (&rw->lock);
+  if (--rw->readers == 0 && !heap_empty (&rw->write_waiters))
+    rw_wake_writer (rw);
+  if (rw_hold_remove (rw))
+    donate (thread_current ());
+  rw_donate (rw);
+  spinlock_release (&rw->lock);
+  spinlock_release (&donation_lock);
+  intr_set_level (old_level);
+
+  thread_preempt ();
+}
+
+/* Acquires RW for writing, sleeping until no other thread holds
+   it if necessary, and donating the current thread's priority
+   to RW's holders meanwhile.  The current thread must not
+   already hold RW.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rw_write_acquire (struct rwlock *rw) 
+{
+  enum intr_level old_level;
+  struct thread *cur = thread_current ();
+
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (rw->writer != cur);
+
+  /* Fast path.  If RW is free, it has no waiters. */
+  old_level = intr_disable ();
+  spinlock_acquire (&rw->lock);
+  if (rw_write_ready (rw))
+    goto acquired;
+  spinlock_release (&rw->lock);
+
+  /* Slow path. */
+  spinlock_acquire (&donation_lock);
+  spinlock_acquire (&rw->lock);
+  if (rw_write_ready (rw)) 
+    {
+      spinlock_release (&donation_lock);
+      goto acquired;
+    }
+
+  /* The releasing thread makes us the writer before it wakes us
+     up. */
+  rw_wait (rw, true);
+  intr_set_level (old_level);
+  ASSERT (rw->writer == cur);
+  return;
+
+ acquired:
+  rw->writer = cur;
+  rw_hold_add (rw, cur);
+  spinlock_release (&rw->lock);
+  intr_set_level (old_level);
+}
+
+/* Tries to acquire RW for writing without sleeping.  Returns
+   true if successful, false if another thread holds RW.
+
+   This function will not sleep, so it may be called within an
+   interrupt handler. */
+bool
+rw_write_try_acquire (struct rwlock *rw) 
+{
+  enum intr_level old_level;
+  bool success;
+
+  ASSERT (rw != NULL);
+  ASSERT (!rw_write_held_by_current_thread (rw));
+
+  old_level = intr_disable ();
+  spinlock_acquire (&rw->lock);
+  success = rw_write_ready (rw);
+  if (success) 
+    {
+      rw->writer = thread_current ();
+      rw_hold_add (rw, rw->writer);
+    }
+  spinlock_release (&rw->lock);
+  intr_set_level (old_level);
+
+  return success;
+}
+
+/* Releases RW, which the current thread must hold for writing,
+   and hands it to the next writer or to the waiting readers, as
+   described at rw_init().  Yields if giving up the priority
+   donated through RW leaves the current thread without the
+   highest priority. */
+void
+rw_write_release (struct rwlock *rw) 
+{
+  enum intr_level old_level;
+
+  ASSERT (rw != NULL);
+  ASSERT (rw_write_held_by_current_thread (rw));
+
+  /* Fast path: no waiters. */
+  old_level = intr_disable ();
+  spinlock_acquire (&rw->lock);
+  if (!rw_has_waiters (rw)) 
+    {
+      rw->writer = NULL;
+      rw_hold_remove (rw);
+      spinlock_release (&rw->lock);
+      intr_set_level (old_level);
+      return;
+    }
+  spinlock_release (&rw->lock);
+
+  /* Slow path. */
+  spinlock_acquire (&donation_lock);
+  spinlock_acquire (&rw->lock);
+  rw->writer = NULL;
+  if (!heap_empty (&rw->write_waiters)
+      && (heap_empty (&rw->read_waiters) || rw->writer_run < RW_WRITER_RUN))
+    rw_wake_writer (rw);
+  else
+    rw_wake_readers (rw);
+  if (rw_hold_remove (rw))
+    donate (thread_current ());
+  rw_donate (rw);
+  spinlock_release (&rw->lock);
+  spinlock_release (&donation_lock);
+  intr_set_level (old_level);
+
+  thread_preempt ();
+}
+
+/* Returns true if the current thread holds RW for writing, false
+   otherwise. */
+bool
+rw_write_held_by_current_thread (const struct rwlock *rw) 
+{
+  ASSERT (rw != NULL);
+
+  return rw->writer == thread_current ();
+}
+
+#ifdef LOCKSTAT
+/* Lock statistics.
+
+   Locks are grouped into classes by name, so that, for example,
+   the locks embedded in every open inode share one set of
+   counters.  This also means that statistics survive locks that
+   are freed, which would otherwise need unregistering.
+
+   Semaphores are counted the same way, each down as an
+   acquisition, which is contended if it had to wait.  A
+   semaphore has no holder, so it is never counted as held. */
+
+/* Maximum number of lock classes.  Locks whose names do not fit
+   are counted together in the last class. */
+#define LOCK_CLASS_MAX 128
+
+/* Number of lock classes printed at shutdown. */
+#define LOCKSTAT_TOP 10
+
+/* Statistics for a class of locks. */
+struct lock_class 
+  {
+    const char *name;           /* Name of the locks. */
+    struct spinlock lock;       /* Protects the counters below. */
+    long long acquisitions;     /* # of times acquired. */
+    long long contentions;      /* # of acquisitions that had to wait. */
+    int64_t wait_ticks;         /* Total timer ticks spent waiting. */
+    int64_t max_wait_ticks;     /* Longest wait, in timer ticks. */
+    int64_t hold_ticks;         /* Total timer ticks held. */
+  };
+
+bool lockstat;
+
+static struct lock_class lock_classes[LOCK_CLASS_MAX];
+static int lock_class_cnt;
+static struct spinlock lock_classes_lock;
+
+/* Returns the lock class named NAME, creating it if it does not
+   yet exist. */
+static struct lock_class *
+lock_class_lookup (const char *name) 
+{
+  enum intr_level old_level;
+  struct lock_class *c;
+
+  old_level = intr_disable ();
+  spinlock_acquire (&lock_classes_lock);
+  for (c = lock_classes; c < lock_classes + lock_class_cnt; c++)
+    if (!strcmp (c->name, name))
+      goto done;
+  if (lock_class_cnt < LOCK_CLASS_MAX) 
+    {
+      c = &lock_classes[lock_class_cnt++];
+      c->name = lock_class_cnt < LOCK_CLASS_MAX ? name : "(others)";
+      spinlock_init (&c->lock);
+    }
+  else
+    c = &lock_classes[LOCK_CLASS_MAX - 1];
+ done:
+  spinlock_release (&lock_classes_lock);
+  intr_set_level (old_level);
+  return c;
+}
+
+/* Records that the current thread acquired LOCK, after waiting
+   WAIT timer ticks for it if CONTENDED. */
+static void
+lock_stat_acquired (struct lock *lock, bool contended, int64_t wait) 
+{
+  lock->acquired = timer_ticks ();
+  lock_class_count (lock->class, contended, wait);
+}
+
+/* Counts an acquisition of a lock or semaphore of class C, after
+   waiting WAIT timer ticks for it if CONTENDED. */
+static void
+lock_class_count (struct lock_class *c, bool contended, int64_t wait) 
+{
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  spinlock_acquire (&c->lock);
+  c->acquisitions++;
+  if (contended) 
+    {
+      c->contentions++;
+      c->wait_ticks += wait;
+      if (wait > c->max_wait_ticks)
+        c->max_wait_ticks = wait;
+    }
+  spinlock_release (&c->lock);
+  intr_set_level (old_level);
+}
+
+/* Records that the current thread is about to release LOCK. */
+static void
+lock_stat_released (struct lock *lock) 
+{
+  struct lock_class *c = lock->class;
+  int64_t held = timer_elapsed (lock->acquired);
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  spinlock_acquire (&c->lock);
+  c->hold_ticks += held;
+  spinlock_release (&c->lock);
+  intr_set_level (old_level);
+}
+
+/* Returns true if lock class A was less contended than B. */
+static bool
+lock_class_less (const struct lock_class *a, const struct lock_class *b) 
+{
+  if (a->contentions != b->contentions)
+    return a->contentions < b->contentions;
+  return a->wait_ticks < b->wait_ticks;
+}
+
+/* Prints the LOCKSTAT_TOP most contended lock classes, if
+   enabled with "-o=lockstat". */
+void
+lock_print_stats (void) 
+{
+  static struct lock_class top[LOCKSTAT_TOP];
+  int top_cnt = 0;
+  int i, j;
+
+  if (!lockstat)
+    return;
+
+  /* Take a snapshot of the most contended classes first, since
+     printing acquires the console lock, which updates its own
+     class. */
+  for (i = 0; i < lock_class_cnt; i++) 
+    {
+      struct lock_class *c = &lock_classes[i];
+      struct lock_class snap;
+      enum intr_level old_level;
+
+      old_level = intr_disable ();
+      spinlock_acquire (&c->lock);
+      snap = *c;
+      spinlock_release (&c->lock);
+      intr_set_level (old_level);
+
+      /* Insertion into TOP, kept most contended first. */
+      for (j = top_cnt; j > 0 && lock_class_less (&top[j - 1], &snap); j--)
+        if (j < LOCKSTAT_TOP)
+          top[j] = top[j - 1];
+      if (j < LOCKSTAT_TOP) 
+        {
+          top[j] = snap;
+          if (top_cnt < LOCKSTAT_TOP)
+            top_cnt++;
+        }
+    }
+
+  printf ("Most contended locks and semaphores:\n");
+  printf ("%-24s %10s %10s %10s %8s %10s\n",
+          "name", "acquired", "contended", "wait", "max", "held");
+  for (i = 0; i < top_cnt; i++) 
+    printf ("%-24s %10lld %10lld %10"PRId64" %8"PRId64" %10"PRId64"\n",
+            top[i].name, top[i].acquisitions, top[i].contentions,
+            top[i].wait_ticks, top[i].max_wait_ticks, top[i].hold_ticks);
+}
+#else /* !LOCKSTAT */
+/* Lock statistics are not compiled in.  Build with "make
+   LOCKSTAT=1" to enable them. */
+void
+lock_print_stats (void) 
+{
+}
+#endif /* !LOCKSTAT */
+
+/* States of a thread waiting on a condition variable. */
+enum cond_state
   {
-    struct list_elem elem;              /* List element. */
-    struct semaphore semaphore;         /* This semaphore. */
+    COND_STARTING,              /* Not yet on the waiters list. */
+    COND_WAITING,               /* On the waiters list. */
+    COND_SIGNALED,              /* Signaled. */
+    COND_TIMED_OUT              /* Timed out. */
   };
 
+/* A thread waiting on a condition variable.  Lives on the
+   waiting thread's stack. */
+struct cond_waiter 
+  {
+    struct heap_elem elem;              /* Element in waiters heap. */
+    struct condition *cond;             /* Condition waited on. */
+    struct thread *thread;              /* Waiting thread. */
+    struct lock *lock;                  /* Lock to reacquire. */
+    enum cond_state state;              /* State of the wait. */
+    struct timeout timeout;             /* Timeout, if any. */
+  };
+
+static timeout_func cond_timeout;
+static heap_less_func cond_waiter_less;
+
 /* Initializes condition variable COND.  A condition variable
    allows one piece of code to signal a condition and cooperating
-   code to receive the signal and act upon it. */
+   code to receive the signal and act upon it.
+
+   Signaling a condition variable does not wake up the waiting
+   thread.  Since the signaling thread holds the associated lock,
+   a woken thread could not run for long before it had to wait
+   again for the lock.  Instead, the signaled thread moves
+   straight from the condition variable's waiters list to the
+   lock's, as if it had tried to acquire the lock, and wakes up
+   when the lock is handed to it.  This "wait morphing" saves a
+   pair of thread switches for every waiter woken by
+   cond_broadcast().
+
+   COND's waiters are kept in a heap ordered by priority, like a
+   lock's, and are protected by the spinlock of the lock
+   associated with COND, along with donation_lock, so that a
+   waiter can move between the two heaps atomically. */
 void
 cond_init (struct condition *cond)
 {
   ASSERT (cond != NULL);
 
-  list_init (&cond->waiters);
+  heap_init (&cond->waiters, cond_waiter_less, NULL);
 }
 
 /* Atomically releases LOCK and waits for COND to be signaled by
@@ -289,42 +1480,187 @@ cond_init (struct condition *cond)
 void
 cond_wait (struct condition *cond, struct lock *lock) 
 {
-  struct semaphore_elem waiter;
+  cond_wait_timeout (cond, lock, INT64_MAX);
+}
+
+/* Like cond_wait(), but gives up waiting once approximately
+   TICKS timer ticks have passed without COND being signaled.
+   Either way, LOCK is reacquired before returning.  Returns true
+   if COND was signaled, false if the wait timed out.  If TICKS
+   is not positive, returns false at once without releasing
+   LOCK. */
+bool
+cond_wait_timeout (struct condition *cond, struct lock *lock, int64_t ticks) 
+{
+  struct cond_waiter w;
+  enum intr_level old_level;
 
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (lock_held_by_current_thread (lock));
-  
-  sema_init (&waiter.semaphore, 0);
-  list_push_back (&cond->waiters, &waiter.elem);
-  lock_release (lock);
-  sema_down (&waiter.semaphore);
-  lock_acquire (lock);
+
+  if (ticks <= 0)
+    return false;
+
+  w.cond = cond;
+  w.thread = thread_current ();
+  w.lock = lock;
+  w.state = COND_STARTING;
+  if (ticks != INT64_MAX)
+    timer_timeout_add (&w.timeout, ticks, cond_timeout, &w);
+
+  /* We will have to reacquire LOCK while holding whatever other
+     locks we hold now. */
+  lockdep_released (lock);
+  lockdep_check (lock);
+
+  old_level = intr_disable ();
+#ifdef LOCKSTAT
+  lock_stat_released (lock);
+#endif
+  spinlock_acquire (&donation_lock);
+  spinlock_acquire (&lock->spin);
+  if (w.state == COND_STARTING) 
+    {
+      /* Release LOCK and sleep until whoever takes us off COND's
+         waiters list hands LOCK back to us. */
+      w.state = COND_WAITING;
+      w.thread->waiting_cond = &w;
+      w.thread->wait_seq = donation_seq++;
+      heap_push (&cond->waiters, &w.elem);
+      lock_hand_off (lock);
+      spinlock_release (&donation_lock);
+      thread_block_spin (&lock->spin, WCHAN_SEMA);
+    }
+  else 
+    {
+      /* Timed out already.  Keep LOCK. */
+      spinlock_release (&lock->spin);
+      spinlock_release (&donation_lock);
+    }
+  intr_set_level (old_level);
+  ASSERT (lock->holder == w.thread);
+  lockdep_acquired (lock);
+#ifdef LOCKSTAT
+  lock_stat_acquired (lock, false, 0);
+#endif
+
+  if (ticks != INT64_MAX)
+    timer_timeout_cancel (&w.timeout);
+  return w.state == COND_SIGNALED;
+}
+
+/* Timeout function for cond_wait_timeout().  If waiter W_ is
+   still waiting, takes it off the waiters list and has it
+   reacquire its lock. */
+static void
+cond_timeout (void *w_) 
+{
+  struct cond_waiter *w = w_;
+
+  spinlock_acquire (&donation_lock);
+  spinlock_acquire (&w->lock->spin);
+  if (w->state == COND_WAITING) 
+    {
+      heap_remove (&w->cond->waiters, &w->elem);
+      w->thread->waiting_cond = NULL;
+      lock_enqueue (w->lock, w->thread);
+    }
+  if (w->state != COND_SIGNALED)
+    w->state = COND_TIMED_OUT;
+  spinlock_release (&w->lock->spin);
+  spinlock_release (&donation_lock);
+}
+
+/* Returns true if waiter A should be signaled before waiter
+   B. */
+static bool
+cond_waiter_less (const struct heap_elem *a_, const struct heap_elem *b_,
+                  void *aux UNUSED) 
+{
+  const struct cond_waiter *a = heap_entry (a_, struct cond_waiter, elem);
+  const struct cond_waiter *b = heap_entry (b_, struct cond_waiter, elem);
+
+  return waiter_less (&a->thread->heap_elem, &b->thread->heap_elem, NULL);
+}
+
+/* Moves the highest-priority thread waiting on COND to LOCK's
+   waiters.  COND must have waiters.  donation_lock and LOCK's
+   spinlock must be held. */
+static void
+cond_morph (struct condition *cond, struct lock *lock) 
+{
+  struct cond_waiter *w = heap_entry (waiter_pop (&cond->waiters),
+                                      struct cond_waiter, elem);
+
+  ASSERT (w->lock == lock);
+
+  w->thread->waiting_cond = NULL;
+  w->state = COND_SIGNALED;
+  lock_enqueue (lock, w->thread);
+}
+
+/* Moves T, a blocked thread whose priority has just changed, to
+   its new place among the waiters of the semaphore or condition
+   variable that it is waiting on, if any.  donation_lock must be
+   held.
+
+   A condition's waiters are protected by donation_lock itself.
+   A semaphore's are protected only by its own spinlock, which
+   sema_up() holds while it takes a waiter off and clears its
+   waiting_sema, so we must check waiting_sema again once we hold
+   it.  The semaphore cannot be freed in the meantime, because
+   the woken thread calls sema_wait_done(), which waits for
+   donation_lock, before it returns from sema_down(). */
+static void
+requeue_waiter (struct thread *t) 
+{
+  struct semaphore *sema = t->waiting_sema;
+
+  if (t->waiting_cond != NULL)
+    heap_update (&t->waiting_cond->cond->waiters, &t->waiting_cond->elem);
+  else if (sema != NULL) 
+    {
+      spinlock_acquire (&sema->lock);
+      if (t->waiting_sema == sema)
+        heap_update (&sema->waiters, &t->heap_elem);
+      spinlock_release (&sema->lock);
+    }
 }
 
 /* If any threads are waiting on COND (protected by LOCK), then
-   this function signals one of them to wake up from its wait.
-   LOCK must be held before calling this function.
+   this function signals the one with the highest priority.  It
+   will wake up once it has reacquired LOCK.  LOCK must be held
+   before calling this function.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to signal a condition variable within an
    interrupt handler. */
 void
-cond_signal (struct condition *cond, struct lock *lock UNUSED) 
+cond_signal (struct condition *cond, struct lock *lock) 
 {
+  enum intr_level old_level;
+
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (lock_held_by_current_thread (lock));
 
-  if (!list_empty (&cond->waiters)) 
-    sema_up (&list_entry (list_pop_front (&cond->waiters),
-                          struct semaphore_elem, elem)->semaphore);
+  old_level = intr_disable ();
+  spinlock_acquire (&donation_lock);
+  spinlock_acquire (&lock->spin);
+  if (!heap_empty (&cond->waiters))
+    cond_morph (cond, lock);
+  spinlock_release (&lock->spin);
+  spinlock_release (&donation_lock);
+  intr_set_level (old_level);
 }
 
-/* Wakes up all threads, if any, waiting on COND (protected by
-   LOCK).  LOCK must be held before calling this function.
+/* Signals all threads, if any, waiting on COND (protected by
+   LOCK).  They will wake up one at a time, in order of priority,
+   as LOCK is handed from one to the next.  LOCK must be held
+   before calling this function.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to signal a condition variable within an
@@ -332,9 +1668,19 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED)
 void
 cond_broadcast (struct condition *cond, struct lock *lock) 
 {
+  enum intr_level old_level;
+
   ASSERT (cond != NULL);
   ASSERT (lock != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (lock_held_by_current_thread (lock));
 
-  while (!list_empty (&cond->waiters))
-    cond_signal (cond, lock);
+  old_level = intr_disable ();
+  spinlock_acquire (&donation_lock);
+  spinlock_acquire (&lock->spin);
+  while (!heap_empty (&cond->waiters))
+    cond_morph (cond, lock);
+  spinlock_release (&lock->spin);
+  spinlock_release (&donation_lock);
+  intr_set_level (old_level);
 }
@@ -1,17 +1,32 @@
 #ifndef THREADS_SYNCH_H
 #define THREADS_SYNCH_H
 
+#include <debug.h>
+#include <heap.h>
 #include <list.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include "threads/interrupt.h"
+#include "threads/spinlock.h"
 
 /* A counting semaphore. */
 struct semaphore 
   {
     unsigned value;             /* Current value. */
-    struct list waiters;        /* List of waiting threads. */
+    struct heap waiters;        /* Waiting threads, by priority. */
+    unsigned seq;               /* Arrival counter for waiters. */
+    struct spinlock lock;       /* Protects the members above. */
+#ifdef LOCKSTAT
+    struct lock_class *class;   /* Statistics, shared by same-named ones. */
+#endif
   };
 
-void sema_init (struct semaphore *, unsigned value);
+/* Initializes SEMA to VALUE, naming it after the expression that
+   denotes it, e.g. "&done", for lock statistics. */
+#define sema_init(SEMA, VALUE) sema_init_named (SEMA, VALUE, #SEMA)
+
+void sema_init_named (struct semaphore *, unsigned value,
+                      const char *name);
 void sema_down (struct semaphore *);
 bool sema_try_down (struct semaphore *);
 void sema_up (struct semaphore *);
@@ -20,24 +35,115 @@ void sema_self_test (void);
 /* Lock. */
 struct lock 
   {
-    struct thread *holder;      /* Thread holding lock (for debugging). */
-    struct semaphore semaphore; /* Binary semaphore controlling access. */
+    struct thread *holder;      /* Thread holding lock, if any. */
+    struct spinlock spin;       /* Protects holder and waiters. */
+    struct heap waiters;        /* Waiting threads, by priority. */
+    struct heap_elem donor_elem; /* In holder's donors, if waited for. */
+#ifdef LOCKDEP
+    struct lockdep_class *dep_class; /* Class for order validation. */
+#endif
+#ifdef LOCKSTAT
+    struct lock_class *class;   /* Statistics, shared by same-named locks. */
+    int64_t acquired;           /* Time of last acquisition. */
+#endif
   };
 
-void lock_init (struct lock *);
+/* Initializes LOCK, naming it after the expression that denotes
+   it, e.g. "&filesys_lock", for lock statistics, and recording
+   where it was initialized for the lock order validator. */
+#define lock_init(LOCK) lock_init_named (LOCK, #LOCK, __FILE__, __LINE__)
+
+void lock_init_named (struct lock *, const char *name,
+                      const char *file, int line);
 void lock_acquire (struct lock *);
 bool lock_try_acquire (struct lock *);
 void lock_release (struct lock *);
 bool lock_held_by_current_thread (const struct lock *);
+void lock_update_priority (struct thread *);
+bool lock_donor_less (const struct heap_elem *, const struct heap_elem *,
+                      void *aux);
+void lock_print_stats (void);
+
+#ifdef LOCKSTAT
+/* If true, print the most contended locks at shutdown.
+   Controlled by kernel command-line option "-o=lockstat". */
+extern bool lockstat;
+#endif
+
+/* Adaptive mutex: a lock that spins for a while, instead of
+   sleeping, while its holder is running on another CPU. */
+struct mutex 
+  {
+    struct lock lock;           /* Underlying lock. */
+    unsigned spin_acquires;     /* Times acquired after spinning. */
+  };
+
+/* Initializes MUTEX, naming it like lock_init(). */
+#define mutex_init(MUTEX) \
+        mutex_init_named (MUTEX, #MUTEX, __FILE__, __LINE__)
+
+void mutex_init_named (struct mutex *, const char *name,
+                       const char *file, int line);
+void mutex_acquire (struct mutex *);
+bool mutex_try_acquire (struct mutex *);
+void mutex_release (struct mutex *);
+bool mutex_held_by_current_thread (const struct mutex *);
+
+/* Readers-writer lock. */
+struct rwlock 
+  {
+    struct spinlock lock;       /* Protects the members below. */
+    int readers;                /* Number of readers holding the lock. */
+    struct thread *writer;      /* Writer holding the lock, if any. */
+    struct list holders;        /* Holds of all threads holding it. */
+    struct heap read_waiters;   /* Readers waiting, by priority. */
+    struct heap write_waiters;  /* Writers waiting, by priority. */
+    int writer_run;             /* Writers admitted in a row while
+                                   readers waited. */
+  };
+
+/* One thread's hold on a readers-writer lock, for reading or
+   writing.  Each thread has RW_HOLD_MAX of these, so that the
+   lock's waiters can donate their priority to every thread
+   holding it. */
+struct rw_hold 
+  {
+    struct rwlock *rw;          /* Lock held, or null if unused. */
+    struct thread *thread;      /* Thread holding RW. */
+    struct list_elem elem;      /* In RW's holders. */
+    struct heap_elem donor_elem; /* In THREAD's rw_donors, if DONATING. */
+    bool donating;              /* Does RW have waiters? */
+  };
+
+/* Maximum number of readers-writer locks that one thread may
+   hold at once. */
+#define RW_HOLD_MAX 4
+
+/* Maximum number of writers admitted in a row while readers are
+   waiting, which bounds how long a steady stream of writers can
+   starve readers. */
+#define RW_WRITER_RUN 4
+
+void rw_init (struct rwlock *);
+void rw_read_acquire (struct rwlock *);
+bool rw_read_try_acquire (struct rwlock *);
+void rw_read_release (struct rwlock *);
+void rw_write_acquire (struct rwlock *);
+bool rw_write_try_acquire (struct rwlock *);
+void rw_write_release (struct rwlock *);
+bool rw_write_held_by_current_thread (const struct rwlock *);
+bool rw_donor_less (const struct heap_elem *, const struct heap_elem *,
+                    void *aux);
 
 /* Condition variable. */
 struct condition 
   {
-    struct list waiters;        /* List of waiting threads. */
+    struct heap waiters;        /* Waiters, by priority. */
   };
 
 void cond_init (struct condition *);
 void cond_wait (struct condition *, struct lock *);
+bool cond_wait_timeout (struct condition *, struct lock *, int64_t ticks);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
@@ -48,4 +154,91 @@ void cond_broadcast (struct condition *, struct lock *);
    reference guide for more information.*/
 #define barrier() asm volatile ("" : : : "memory")
 
+/* Sequence lock.
+
+   A seqlock protects a small amount of data, such as a 64-bit
+   counter, that is read much more often than it is written.
+   Readers do not write shared memory at all, so they never
+   contend with each other, and they never wait for a writer to
+   finish: instead, a reader that overlaps a write notices
+   afterward and retries.  Thus:
+
+        unsigned seq;
+        do
+          {
+            seq = seqlock_read_begin (&sl);
+            ...copy the protected data...
+          }
+        while (seqlock_read_retry (&sl, seq));
+
+   SEQ is odd while a write is in progress, and a reader that
+   begins then spins until it is even again.  Writers serialize
+   among themselves with LOCK and must have interrupts off, which
+   is what makes it safe to read from an interrupt handler: a
+   handler that interrupted a writer on the same CPU would spin
+   forever waiting for it.
+
+   On x86, loads are not reordered with other loads, nor stores
+   with other stores, so compiler barriers order the accesses to
+   SEQ and to the data.  See [IA32-v3a] 8.2.2 "Memory Ordering
+   in P6 and More Recent Processor Families". */
+struct seqlock
+  {
+    volatile unsigned seq;      /* Odd while being written. */
+    struct spinlock lock;       /* Serializes writers. */
+  };
+
+/* Initializes SL. */
+static inline void
+seqlock_init (struct seqlock *sl)
+{
+  sl->seq = 0;
+  spinlock_init (&sl->lock);
+}
+
+/* Begins a read of the data protected by SL and returns the
+   value to pass to seqlock_read_retry() afterward. */
+static inline unsigned
+seqlock_read_begin (const struct seqlock *sl)
+{
+  unsigned seq;
+
+  while ((seq = sl->seq) & 1)
+    asm volatile ("pause" : : : "memory");
+  barrier ();
+  return seq;
+}
+
+/* Returns true if the data protected by SL may have changed
+   since the call to seqlock_read_begin() that returned SEQ, in
+   which case the caller must read it again. */
+static inline bool
+seqlock_read_retry (const struct seqlock *sl, unsigned seq)
+{
+  barrier ();
+  return sl->seq != seq;
+}
+
+/* Begins updating the data protected by SL.  Interrupts must be
+   off, so that no reader on this CPU can interrupt the write and
+   then spin waiting for it to finish. */
+static inline void
+seqlock_write_begin (struct seqlock *sl)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  spinlock_acquire (&sl->lock);
+  sl->seq++;
+  barrier ();
+}
+
+/* Finishes updating the data protected by SL. */
+static inline void
+seqlock_write_end (struct seqlock *sl)
+{
+  barrier ();
+  sl->seq++;
+  spinlock_release (&sl->lock);
+}
+
 #endif /* threads/synch.h */
@@ -4,13 +4,17 @@
 #include <random.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/cpu.h"
 #include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
 #include "threads/palloc.h"
+#include "threads/rcu.h"
+#include "threads/spinlock.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
+#include "devices/timer.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #endif
@@ -24,12 +28,54 @@
    Do not modify this value. */
 #define THREAD_BASIC 0xd42df210
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
-
-/* Idle thread. */
-static struct thread *idle_thread;
+/* Scheduling on multiple CPUs.
+
+   Each CPU has its own run queue of threads in THREAD_READY
+   state, that is, threads that are ready to run on that CPU but
+   not actually running (see struct run_queue in cpu.h).  A
+   thread's `cpu' member names the CPU it is running on, is
+   queued on, or last ran on, and a thread that wakes up goes
+   back on that CPU's run queue.  A thread's status and its
+   place on a run queue may only change while holding that run
+   queue's lock, with interrupts off.
+
+   A CPU that runs out of ready threads steals half of the ready
+   threads of the CPU with the most, so that work does not pile
+   up on one CPU while others idle.  See steal_threads().
+
+   When a thread blocks or yields, it holds its CPU's run queue
+   lock across the switch to the next thread, which releases it
+   in schedule_tail().  That way, no other CPU can pick up or
+   wake up a thread until it has completely stopped running.
+
+   Spinlocks must always be acquired in this order: a wait-list
+   lock such as a semaphore's, then all_lock, then a run queue
+   lock.  At most one run queue lock may be held at a time. */
+
+/* Earliest-deadline-first scheduling.
+
+   Threads created with thread_create_deadline() form a
+   real-time class above all the priorities: any such "EDF"
+   thread that is ready outranks every other thread, and among
+   them the one with the earliest deadline runs first.  An EDF
+   thread gets BUDGET ticks of CPU time in each PERIOD, which
+   must be used by DEADLINE ticks into the period.  Once it has
+   used its budget, or given up the rest of it with
+   thread_yield_period(), it is throttled: it waits on its
+   CPU's edf_waiting list until its next period starts.
+
+   Admission control reserves a share of one CPU for each EDF
+   thread, which then stays on that CPU.  No more than
+   EDF_UTIL_MAX of a CPU may be reserved, so the budgets
+   guarantee the rest of the system the remainder. */
+#define EDF_UTIL_MAX 900        /* Max EDF share of a CPU, in 0.1%. */
+static struct spinlock edf_lock; /* Protects each CPU's edf_util. */
+
+/* List of all processes.  Processes are added to this list
+   when they are created and removed when they exit.  Protected
+   by all_lock. */
+static struct list all_list;
+static struct spinlock all_lock;
 
 /* Initial thread, the thread running init.c:main(). */
 static struct thread *initial_thread;
@@ -45,38 +91,80 @@ struct kernel_thread_frame
     void *aux;                  /* Auxiliary data for function. */
   };
 
-/* Statistics. */
-static long long idle_ticks;    /* # of timer ticks spent idle. */
-static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
-static long long user_ticks;    /* # of timer ticks in user programs. */
-
 /* Scheduling. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
-static unsigned thread_ticks;   /* # of timer ticks since last yield. */
 
 /* If false (default), use round-robin scheduler.
    If true, use multi-level feedback queue scheduler.
-   Controlled by kernel command-line option "-o mlfqs". */
+   Controlled by kernel command-line option "-mlfqs". */
 bool thread_mlfqs;
 
+/* If true, print per-thread scheduler statistics.
+   Controlled by kernel command-line option "-o=schedstat". */
+bool thread_schedstat;
+
+/* If true, use the stride scheduler.
+   Controlled by kernel command-line option "-stride". */
+bool thread_stride;
+
+/* Stride scheduler.  A thread's stride is STRIDE1 divided by its
+   tickets. */
+#define STRIDE1 (1 << 20)
+
+/* Multi-level feedback queue scheduler. */
+#define MLFQS_PRI_TICKS 4       /* # of ticks between priority updates. */
+static fixed_point_t load_avg;  /* System load average. */
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
+static void idle_loop (void) NO_RETURN;
 static struct thread *running_thread (void);
-static struct thread *next_thread_to_run (void);
+static struct thread *next_thread_to_run (struct cpu *);
+static void steal_threads (struct cpu *);
+static struct run_queue *lock_thread_rq (struct thread *);
 static void init_thread (struct thread *, const char *name, int priority);
 static bool is_thread (struct thread *) UNUSED;
+static bool is_idle (struct thread *);
 static void *alloc_frame (struct thread *, size_t size);
+static struct cpu *select_cpu (void);
 static void schedule (void);
 void schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
+static void rq_init (struct run_queue *);
+static void rq_push (struct run_queue *, struct thread *);
+static void rq_remove (struct run_queue *, struct thread *);
+static struct thread *rq_pop (struct run_queue *);
+static int rq_max_priority (const struct run_queue *);
+static bool rq_empty (struct run_queue *);
+static void mlfqs_tick (struct cpu *, struct thread *);
+static void mlfqs_update_second (void);
+static tid_t create_thread (const char *name, int priority,
+                            thread_func *, void *aux,
+                            int period, int budget, int deadline);
+static int edf_util (int period, int budget, int deadline);
+static struct cpu *edf_admit (int util);
+static void edf_unreserve (struct cpu *, int util);
+static void edf_push (struct run_queue *, struct thread *, int64_t now);
+static void edf_release (struct run_queue *, int64_t now);
+static bool outranks (const struct thread *, const struct thread *);
+static bool rq_preempts (struct run_queue *, const struct thread *);
+static void stride_join (struct run_queue *, struct thread *);
+static void stride_leave (struct run_queue *, struct thread *);
+static void stride_steal (struct cpu *thief, struct cpu *victim);
+static bool pass_less (const struct heap_elem *, const struct heap_elem *,
+                       void *aux);
+static void read_schedstat (struct thread *, struct schedstat *);
+static void print_schedstat (tid_t, const char *name,
+                             const struct schedstat *);
+static void mlfqs_update_priority (struct thread *);
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
    general and it is possible in this case only because loader.S
    was careful to put the bottom of the stack at a page boundary.
 
-   Also initializes the run queue and the tid lock.
+   Also initializes the run queues and the tid lock.
 
    After calling this function, be sure to initialize the page
    allocator before trying to create any threads with
@@ -87,20 +175,32 @@ static tid_t allocate_tid (void);
 void
 thread_init (void) 
 {
+  int i;
+
   ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (offsetof (struct thread, stack) == SWITCH_STACK_OFS);
 
   lock_init (&tid_lock);
-  list_init (&ready_list);
+  for (i = 0; i < CPU_MAX; i++)
+    rq_init (&cpus[i].rq);
+  list_init (&all_list);
+  spinlock_init (&all_lock);
+  spinlock_init (&edf_lock);
 
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread ();
   init_thread (initial_thread, "main", PRI_DEFAULT);
+  initial_thread->cpu = &cpus[0];
+  cpus[0].curr = initial_thread;
   initial_thread->status = THREAD_RUNNING;
   initial_thread->tid = allocate_tid ();
+  if (thread_mlfqs)
+    mlfqs_update_priority (initial_thread);
+  stride_join (&cpus[0].rq, initial_thread);
 }
 
 /* Starts preemptive thread scheduling by enabling interrupts.
-   Also creates the idle thread. */
+   Also creates the bootstrap processor's idle thread. */
 void
 thread_start (void) 
 {
@@ -116,34 +216,223 @@ thread_start (void)
   sema_down (&idle_started);
 }
 
+/* Allocates the idle thread for application processor C, which
+   is also the thread that C runs when it first starts up, so
+   that it begins in the RUNNING state.  Returns the new thread,
+   or a null pointer if memory is exhausted. */
+struct thread *
+thread_create_idle (struct cpu *c) 
+{
+  struct thread *t;
+  char name[16];
+
+  ASSERT (c != cpu_current ());
+
+  t = palloc_get_page (PAL_ZERO);
+  if (t == NULL)
+    return NULL;
+
+  snprintf (name, sizeof name, "idle%d", c->id);
+  init_thread (t, name, PRI_MIN);
+  t->tid = allocate_tid ();
+  t->cpu = c;
+  t->status = THREAD_RUNNING;
+  c->idle_thread = c->curr = t;
+  return t;
+}
+
+/* Starts scheduling threads on an application processor.
+   Called on the processor's idle thread, with interrupts off,
+   once the processor is otherwise ready to go. */
+void
+thread_start_ap (void) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (is_idle (thread_current ()));
+
+  idle_loop ();
+}
+
 /* Called by the timer interrupt handler at each timer tick.
    Thus, this function runs in an external interrupt context. */
 void
 thread_tick (void) 
 {
   struct thread *t = thread_current ();
+  struct cpu *c = t->cpu;
 
   /* Update statistics. */
-  if (t == idle_thread)
-    idle_ticks++;
+  seqlock_write_begin (&t->stat_seq);
+  t->stat.run_ticks++;
+  seqlock_write_end (&t->stat_seq);
+  if (t == c->idle_thread)
+    c->idle_ticks++;
 #ifdef USERPROG
   else if (t->pagedir != NULL)
-    user_ticks++;
+    c->user_ticks++;
 #endif
   else
-    kernel_ticks++;
+    c->kernel_ticks++;
+
+  /* The interrupted code had interrupts on, so it was not
+     inside an RCU read-side critical section. */
+  rcu_quiescent ();
+
+  if (thread_mlfqs)
+    mlfqs_tick (c, t);
+
+  /* Charge the running thread's stride and advance the global
+     pass in step. */
+  if (t->stride_counted) 
+    {
+      spinlock_acquire (&c->rq.lock);
+      t->pass += STRIDE1 / t->tickets;
+      c->rq.pass += STRIDE1 / c->rq.tickets;
+      spinlock_release (&c->rq.lock);
+    }
+
+  /* Enforce EDF budget.  Start new EDF periods, and switch to
+     an EDF thread that is now ready or that another thread woke
+     up since the last tick. */
+  if (t->edf_period != 0 && --t->edf_left <= 0)
+    intr_yield_on_return ();
+  if (!list_empty (&c->rq.edf) || !list_empty (&c->rq.edf_waiting)) 
+    {
+      bool preempt;
+
+      spinlock_acquire (&c->rq.lock);
+      edf_release (&c->rq, timer_ticks ());
+      preempt = rq_preempts (&c->rq, t);
+      spinlock_release (&c->rq.lock);
+      if (preempt)
+        intr_yield_on_return ();
+    }
 
   /* Enforce preemption. */
-  if (++thread_ticks >= TIME_SLICE)
+  if (++c->thread_ticks >= TIME_SLICE)
     intr_yield_on_return ();
 }
 
-/* Prints thread statistics. */
+/* Prints thread statistics, totalled over all CPUs and then,
+   if there is more than one, for each CPU. */
 void
 thread_print_stats (void) 
 {
+  long long idle_ticks = 0, kernel_ticks = 0, user_ticks = 0;
+  long long steals = 0;
+  int i;
+
+  for (i = 0; i < cpu_cnt; i++) 
+    {
+      idle_ticks += cpus[i].idle_ticks;
+      kernel_ticks += cpus[i].kernel_ticks;
+      user_ticks += cpus[i].user_ticks;
+      steals += cpus[i].steals;
+    }
   printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
           idle_ticks, kernel_ticks, user_ticks);
+  if (cpu_cnt == 1)
+    return;
+
+  printf ("Thread: %lld threads migrated between CPUs\n", steals);
+  for (i = 0; i < cpu_cnt; i++) 
+    {
+      struct cpu *c = &cpus[i];
+      long long busy = c->kernel_ticks + c->user_ticks;
+      long long total = busy + c->idle_ticks;
+
+      printf ("Thread: CPU %d: %lld idle ticks, %lld kernel ticks, "
+              "%lld user ticks, %lld%% busy, %lld threads stolen\n",
+              i, c->idle_ticks, c->kernel_ticks, c->user_ticks,
+              total > 0 ? busy * 100 / total : 0, c->steals);
+    }
+}
+
+/* Prints the scheduler statistics of every thread that still
+   exists, in order of tid, if enabled with "-o=schedstat".
+
+   printf() may sleep, so we cannot print while holding all_lock.
+   Instead, we copy out one thread's statistics at a time, each
+   time looking for the thread with the next higher tid. */
+void
+thread_print_schedstats (void) 
+{
+  tid_t last = TID_ERROR;
+
+  if (!thread_schedstat)
+    return;
+
+  for (;;) 
+    {
+      struct thread *next = NULL;
+      struct schedstat stat;
+      char name[sizeof next->name];
+      tid_t tid;
+      enum intr_level old_level;
+      struct list_elem *e;
+
+      old_level = intr_disable ();
+      spinlock_acquire (&all_lock);
+      for (e = list_begin (&all_list); e != list_end (&all_list);
+           e = list_next (e)) 
+        {
+          struct thread *t = list_entry (e, struct thread, allelem);
+          if (t->tid > last && (next == NULL || t->tid < next->tid))
+            next = t;
+        }
+      if (next != NULL) 
+        {
+          tid = next->tid;
+          strlcpy (name, next->name, sizeof name);
+          read_schedstat (next, &stat);
+        }
+      spinlock_release (&all_lock);
+      intr_set_level (old_level);
+
+      if (next == NULL)
+        break;
+      print_schedstat (tid, name, &stat);
+      last = tid;
+    }
+}
+
+/* Stores the running thread's scheduler statistics in *STAT. */
+void
+thread_get_schedstat (struct schedstat *stat) 
+{
+  read_schedstat (thread_current (), stat);
+}
+
+/* Copies T's scheduler statistics into *STAT.  They may be
+   updated concurrently, by T's CPU or by a CPU waking T up, so
+   we retry until we get a consistent copy. */
+static void
+read_schedstat (struct thread *t, struct schedstat *stat) 
+{
+  unsigned seq;
+
+  do
+    {
+      seq = seqlock_read_begin (&t->stat_seq);
+      *stat = t->stat;
+    }
+  while (seqlock_read_retry (&t->stat_seq, seq));
+}
+
+/* Prints scheduler statistics STAT for the thread with the given
+   TID and NAME. */
+static void
+print_schedstat (tid_t tid, const char *name, const struct schedstat *stat) 
+{
+  printf ("Schedstat: tid %d (%s): %lld run, %lld ready, "
+          "%lld blocked (%lld sema, %lld sleep, %lld io, %lld other) "
+          "ticks; %u voluntary, %u involuntary switches\n",
+          tid, name, stat->run_ticks, stat->ready_ticks,
+          stat->blocked_ticks[WCHAN_SEMA] + stat->blocked_ticks[WCHAN_SLEEP]
+          + stat->blocked_ticks[WCHAN_IO] + stat->blocked_ticks[WCHAN_OTHER],
+          stat->blocked_ticks[WCHAN_SEMA], stat->blocked_ticks[WCHAN_SLEEP],
+          stat->blocked_ticks[WCHAN_IO], stat->blocked_ticks[WCHAN_OTHER],
+          stat->voluntary_switches, stat->involuntary_switches);
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -158,29 +447,101 @@ thread_print_stats (void)
    scheduled.  Use a semaphore or some other form of
    synchronization if you need to ensure ordering.
 
-   The code provided sets the new thread's `priority' member to
-   PRIORITY, but no actual priority scheduling is implemented.
-   Priority scheduling is the goal of Problem 1-3. */
+   The new thread is queued on the CPU with the fewest threads
+   ready to run.  If that is the running CPU and the new thread
+   has a higher priority than the running thread, the running
+   thread yields to it before returning.
+   With the multi-level feedback queue scheduler, PRIORITY is
+   ignored: the new thread inherits the running thread's nice
+   and recent_cpu values and its priority is computed from
+   them. */
 tid_t
 thread_create (const char *name, int priority,
                thread_func *function, void *aux) 
+{
+  return create_thread (name, priority, function, aux, 0, 0, 0);
+}
+
+/* Creates a new kernel thread named NAME in the
+   earliest-deadline-first class, which executes FUNCTION passing
+   AUX as the argument.  In every PERIOD timer ticks, the thread
+   may run for up to BUDGET ticks, and should have done so by
+   DEADLINE ticks into the period.  The new thread outranks
+   every thread that is not in the EDF class.
+
+   Returns the new thread's identifier, or TID_ERROR if creation
+   fails, including if no CPU has enough unreserved time left to
+   admit the thread.  See the comment on EDF scheduling at the
+   top of this file. */
+tid_t
+thread_create_deadline (const char *name, int period, int budget,
+                        int deadline, thread_func *function, void *aux) 
+{
+  ASSERT (0 < budget && budget <= deadline && deadline <= period);
+
+  return create_thread (name, PRI_MAX, function, aux,
+                        period, budget, deadline);
+}
+
+/* Does the work of thread_create() and thread_create_deadline().
+   PERIOD is 0 for a thread outside the EDF class. */
+static tid_t
+create_thread (const char *name, int priority, thread_func *function,
+               void *aux, int period, int budget, int deadline) 
 {
   struct thread *t;
   struct kernel_thread_frame *kf;
   struct switch_entry_frame *ef;
   struct switch_threads_frame *sf;
+  struct cpu *c = NULL;
+  int util = 0;
   tid_t tid;
 
   ASSERT (function != NULL);
 
+  /* Admit EDF thread. */
+  if (period != 0) 
+    {
+      util = edf_util (period, budget, deadline);
+      c = edf_admit (util);
+      if (c == NULL)
+        return TID_ERROR;
+    }
+
   /* Allocate thread. */
   t = palloc_get_page (PAL_ZERO);
-  if (t == NULL)
-    return TID_ERROR;
+  if (t == NULL) 
+    {
+      if (c != NULL)
+        edf_unreserve (c, util);
+      return TID_ERROR;
+    }
 
   /* Initialize thread. */
   init_thread (t, name, priority);
   tid = t->tid = allocate_tid ();
+  if (period != 0) 
+    {
+      t->cpu = c;
+      t->edf_period = period;
+      t->edf_budget = t->edf_left = budget;
+      t->edf_rel_deadline = deadline;
+      t->edf_release = timer_ticks ();
+      t->edf_deadline = t->edf_release + deadline;
+    }
+  else 
+    {
+      t->cpu = select_cpu ();
+      t->tickets = thread_current ()->tickets;
+      t->remain = STRIDE1 / t->tickets;
+      if (thread_mlfqs) 
+        {
+          struct thread *curr = thread_current ();
+          t->nice = curr->nice;
+          t->recent_cpu = curr->recent_cpu;
+          mlfqs_update_priority (t);
+        }
+    }
 
   /* Stack frame for kernel_thread(). */
   kf = alloc_frame (t, sizeof *kf);
@@ -198,6 +559,7 @@ thread_create (const char *name, int priority,
 
   /* Add to run queue. */
   thread_unblock (t);
+  thread_preempt ();
 
   return tid;
 }
@@ -211,32 +573,86 @@ thread_create (const char *name, int priority,
 void
 thread_block (void) 
 {
+  struct thread *curr = thread_current ();
+
+  ASSERT (!intr_context ());
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  spinlock_acquire (&curr->cpu->rq.lock);
+  curr->status = THREAD_BLOCKED;
+  curr->wchan = WCHAN_OTHER;
+  stride_leave (&curr->cpu->rq, curr);
+  schedule ();
+}
+
+/* Puts the current thread to sleep, like thread_block(), and
+   releases LOCK, which the caller holds, once the thread is
+   marked as blocked.
+
+   This is how to wait for an event signalled from another CPU:
+   hold LOCK while checking for the event and putting the
+   thread on a wait list, and have the waker hold LOCK while
+   taking it off and calling thread_unblock().  Then the waker
+   cannot try to unblock the thread before it has blocked.
+
+   WCHAN says what kind of event the thread is waiting for, for
+   its scheduler statistics. */
+void
+thread_block_spin (struct spinlock *lock, enum wait_channel wchan) 
+{
+  struct thread *curr = thread_current ();
+
   ASSERT (!intr_context ());
   ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (wchan < WCHAN_CNT);
 
-  thread_current ()->status = THREAD_BLOCKED;
+  spinlock_acquire (&curr->cpu->rq.lock);
+  curr->status = THREAD_BLOCKED;
+  curr->wchan = wchan;
+  stride_leave (&curr->cpu->rq, curr);
+  spinlock_release (lock);
   schedule ();
 }
 
-/* Transitions a blocked thread T to the ready-to-run state.
-   This is an error if T is not blocked.  (Use thread_yield() to
-   make the running thread ready.)
+/* Transitions a blocked thread T to the ready-to-run state, on
+   the run queue of the CPU it last ran on.  This is an error if
+   T is not blocked.  (Use thread_yield() to make the running
+   thread ready.)
 
    This function does not preempt the running thread.  This can
    be important: if the caller had disabled interrupts itself,
    it may expect that it can atomically unblock a thread and
-   update other data. */
+   update other data.  If T goes on another CPU that is idle or
+   running a lower-priority thread, though, that CPU is asked to
+   reschedule. */
 void
 thread_unblock (struct thread *t) 
 {
   enum intr_level old_level;
+  struct cpu *c;
+  int64_t now;
+  bool kick;
 
   ASSERT (is_thread (t));
 
   old_level = intr_disable ();
+  now = timer_ticks ();
+  c = t->cpu;
+  spinlock_acquire (&c->rq.lock);
   ASSERT (t->status == THREAD_BLOCKED);
-  list_push_back (&ready_list, &t->elem);
+  stride_join (&c->rq, t);
+  rq_push (&c->rq, t);
   t->status = THREAD_READY;
+  seqlock_write_begin (&t->stat_seq);
+  t->stat.blocked_ticks[t->wchan] += now - t->stat_stamp;
+  seqlock_write_end (&t->stat_seq);
+  t->stat_stamp = now;
+  kick = (c != cpu_current ()
+          && (c->curr == c->idle_thread || outranks (t, c->curr)));
+  spinlock_release (&c->rq.lock);
+
+  if (kick)
+    cpu_kick (c);
   intr_set_level (old_level);
 }
 
@@ -266,6 +682,19 @@ thread_current (void)
   return t;
 }
 
+/* Returns the CPU we're running on.  Before thread_init() has
+   set up the initial thread, that is the bootstrap processor.
+
+   The result is only stable while interrupts are off, since a
+   thread may be moved to another CPU while it is preempted. */
+struct cpu *
+cpu_current (void) 
+{
+  struct thread *t = running_thread ();
+
+  return is_thread (t) && t->cpu != NULL ? t->cpu : &cpus[0];
+}
+
 /* Returns the running thread's tid. */
 tid_t
 thread_tid (void) 
@@ -284,10 +713,35 @@ thread_exit (void)
   process_exit ();
 #endif
 
-  /* Just set our status to dying and schedule another process.
-     We will be destroyed during the call to schedule_tail(). */
+  if (thread_schedstat) 
+    {
+      struct thread *curr = thread_current ();
+      struct schedstat stat;
+
+      thread_get_schedstat (&stat);
+      print_schedstat (curr->tid, curr->name, &stat);
+    }
+
+  /* Give back the CPU time reserved for an EDF thread.  EDF
+     threads never move between CPUs. */
+  if (thread_current ()->edf_period != 0) 
+    {
+      struct thread *curr = thread_current ();
+      edf_unreserve (curr->cpu, edf_util (curr->edf_period,
+                                          curr->edf_budget,
+                                          curr->edf_rel_deadline));
+    }
+
+  /* Remove thread from all threads list, set our status to dying,
+     and schedule another process.  That process will destroy us
+     when it calls schedule_tail(). */
   intr_disable ();
+  spinlock_acquire (&all_lock);
+  list_remove (&thread_current ()->allelem);
+  spinlock_release (&all_lock);
+  spinlock_acquire (&thread_current ()->cpu->rq.lock);
   thread_current ()->status = THREAD_DYING;
+  stride_leave (&thread_current ()->cpu->rq, thread_current ());
   schedule ();
   NOT_REACHED ();
 }
@@ -303,80 +757,409 @@ thread_yield (void)
   ASSERT (!intr_context ());
 
   old_level = intr_disable ();
-  if (curr != idle_thread) 
-    list_push_back (&ready_list, &curr->elem);
+  spinlock_acquire (&curr->cpu->rq.lock);
+  if (!is_idle (curr)) 
+    rq_push (&curr->cpu->rq, curr);
   curr->status = THREAD_READY;
   schedule ();
   intr_set_level (old_level);
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
+/* Yields the CPU like thread_yield(), but counts the switch as
+   involuntary in the running thread's scheduler statistics.
+   Used when the running thread is preempted. */
+void
+thread_yield_preempted (void) 
+{
+  thread_current ()->preempted = true;
+  thread_yield ();
+}
+
+/* Gives up the rest of the running EDF thread's budget for its
+   current period, so that it does not run again until its next
+   period starts.  A periodic thread calls this when it has
+   finished its work for the period. */
+void
+thread_yield_period (void) 
+{
+  struct thread *curr = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (curr->edf_period != 0);
+
+  old_level = intr_disable ();
+  curr->edf_left = 0;
+  thread_yield ();
+  intr_set_level (old_level);
+}
+
+/* Returns the time at which the next throttled EDF thread on the
+   running CPU starts a new period, or INT64_MAX if there is no
+   such thread.  Must be called with interrupts off. */
+int64_t
+thread_next_release (void) 
+{
+  struct run_queue *rq = &cpu_current ()->rq;
+  int64_t next = INT64_MAX;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  spinlock_acquire (&rq->lock);
+  if (!list_empty (&rq->edf_waiting)) 
+    {
+      struct thread *t = list_entry (list_front (&rq->edf_waiting),
+                                     struct thread, elem);
+      next = t->edf_release + t->edf_period;
+    }
+  spinlock_release (&rq->lock);
+  return next;
+}
+
+/* Yields the CPU if a thread with higher priority than the
+   running thread is ready to run.  In an interrupt handler,
+   arranges for the yield to happen just before the interrupt
+   returns instead. */
+void
+thread_preempt (void) 
+{
+  enum intr_level old_level = intr_disable ();
+  struct thread *curr = thread_current ();
+  struct run_queue *rq = &curr->cpu->rq;
+  bool preempt;
+
+  spinlock_acquire (&rq->lock);
+  preempt = !is_idle (curr) && rq_preempts (rq, curr);
+  spinlock_release (&rq->lock);
+  intr_set_level (old_level);
+
+  if (!preempt)
+    return;
+  if (intr_context ())
+    intr_yield_on_return ();
+  else
+    thread_yield_preempted ();
+}
+
+/* Sets the current thread's base priority to NEW_PRIORITY.  Its
+   effective priority stays higher while a donation is in effect.
+   Yields if the running thread no longer has the highest
+   priority.  Ignored by the multi-level feedback queue
+   scheduler, which computes priorities itself, and for EDF
+   threads, which are scheduled by deadline. */
 void
 thread_set_priority (int new_priority) 
 {
-  thread_current ()->priority = new_priority;
+  ASSERT (PRI_MIN <= new_priority && new_priority <= PRI_MAX);
+
+  if (thread_mlfqs || thread_current ()->edf_period != 0)
+    return;
+  thread_current ()->base_priority = new_priority;
+  lock_update_priority (thread_current ());
+  thread_preempt ();
 }
 
-/* Returns the current thread's priority. */
+/* Sets T's effective priority to PRIORITY, on behalf of priority
+   donation in synch.c.  If T is ready, it moves to the run queue
+   list for its new priority, and its CPU is asked to reschedule
+   if T should now preempt the thread running there; likewise if
+   T is running on another CPU and no longer should.  The caller
+   must yield itself if T is the running thread and it may have
+   lost the highest priority.  EDF threads are not affected. */
+void
+thread_set_effective_priority (struct thread *t, int priority) 
+{
+  enum intr_level old_level;
+  struct run_queue *rq;
+  struct cpu *c;
+  bool kick = false;
+
+  ASSERT (is_thread (t));
+  ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
+
+  old_level = intr_disable ();
+  rq = lock_thread_rq (t);
+  c = t->cpu;
+  if (t->edf_period == 0 && t->priority != priority) 
+    {
+      if (t->status == THREAD_READY) 
+        {
+          rq_remove (rq, t);
+          t->priority = priority;
+          rq_push (rq, t);
+          kick = c != cpu_current () && outranks (t, c->curr);
+        }
+      else 
+        {
+          t->priority = priority;
+          kick = (t->status == THREAD_RUNNING && c != cpu_current ()
+                  && rq_preempts (rq, t));
+        }
+    }
+  spinlock_release (&rq->lock);
+
+  if (kick)
+    cpu_kick (c);
+  intr_set_level (old_level);
+}
+
+/* Returns the current thread's effective priority. */
 int
 thread_get_priority (void) 
 {
   return thread_current ()->priority;
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Sets the current thread's nice value to NICE and recomputes
+   its priority, yielding if it no longer has the highest
+   priority. */
 void
-thread_set_nice (int nice UNUSED) 
+thread_set_nice (int nice) 
 {
-  /* Not yet implemented. */
+  enum intr_level old_level;
+
+  ASSERT (NICE_MIN <= nice && nice <= NICE_MAX);
+
+  old_level = intr_disable ();
+  spinlock_acquire (&thread_current ()->cpu->rq.lock);
+  thread_current ()->nice = nice;
+  if (thread_mlfqs)
+    mlfqs_update_priority (thread_current ());
+  spinlock_release (&thread_current ()->cpu->rq.lock);
+  intr_set_level (old_level);
+
+  thread_preempt ();
+}
+
+/* Sets the current thread's tickets to TICKETS.  Under the
+   stride scheduler, a thread's share of its CPU is proportional
+   to its tickets. */
+void
+thread_set_tickets (int tickets) 
+{
+  struct thread *curr = thread_current ();
+  struct run_queue *rq;
+  enum intr_level old_level;
+
+  ASSERT (TICKETS_MIN <= tickets && tickets <= TICKETS_MAX);
+
+  old_level = intr_disable ();
+  rq = &curr->cpu->rq;
+  spinlock_acquire (&rq->lock);
+  if (curr->stride_counted) 
+    {
+      /* Scale the pass we have to go, so that we keep the same
+         place relative to the other threads. */
+      int64_t remain = curr->pass - rq->pass;
+      curr->pass = rq->pass + remain * curr->tickets / tickets;
+      rq->tickets += tickets - curr->tickets;
+    }
+  curr->tickets = tickets;
+  spinlock_release (&rq->lock);
+  intr_set_level (old_level);
+}
+
+/* Returns the current thread's tickets. */
+int
+thread_get_tickets (void) 
+{
+  return thread_current ()->tickets;
 }
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  return thread_current ()->nice;
 }
 
 /* Returns 100 times the system load average. */
 int
 thread_get_load_avg (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  /* LOAD_AVG is a single word, so reading it needs no lock. */
+  return fix_round (fix_scale (load_avg, 100));
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int recent_cpu_100 = fix_round (fix_scale (thread_current ()->recent_cpu,
+                                             100));
+  intr_set_level (old_level);
+
+  return recent_cpu_100;
+}
+
+/* Multi-level feedback queue scheduler.
+
+   Only the running thread accumulates recent_cpu between the
+   once-per-second decays, so every MLFQS_PRI_TICKS ticks only
+   its priority needs to be recomputed.  The once-per-second
+   update has to visit every thread to decay recent_cpu, but it
+   skips threads whose recent_cpu and nice are both 0, since
+   their recent_cpu, and therefore their priority, cannot
+   change; in practice that leaves only threads that have run
+   recently.  All of this runs in the timer interrupt; the
+   once-per-second update runs on the bootstrap processor only.
+
+   A thread's recent_cpu and priority are protected by the lock
+   on the run queue of its CPU.  A blocked thread whose priority
+   changes stays where it is in the heap of whatever it waits
+   for, so synch.c scans those heaps instead of trusting their
+   order; see waiter_pop(). */
+
+/* Per-tick MLFQS work for thread T, running on CPU C. */
+static void
+mlfqs_tick (struct cpu *c, struct thread *t) 
+{
+  int64_t now = timer_ticks ();
+  bool yield;
+
+  spinlock_acquire (&c->rq.lock);
+  if (t != c->idle_thread)
+    t->recent_cpu = fix_add (t->recent_cpu, fix_int (1));
+  spinlock_release (&c->rq.lock);
+
+  if (now % TIMER_FREQ == 0 && c == &cpus[0])
+    mlfqs_update_second ();
+
+  spinlock_acquire (&c->rq.lock);
+  if (now % MLFQS_PRI_TICKS == 0 && t != c->idle_thread)
+    mlfqs_update_priority (t);
+  yield = now % MLFQS_PRI_TICKS == 0 && rq_preempts (&c->rq, t);
+  spinlock_release (&c->rq.lock);
+
+  if (yield)
+    intr_yield_on_return ();
+}
+
+/* Updates the load average and decays every thread's
+   recent_cpu, as required once per second. */
+static void
+mlfqs_update_second (void) 
+{
+  struct list_elem *e;
+  fixed_point_t twice_load, coeff;
+  int ready_threads = 0;
+  int i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  /* load_avg = (59/60)*load_avg + (1/60)*ready_threads.  We
+     sample each CPU without locking it: the count only has to
+     be approximately right. */
+  for (i = 0; i < cpu_cnt; i++) 
+    {
+      struct cpu *c = &cpus[i];
+      if (c->started)
+        ready_threads += c->rq.cnt + (c->curr != c->idle_thread);
+    }
+  load_avg = fix_add (fix_mul (fix_frac (59, 60), load_avg),
+                      fix_scale (fix_frac (1, 60), ready_threads));
+
+  /* recent_cpu = (2*load_avg)/(2*load_avg + 1)*recent_cpu + nice. */
+  twice_load = fix_scale (load_avg, 2);
+  coeff = fix_div (twice_load, fix_add (twice_load, fix_int (1)));
+  spinlock_acquire (&all_lock);
+  for (e = list_begin (&all_list); e != list_end (&all_list);
+       e = list_next (e)) 
+    {
+      struct thread *t = list_entry (e, struct thread, allelem);
+      struct run_queue *rq;
+
+      if (is_idle (t) || (t->recent_cpu.f == 0 && t->nice == 0))
+        continue;
+      rq = lock_thread_rq (t);
+      t->recent_cpu = fix_add (fix_mul (coeff, t->recent_cpu),
+                               fix_int (t->nice));
+      mlfqs_update_priority (t);
+      spinlock_release (&rq->lock);
+    }
+  spinlock_release (&all_lock);
+}
+
+/* Recomputes T's priority from its recent_cpu and nice values,
+   moving it to the right run queue if it is ready.  If T is
+   ready, its run queue must be locked.  EDF threads keep
+   PRI_MAX. */
+static void
+mlfqs_update_priority (struct thread *t) 
+{
+  if (t->edf_period != 0)
+    return;
+
+  /* priority = PRI_MAX - (recent_cpu / 4) - (nice * 2). */
+  int priority = fix_trunc (fix_sub (fix_int (PRI_MAX - t->nice * 2),
+                                     fix_unscale (t->recent_cpu, 4)));
+  if (priority < PRI_MIN)
+    priority = PRI_MIN;
+  else if (priority > PRI_MAX)
+    priority = PRI_MAX;
+
+  if (priority == t->priority)
+    return;
+  if (t->status == THREAD_READY) 
+    {
+      rq_remove (&t->cpu->rq, t);
+      t->priority = priority;
+      rq_push (&t->cpu->rq, t);
+    }
+  else
+    t->priority = priority;
 }
 
 /* Idle thread.  Executes when no other thread is ready to run.
 
-   The idle thread is initially put on the ready list by
-   thread_start().  It will be scheduled once initially, at which
-   point it initializes idle_thread, "up"s the semaphore passed
-   to it to enable thread_start() to continue, and immediately
-   blocks.  After that, the idle thread never appears in the
-   ready list.  It is returned by next_thread_to_run() as a
-   special case when the ready list is empty. */
+   The bootstrap processor's idle thread is initially put on the
+   run queue by thread_start().  It will be scheduled once
+   initially, at which point it initializes its CPU's
+   idle_thread, "up"s the semaphore passed to it to enable
+   thread_start() to continue, and immediately blocks.  After
+   that, the idle thread never appears in the run queue.  It is
+   returned by next_thread_to_run() as a special case when the
+   run queue is empty.  Application processors start out running
+   their idle threads; see thread_create_idle(). */
 static void
 idle (void *idle_started_ UNUSED) 
 {
   struct semaphore *idle_started = idle_started_;
-  idle_thread = thread_current ();
+  enum intr_level old_level = intr_disable ();
+  cpu_current ()->idle_thread = thread_current ();
+  intr_set_level (old_level);
   sema_up (idle_started);
 
+  idle_loop ();
+}
+
+/* The idle thread's main loop. */
+static void
+idle_loop (void) 
+{
+  struct cpu *c = cpu_current ();
+
   for (;;) 
     {
       /* Let someone else run. */
       intr_disable ();
       thread_block ();
 
+      /* Nobody else wants to run, so zero pages ahead of time for
+         PAL_ZERO allocations.  We do it a page at a time, with
+         interrupts on, and check between pages whether a thread
+         has become ready here, so that it doesn't wait long. */
+      intr_enable ();
+      while (rq_empty (&c->rq) && palloc_zero_idle ())
+        continue;
+      intr_disable ();
+      if (!rq_empty (&c->rq))
+        continue;
+
+      /* In tickless mode, stop the periodic timer interrupt
+         until the next time it is needed. */
+      timer_idle_enter ();
+
       /* Re-enable interrupts and wait for the next one.
 
          The `sti' instruction disables interrupts until the
@@ -425,11 +1208,21 @@ is_thread (struct thread *t)
   return t != NULL && t->magic == THREAD_MAGIC;
 }
 
+/* Returns true if T is some CPU's idle thread.  Idle threads
+   never move between CPUs. */
+static bool
+is_idle (struct thread *t) 
+{
+  return t->cpu != NULL && t == t->cpu->idle_thread;
+}
+
 /* Does basic initialization of T as a blocked thread named
    NAME. */
 static void
 init_thread (struct thread *t, const char *name, int priority)
 {
+  enum intr_level old_level;
+
   ASSERT (t != NULL);
   ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
   ASSERT (name != NULL);
@@ -438,8 +1231,22 @@ init_thread (struct thread *t, const char *name, int priority)
   t->status = THREAD_BLOCKED;
   strlcpy (t->name, name, sizeof t->name);
   t->stack = (uint8_t *) t + PGSIZE;
-  t->priority = priority;
+  t->priority = t->base_priority = priority;
+  heap_init (&t->donors, lock_donor_less, NULL);
+  heap_init (&t->rw_donors, rw_donor_less, NULL);
+  t->nice = NICE_DEFAULT;
+  t->recent_cpu = fix_int (0);
+  t->tickets = TICKETS_DEFAULT;
+  t->remain = STRIDE1 / TICKETS_DEFAULT;
+  seqlock_init (&t->stat_seq);
+  t->stat_stamp = timer_ticks ();
   t->magic = THREAD_MAGIC;
+
+  old_level = intr_disable ();
+  spinlock_acquire (&all_lock);
+  list_push_back (&all_list, &t->allelem);
+  spinlock_release (&all_lock);
+  intr_set_level (old_level);
 }
 
 /* Allocates a SIZE-byte frame at the top of thread T's stack and
@@ -455,26 +1262,450 @@ alloc_frame (struct thread *t, size_t size)
   return t->stack;
 }
 
-/* Chooses and returns the next thread to be scheduled.  Should
-   return a thread from the run queue, unless the run queue is
-   empty.  (If the running thread can continue running, then it
-   will be in the run queue.)  If the run queue is empty, return
-   idle_thread. */
+/* Chooses the CPU on which to run a new thread: the started
+   CPU with the fewest ready threads, preferring the running CPU
+   when there is a tie. */
+static struct cpu *
+select_cpu (void) 
+{
+  struct cpu *best = cpu_current ();
+  int i;
+
+  for (i = 0; i < cpu_cnt; i++)
+    if (cpus[i].started && cpus[i].rq.cnt < best->rq.cnt)
+      best = &cpus[i];
+  return best;
+}
+
+/* Initializes RQ as empty. */
+static void
+rq_init (struct run_queue *rq) 
+{
+  int i;
+
+  spinlock_init (&rq->lock);
+  for (i = PRI_MIN; i <= PRI_MAX; i++)
+    list_init (&rq->lists[i]);
+  rq->mask = 0;
+  rq->cnt = 0;
+  heap_init (&rq->heap, pass_less, NULL);
+  rq->tickets = 0;
+  rq->pass = 0;
+  list_init (&rq->edf);
+  list_init (&rq->edf_waiting);
+}
+
+/* Adds T to the back of RQ's list for its priority, or, if T is
+   an EDF thread, to RQ's EDF lists. */
+static void
+rq_push (struct run_queue *rq, struct thread *t) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (t->edf_period != 0) 
+    {
+      edf_push (rq, t, timer_ticks ());
+      return;
+    }
+  if (thread_stride) 
+    {
+      heap_push (&rq->heap, &t->heap_elem);
+      rq->cnt++;
+      return;
+    }
+  list_push_back (&rq->lists[t->priority], &t->elem);
+  rq->mask |= (uint64_t) 1 << t->priority;
+  rq->cnt++;
+}
+
+/* Removes ready thread T, which must not be an EDF thread, from
+   RQ. */
+static void
+rq_remove (struct run_queue *rq, struct thread *t) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (t->status == THREAD_READY);
+  ASSERT (t->edf_period == 0);
+
+  if (thread_stride) 
+    {
+      heap_remove (&rq->heap, &t->heap_elem);
+      rq->cnt--;
+      return;
+    }
+  list_remove (&t->elem);
+  if (list_empty (&rq->lists[t->priority]))
+    rq->mask &= ~((uint64_t) 1 << t->priority);
+  rq->cnt--;
+}
+
+/* Removes and returns the frontmost thread of RQ's
+   highest-priority nonempty list, or with the stride scheduler
+   the thread with the least pass.  RQ must not be empty. */
+static struct thread *
+rq_pop (struct run_queue *rq) 
+{
+  int pri = rq_max_priority (rq);
+  struct thread *t;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (thread_stride) 
+    {
+      rq->cnt--;
+      return heap_entry (heap_pop (&rq->heap), struct thread, heap_elem);
+    }
+
+  ASSERT (pri >= PRI_MIN);
+
+  t = list_entry (list_pop_front (&rq->lists[pri]), struct thread, elem);
+  if (list_empty (&rq->lists[pri]))
+    rq->mask &= ~((uint64_t) 1 << pri);
+  rq->cnt--;
+  return t;
+}
+
+/* Returns the priority of the highest-priority thread in RQ, or
+   PRI_MIN - 1 if RQ is empty.  Uses the x86 "bsr" instruction
+   on each half of RQ's mask, because GCC would otherwise call
+   into libgcc for a 64-bit count. */
+static int
+rq_max_priority (const struct run_queue *rq) 
+{
+  uint32_t hi = rq->mask >> 32;
+  uint32_t lo = rq->mask;
+
+  if (hi != 0)
+    return 63 - __builtin_clz (hi);
+  else if (lo != 0)
+    return 31 - __builtin_clz (lo);
+  else
+    return PRI_MIN - 1;
+}
+
+/* Returns true if RQ has no ready threads, EDF or otherwise.
+   The idle thread calls this without RQ's lock, so the answer
+   may be out of date by the time it returns. */
+static bool
+rq_empty (struct run_queue *rq) 
+{
+  return rq->cnt == 0 && list_empty (&rq->edf);
+}
+
+/* Returns true if RQ holds a ready thread that should run
+   instead of T. */
+static bool
+rq_preempts (struct run_queue *rq, const struct thread *t) 
+{
+  if (!list_empty (&rq->edf))
+    return outranks (list_entry (list_front (&rq->edf),
+                                 struct thread, elem), t);
+  return (t->edf_period == 0 && !thread_stride
+          && rq_max_priority (rq) > t->priority);
+}
+
+/* Returns true if thread A should run in preference to thread
+   B: either A is an EDF thread and B is not, or both are and A
+   has the earlier deadline, or neither is and A has the higher
+   priority.  The stride scheduler does not preempt on
+   priority. */
+static bool
+outranks (const struct thread *a, const struct thread *b) 
+{
+  if (a->edf_period != 0)
+    return b->edf_period == 0 || a->edf_deadline < b->edf_deadline;
+  else
+    return (b->edf_period == 0 && !thread_stride
+            && a->priority > b->priority);
+}
+
+/* Adds T's tickets to RQ's total, now that T is about to become
+   ready on RQ's CPU after being blocked or on another CPU, and
+   gives it a pass that puts it as far ahead of or behind RQ's
+   global pass as it was when it left.  Thus, a thread neither
+   gains nor loses ground by blocking or moving between CPUs.
+   Does nothing unless the stride scheduler is in use.  RQ must
+   be locked. */
+static void
+stride_join (struct run_queue *rq, struct thread *t) 
+{
+  if (!thread_stride || t->edf_period != 0 || t->stride_counted)
+    return;
+
+  rq->tickets += t->tickets;
+  t->pass = rq->pass + t->remain;
+  t->stride_counted = true;
+}
+
+/* Removes T's tickets from RQ's total, because T is blocking,
+   exiting, or moving to another CPU, and remembers how far ahead
+   of or behind RQ's global pass it is.  RQ must be locked. */
+static void
+stride_leave (struct run_queue *rq, struct thread *t) 
+{
+  if (!t->stride_counted)
+    return;
+
+  rq->tickets -= t->tickets;
+  t->remain = t->pass - rq->pass;
+  t->stride_counted = false;
+}
+
+/* Moves half of VICTIM's ready threads, rounding up, to THIEF,
+   taking those with the least pass first.  Both run queues must
+   be locked. */
+static void
+stride_steal (struct cpu *thief, struct cpu *victim) 
+{
+  int cnt = (victim->rq.cnt + 1) / 2;
+
+  while (cnt-- > 0) 
+    {
+      struct thread *t = rq_pop (&victim->rq);
+      stride_leave (&victim->rq, t);
+      t->cpu = thief;
+      stride_join (&thief->rq, t);
+      rq_push (&thief->rq, t);
+      thief->steals++;
+    }
+}
+
+/* Returns true if thread A's pass is less than thread B's. */
+static bool
+pass_less (const struct heap_elem *a_, const struct heap_elem *b_,
+           void *aux UNUSED) 
+{
+  const struct thread *a = heap_entry (a_, struct thread, heap_elem);
+  const struct thread *b = heap_entry (b_, struct thread, heap_elem);
+
+  return a->pass < b->pass;
+}
+
+/* Returns the share of a CPU, in 0.1% units and rounded up,
+   needed by an EDF thread with the given PERIOD, BUDGET, and
+   DEADLINE. */
+static int
+edf_util (int period, int budget, int deadline) 
+{
+  int span = deadline < period ? deadline : period;
+  return (budget * 1000 + span - 1) / span;
+}
+
+/* Reserves UTIL of the started CPU that has the least reserved
+   for EDF threads, provided that does not take it over
+   EDF_UTIL_MAX.  Returns that CPU, or a null pointer if no CPU
+   has enough time left. */
+static struct cpu *
+edf_admit (int util) 
+{
+  struct cpu *best = NULL;
+  enum intr_level old_level;
+  int i;
+
+  old_level = intr_disable ();
+  spinlock_acquire (&edf_lock);
+  for (i = 0; i < cpu_cnt; i++) 
+    {
+      struct cpu *c = &cpus[i];
+      if (c->started && c->edf_util + util <= EDF_UTIL_MAX
+          && (best == NULL || c->edf_util < best->edf_util))
+        best = c;
+    }
+  if (best != NULL)
+    best->edf_util += util;
+  spinlock_release (&edf_lock);
+  intr_set_level (old_level);
+
+  return best;
+}
+
+/* Gives back UTIL reserved on CPU C by edf_admit(). */
+static void
+edf_unreserve (struct cpu *c, int util) 
+{
+  enum intr_level old_level = intr_disable ();
+  spinlock_acquire (&edf_lock);
+  c->edf_util -= util;
+  ASSERT (c->edf_util >= 0);
+  spinlock_release (&edf_lock);
+  intr_set_level (old_level);
+}
+
+/* Returns true if EDF thread A's deadline is earlier than B's. */
+static bool
+deadline_less (const struct list_elem *a_, const struct list_elem *b_,
+               void *aux UNUSED) 
+{
+  const struct thread *a = list_entry (a_, struct thread, elem);
+  const struct thread *b = list_entry (b_, struct thread, elem);
+
+  return a->edf_deadline < b->edf_deadline;
+}
+
+/* Returns true if EDF thread A's next period starts before
+   B's. */
+static bool
+release_less (const struct list_elem *a_, const struct list_elem *b_,
+              void *aux UNUSED) 
+{
+  const struct thread *a = list_entry (a_, struct thread, elem);
+  const struct thread *b = list_entry (b_, struct thread, elem);
+
+  return a->edf_release + a->edf_period < b->edf_release + b->edf_period;
+}
+
+/* Adds EDF thread T to RQ at time NOW.  If T's period is over, T
+   first starts a new one with its budget replenished.  Then T
+   goes on RQ's EDF list if it has budget left, or on the list of
+   throttled threads if it must wait for its next period. */
+static void
+edf_push (struct run_queue *rq, struct thread *t, int64_t now) 
+{
+  if (now >= t->edf_release + t->edf_period) 
+    {
+      /* Stay in phase, unless we fell more than a period
+         behind, as a thread that blocked for a while may. */
+      t->edf_release += t->edf_period;
+      if (t->edf_release + t->edf_period <= now)
+        t->edf_release = now;
+      t->edf_deadline = t->edf_release + t->edf_rel_deadline;
+      t->edf_left = t->edf_budget;
+    }
+
+  if (t->edf_left > 0)
+    list_insert_ordered (&rq->edf, &t->elem, deadline_less, NULL);
+  else
+    list_insert_ordered (&rq->edf_waiting, &t->elem, release_less, NULL);
+}
+
+/* Moves the throttled EDF threads on RQ whose next period has
+   started by time NOW to RQ's EDF list.  RQ must be locked. */
+static void
+edf_release (struct run_queue *rq, int64_t now) 
+{
+  while (!list_empty (&rq->edf_waiting)) 
+    {
+      struct thread *t = list_entry (list_front (&rq->edf_waiting),
+                                     struct thread, elem);
+      if (t->edf_release + t->edf_period > now)
+        break;
+      list_pop_front (&rq->edf_waiting);
+      edf_push (rq, t, now);
+    }
+}
+
+/* Chooses and returns the next thread to be scheduled on CPU C.
+   Should return a thread from C's run queue, unless the run
+   queue is empty.  (If the running thread can continue running,
+   then it will be in the run queue.)  EDF threads come first.
+   If the run queue is empty and no threads can be stolen from
+   other CPUs, return C's idle thread. */
 static struct thread *
-next_thread_to_run (void) 
+next_thread_to_run (struct cpu *c) 
 {
-  if (list_empty (&ready_list))
-    return idle_thread;
+  if (!list_empty (&c->rq.edf))
+    return list_entry (list_pop_front (&c->rq.edf), struct thread, elem);
+
+  if (c->rq.cnt == 0 && cpu_cnt > 1)
+    steal_threads (c);
+
+  if (c->rq.cnt == 0)
+    return c->idle_thread;
   else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+    return rq_pop (&c->rq);
+}
+
+/* Moves half of the ready threads of the CPU with the most ready
+   threads, rounding up, to the run queue of CPU THIEF, which
+   must be locked and empty.
+
+   Threads are taken in priority order, so that the
+   highest-priority threads waiting on the victim get to run
+   first.  Within a priority, threads whose last_cpu is the
+   victim are taken last, since their working sets are likely to
+   still be in the victim's caches.
+
+   We already hold THIEF's run queue lock, so we only try to
+   lock the victim's: two CPUs stealing from each other could
+   otherwise deadlock.  If the lock is busy we give up and try
+   again next time. */
+static void
+steal_threads (struct cpu *thief) 
+{
+  struct cpu *victim = NULL;
+  int cnt, pri, pass, i;
+
+  for (i = 0; i < cpu_cnt; i++) 
+    {
+      struct cpu *c = &cpus[i];
+      if (c != thief && c->started && c->rq.cnt > 0
+          && (victim == NULL || c->rq.cnt > victim->rq.cnt))
+        victim = c;
+    }
+  if (victim == NULL || !spinlock_try_acquire (&victim->rq.lock))
+    return;
+  if (thread_stride) 
+    {
+      stride_steal (thief, victim);
+      spinlock_release (&victim->rq.lock);
+      return;
+    }
+
+  cnt = (victim->rq.cnt + 1) / 2;
+  for (pri = PRI_MAX; pri >= PRI_MIN && cnt > 0; pri--)
+    {
+      struct list *list = &victim->rq.lists[pri];
+
+      if ((victim->rq.mask & ((uint64_t) 1 << pri)) == 0)
+        continue;
+      for (pass = 0; pass < 2 && cnt > 0; pass++) 
+        {
+          struct list_elem *e = list_begin (list);
+          while (e != list_end (list) && cnt > 0) 
+            {
+              struct thread *t = list_entry (e, struct thread, elem);
+              e = list_next (e);
+              if ((t->last_cpu == victim) != (pass == 1))
+                continue;
+
+              rq_remove (&victim->rq, t);
+              t->cpu = thief;
+              rq_push (&thief->rq, t);
+              thief->steals++;
+              cnt--;
+            }
+        }
+    }
+  spinlock_release (&victim->rq.lock);
+}
+
+/* Locks and returns the run queue of the CPU that T is on.  If T
+   is ready, another CPU may steal it until we hold the lock, so
+   we must check that T did not move while we were acquiring
+   it. */
+static struct run_queue *
+lock_thread_rq (struct thread *t) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (;;) 
+    {
+      struct cpu *c = t->cpu;
+      spinlock_acquire (&c->rq.lock);
+      if (c == t->cpu)
+        return &c->rq;
+      spinlock_release (&c->rq.lock);
+    }
 }
 
 /* Completes a thread switch by activating the new thread's page
    tables, and, if the previous thread is dying, destroying it.
 
    At this function's invocation, we just switched from thread
-   PREV, the new thread is already running, and interrupts are
-   still disabled.  This function is normally invoked by
+   PREV, the new thread is already running, interrupts are still
+   disabled, and we hold the running CPU's run queue lock, which
+   schedule() acquired on PREV's behalf and which we release
+   here.  This function is normally invoked by
    thread_schedule() as its final action before returning, but
    the first time a thread is scheduled it is called by
    switch_entry() (see switch.S).
@@ -489,14 +1720,42 @@ void
 schedule_tail (struct thread *prev) 
 {
   struct thread *curr = running_thread ();
+  struct cpu *c = curr->cpu;
+  bool prev_dying;
   
   ASSERT (intr_get_level () == INTR_OFF);
 
+#ifdef USERPROG
+  /* If we moved here from another CPU, we may have changed our
+     page tables since this CPU last had them loaded, so make
+     process_activate() reload them. */
+  if (curr->last_cpu != c && curr->pagedir != NULL
+      && c->pagedir == curr->pagedir)
+    c->pagedir = NULL;
+#endif
+
   /* Mark us as running. */
   curr->status = THREAD_RUNNING;
+  curr->last_cpu = c;
+  c->curr = curr;
 
   /* Start new time slice. */
-  thread_ticks = 0;
+  c->thread_ticks = 0;
+  rcu_quiescent ();
+
+  /* Charge the time since it was made ready as waiting time,
+     unless schedule() picked the same thread to run again, in
+     which case it never waited. */
+  if (prev != NULL) 
+    {
+      seqlock_write_begin (&curr->stat_seq);
+      curr->stat.ready_ticks += timer_ticks () - curr->stat_stamp;
+      seqlock_write_end (&curr->stat_seq);
+    }
+
+  /* Now that PREV is off its stack, other CPUs may touch it. */
+  prev_dying = prev != NULL && prev->status == THREAD_DYING;
+  spinlock_release (&c->rq.lock);
 
 #ifdef USERPROG
   /* Activate the new address space. */
@@ -508,17 +1767,18 @@ schedule_tail (struct thread *prev)
      pull out the rug under itself.  (We don't free
      initial_thread because its memory was not obtained via
      palloc().) */
-  if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread) 
+  if (prev_dying && prev != initial_thread) 
     {
       ASSERT (prev != curr);
       palloc_free_page (prev);
     }
 }
 
-/* Schedules a new process.  At entry, interrupts must be off and
-   the running process's state must have been changed from
-   running to some other state.  This function finds another
-   thread to run and switches to it.
+/* Schedules a new process.  At entry, interrupts must be off,
+   the running CPU's run queue must be locked, and the running
+   process's state must have been changed from running to some
+   other state.  This function finds another thread to run and
+   switches to it.
    
    It's not safe to call printf() until schedule_tail() has
    completed. */
@@ -526,15 +1786,38 @@ static void
 schedule (void) 
 {
   struct thread *curr = running_thread ();
-  struct thread *next = next_thread_to_run ();
+  struct thread *next = next_thread_to_run (curr->cpu);
   struct thread *prev = NULL;
+  bool preempted;
 
   ASSERT (intr_get_level () == INTR_OFF);
   ASSERT (curr->status != THREAD_RUNNING);
   ASSERT (is_thread (next));
 
-  if (curr != next)
-    prev = switch_threads (curr, next);
+  /* If the idle thread slept in tickless mode, whatever woke it
+     may have been an interrupt other than the timer's.  Bring
+     the tick count up to date before anything else runs. */
+  if (curr == curr->cpu->idle_thread)
+    timer_idle_exit ();
+
+  /* Update the outgoing thread's scheduler statistics, unless it
+     is about to run again, in which case there is no switch to
+     count.  A thread that blocks has given up the CPU voluntarily
+     even if it was asked to yield, so the preempted flag only
+     counts for a thread that is still ready. */
+  preempted = curr->preempted;
+  curr->preempted = false;
+  if (curr != next) 
+    {
+      seqlock_write_begin (&curr->stat_seq);
+      if (curr->status == THREAD_READY && preempted)
+        curr->stat.involuntary_switches++;
+      else
+        curr->stat.voluntary_switches++;
+      seqlock_write_end (&curr->stat_seq);
+      curr->stat_stamp = timer_ticks ();
+      prev = switch_threads (curr, next);
+    }
   schedule_tail (prev); 
 }
 
@@ -551,7 +1834,3 @@ allocate_tid (void)
 
   return tid;
 }
-
-/* Offset of `stack' member within `struct thread'.
-   Used by switch.S, which can't figure it out on its own. */
-uint32_t thread_stack_ofs = offsetof (struct thread, stack);
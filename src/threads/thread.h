@@ -2,8 +2,18 @@
 #define THREADS_THREAD_H
 
 #include <debug.h>
+#include <heap.h>
 #include <list.h>
+#include <schedstat.h>
 #include <stdint.h>
+#include "threads/fixed-point.h"
+#include "threads/lockdep.h"
+#include "threads/synch.h"
+
+struct cond_waiter;
+struct cpu;
+struct lock;
+struct spinlock;
 
 /* States in a thread's life cycle. */
 enum thread_status
@@ -24,6 +34,17 @@ typedef int tid_t;
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Thread niceness, for the multi-level feedback queue
+   scheduler. */
+#define NICE_MIN -20                    /* Nicest to others. */
+#define NICE_DEFAULT 0                  /* Default niceness. */
+#define NICE_MAX 20                     /* Least nice to others. */
+
+/* Thread tickets, for the stride scheduler. */
+#define TICKETS_MIN 1                   /* Smallest share. */
+#define TICKETS_DEFAULT 100             /* Default share. */
+#define TICKETS_MAX 1000                /* Largest share. */
+
 /* A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -79,7 +100,10 @@ typedef int tid_t;
    semaphore wait list (synch.c).  It can be used these two ways
    only because they are mutually exclusive: only a thread in the
    ready state is on the run queue, whereas only a thread in the
-   blocked state is on a semaphore wait list. */
+   blocked state is on a semaphore wait list.  In the same way,
+   `heap_elem' is either in the stride scheduler's run queue heap
+   or in a lock's, semaphore's, or readers-writer lock's heap of
+   waiting threads. */
 struct thread
   {
     /* Owned by thread.c. */
@@ -87,7 +111,57 @@ struct thread
     enum thread_status status;          /* Thread state. */
     char name[16];                      /* Name (for debugging purposes). */
     uint8_t *stack;                     /* Saved stack pointer. */
-    int priority;                       /* Priority. */
+    int priority;                       /* Effective priority. */
+    int base_priority;                  /* Priority before donation. */
+    struct list_elem allelem;           /* List element for all threads list. */
+    struct cpu *cpu;                    /* CPU it runs, or is queued, on. */
+    struct cpu *last_cpu;               /* CPU it last ran on, if any. */
+
+    /* Multi-level feedback queue scheduler. */
+    int nice;                           /* Niceness. */
+    fixed_point_t recent_cpu;           /* Recent CPU time, decayed. */
+
+    /* Stride scheduler. */
+    int tickets;                        /* Share of the CPU. */
+    bool stride_counted;                /* Tickets in its CPU's total? */
+    int64_t pass;                       /* Pass, while counted. */
+    int64_t remain;                     /* Pass to go, while not. */
+    struct heap_elem heap_elem;         /* Heap element (see below). */
+
+    /* Earliest-deadline-first class.  All times in timer ticks. */
+    int edf_period;                     /* Period, or 0 if not EDF. */
+    int edf_budget;                     /* Run time per period. */
+    int edf_rel_deadline;               /* Deadline, relative to release. */
+    int edf_left;                       /* Budget left in this period. */
+    int64_t edf_release;                /* Start of this period. */
+    int64_t edf_deadline;               /* Absolute deadline. */
+
+    /* Priority donation (synch.c), under its donation lock,
+       except that waiting_sema is under the semaphore's. */
+    struct heap donors;                 /* Held locks with waiters, by
+                                           top waiter's priority. */
+    struct lock *waiting_lock;          /* Lock being waited for. */
+    struct semaphore *waiting_sema;     /* Semaphore being waited for. */
+    struct cond_waiter *waiting_cond;   /* Condition wait, if any. */
+    struct rwlock *waiting_rw;          /* Readers-writer lock waited for. */
+    bool waiting_rw_write;              /* Waiting on it as a writer? */
+    unsigned wait_seq;                  /* Arrival order at any of them. */
+    struct rw_hold rw_holds[RW_HOLD_MAX]; /* Readers-writer locks held. */
+    struct heap rw_donors;              /* RW_HOLDS with waiters, by
+                                           top waiter's priority. */
+
+#ifdef LOCKDEP
+    /* Lock order validation (lockdep.c). */
+    struct lock *held_locks[LOCKDEP_HELD_MAX]; /* Locks held. */
+    int held_lock_cnt;                  /* Number of HELD_LOCKS. */
+#endif
+
+    /* Scheduler statistics. */
+    struct schedstat stat;              /* Counters (under stat_seq). */
+    struct seqlock stat_seq;            /* Lets other threads read STAT. */
+    int64_t stat_stamp;                 /* Time of last state change. */
+    enum wait_channel wchan;            /* What it is blocked on. */
+    bool preempted;                     /* Yielding involuntarily? */
 
     /* Shared between thread.c and synch.c. */
     struct list_elem elem;              /* List element. */
@@ -103,20 +177,38 @@ struct thread
 
 /* If false (default), use round-robin scheduler.
    If true, use multi-level feedback queue scheduler.
-   Controlled by kernel command-line option "-o mlfqs". */
+   Controlled by kernel command-line option "-mlfqs". */
 extern bool thread_mlfqs;
 
+/* If true, use the stride scheduler, which shares the CPU in
+   proportion to each thread's tickets.  Controlled by kernel
+   command-line option "-stride". */
+extern bool thread_stride;
+
+/* If true, print each thread's scheduler statistics when it
+   exits and at shutdown.  Controlled by kernel command-line
+   option "-o=schedstat". */
+extern bool thread_schedstat;
+
 void thread_init (void);
 void thread_start (void);
+struct thread *thread_create_idle (struct cpu *);
+void thread_start_ap (void) NO_RETURN;
 
 void thread_tick (void);
 void thread_print_stats (void);
+void thread_print_schedstats (void);
+void thread_get_schedstat (struct schedstat *);
 
 typedef void thread_func (void *aux);
 tid_t thread_create (const char *name, int priority, thread_func *, void *);
+tid_t thread_create_deadline (const char *name, int period, int budget,
+                              int deadline, thread_func *, void *);
 
 void thread_block (void);
+void thread_block_spin (struct spinlock *, enum wait_channel);
 void thread_unblock (struct thread *);
+void thread_set_effective_priority (struct thread *, int);
 
 struct thread *thread_current (void);
 tid_t thread_tid (void);
@@ -124,10 +216,17 @@ const char *thread_name (void);
 
 void thread_exit (void) NO_RETURN;
 void thread_yield (void);
+void thread_yield_preempted (void);
+void thread_yield_period (void);
+int64_t thread_next_release (void);
+void thread_preempt (void);
 
 int thread_get_priority (void);
 void thread_set_priority (int);
 
+int thread_get_tickets (void);
+void thread_set_tickets (int);
+
 int thread_get_nice (void);
 void thread_set_nice (int);
 int thread_get_recent_cpu (void);
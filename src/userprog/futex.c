@@ -0,0 +1,185 @@
+#include "userprog/futex.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Fast user-space mutexes ("futexes").
+
+   A user program builds its locks out of ordinary words in its
+   own memory, which it updates with atomic instructions, and
+   only enters the kernel when it has to sleep or to wake up a
+   thread that is sleeping.  See lib/user/synch.c, and "Futexes
+   Are Tricky" by Ulrich Drepper.
+
+   futex_wait() puts the calling thread to sleep on the wait
+   queue for a word in its address space, but only if the word
+   still holds the value that the caller expects, and
+   futex_wake() wakes threads waiting on a word.  The wait queues
+   are kept in a hash table keyed by page directory and user
+   virtual address, and exist only while they have waiters.  A
+   single lock protects the whole table; because futex_wait()
+   checks the word while holding it, a futex_wake() for a change
+   made to the word just before cannot slip in between the check
+   and the sleep. */
+
+/* Wait queue for one user word. */
+struct futex_queue
+  {
+    struct hash_elem elem;      /* Element in `queues'. */
+    uint32_t *pagedir;          /* Address space. */
+    int *uaddr;                 /* User virtual address. */
+    struct list waiters;        /* List of struct futex_waiter. */
+  };
+
+/* A thread sleeping in futex_wait(). */
+struct futex_waiter
+  {
+    struct list_elem elem;      /* Element in futex_queue's list. */
+    struct thread *thread;      /* Sleeping thread. */
+    struct semaphore sema;      /* Upped to wake the thread. */
+  };
+
+/* Wait queues, keyed by address space and address. */
+static struct hash queues;
+static struct lock queues_lock;
+
+static hash_hash_func queue_hash;
+static hash_less_func queue_less;
+static struct futex_queue *find_queue (int *uaddr);
+
+/* Initializes the futex wait queues. */
+void
+futex_init (void)
+{
+  hash_init (&queues, queue_hash, queue_less, NULL);
+  lock_init (&queues_lock);
+}
+
+/* If the user word at UADDR, which the caller must have checked
+   to be mapped and aligned, still contains VAL, sleeps until
+   futex_wake() is called on UADDR and returns true.  Otherwise,
+   returns false immediately. */
+bool
+futex_wait (int *uaddr, int val)
+{
+  struct futex_queue *q;
+  struct futex_waiter w;
+
+  lock_acquire (&queues_lock);
+  if (*(volatile int *) uaddr != val)
+    {
+      lock_release (&queues_lock);
+      return false;
+    }
+
+  q = find_queue (uaddr);
+  if (q == NULL)
+    {
+      q = malloc (sizeof *q);
+      if (q == NULL)
+        {
+          /* Let the caller retry, as after a spurious wakeup. */
+          lock_release (&queues_lock);
+          return true;
+        }
+      q->pagedir = thread_current ()->pagedir;
+      q->uaddr = uaddr;
+      list_init (&q->waiters);
+      hash_insert (&queues, &q->elem);
+    }
+
+  w.thread = thread_current ();
+  sema_init (&w.sema, 0);
+  list_push_back (&q->waiters, &w.elem);
+  lock_release (&queues_lock);
+
+  /* If futex_wake() gets to us first, this returns at once. */
+  sema_down (&w.sema);
+  return true;
+}
+
+/* Returns true if waiter A's thread has lower priority than
+   waiter B's. */
+static bool
+waiter_less (const struct list_elem *a_, const struct list_elem *b_,
+             void *aux UNUSED)
+{
+  const struct futex_waiter *a = list_entry (a_, struct futex_waiter, elem);
+  const struct futex_waiter *b = list_entry (b_, struct futex_waiter, elem);
+
+  return a->thread->priority < b->thread->priority;
+}
+
+/* Wakes up to CNT threads waiting on UADDR, highest priority
+   first, and returns the number woken. */
+int
+futex_wake (int *uaddr, int cnt)
+{
+  struct futex_queue *q;
+  int woken = 0;
+
+  lock_acquire (&queues_lock);
+  q = find_queue (uaddr);
+  if (q != NULL)
+    {
+      while (woken < cnt && !list_empty (&q->waiters))
+        {
+          struct list_elem *e = list_max (&q->waiters, waiter_less, NULL);
+          struct futex_waiter *w = list_entry (e, struct futex_waiter, elem);
+
+          list_remove (e);
+          sema_up (&w->sema);
+          woken++;
+        }
+      if (list_empty (&q->waiters))
+        {
+          hash_delete (&queues, &q->elem);
+          free (q);
+        }
+    }
+  lock_release (&queues_lock);
+  return woken;
+}
+
+/* Returns the wait queue for UADDR in the running thread's
+   address space, or a null pointer if it has no waiters.
+   queues_lock must be held. */
+static struct futex_queue *
+find_queue (int *uaddr)
+{
+  struct futex_queue key;
+  struct hash_elem *e;
+
+  key.pagedir = thread_current ()->pagedir;
+  key.uaddr = uaddr;
+  e = hash_find (&queues, &key.elem);
+  return e != NULL ? hash_entry (e, struct futex_queue, elem) : NULL;
+}
+
+/* Returns a hash value for futex_queue E. */
+static unsigned
+queue_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct futex_queue *q = hash_entry (e, struct futex_queue, elem);
+  uintptr_t key[2];
+
+  key[0] = (uintptr_t) q->pagedir;
+  key[1] = (uintptr_t) q->uaddr;
+  return hash_bytes (key, sizeof key);
+}
+
+/* Returns true if futex_queue A precedes futex_queue B. */
+static bool
+queue_less (const struct hash_elem *a_, const struct hash_elem *b_,
+            void *aux UNUSED)
+{
+  const struct futex_queue *a = hash_entry (a_, struct futex_queue, elem);
+  const struct futex_queue *b = hash_entry (b_, struct futex_queue, elem);
+
+  if (a->pagedir != b->pagedir)
+    return a->pagedir < b->pagedir;
+  return a->uaddr < b->uaddr;
+}
@@ -1,13 +1,20 @@
 #include "userprog/pagedir.h"
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
 #include <string.h>
+#include "threads/cpu.h"
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
 
 static uint32_t *active_pd (void);
+static void load_pagedir (uint32_t *);
 static void invalidate_pagedir (uint32_t *);
+static void unload_everywhere (uint32_t *);
 
 /* Creates a new page directory that has mappings for kernel
    virtual addresses, but none for user virtual addresses.
@@ -33,6 +40,7 @@ pagedir_destroy (uint32_t *pd)
     return;
 
   ASSERT (pd != base_page_dir);
+  unload_everywhere (pd);
   for (pde = pd; pde < pd + pd_no (PHYS_BASE); pde++)
     if (*pde & PTE_P) 
       {
@@ -136,6 +144,22 @@ pagedir_get_page (uint32_t *pd, const void *uaddr)
     return NULL;
 }
 
+/* Returns true if user virtual address UADDR is mapped in PD
+   and the mapping is writable.  The processor checks write
+   permission on kernel accesses too (see CR0_WP in start.S), so
+   the kernel must not write to a page for which this is
+   false. */
+bool
+pagedir_is_writable (uint32_t *pd, const void *uaddr) 
+{
+  uint32_t *pte;
+
+  ASSERT (is_user_vaddr (uaddr));
+
+  pte = lookup_page (pd, uaddr, false);
+  return pte != NULL && (*pte & (PTE_P | PTE_W)) == (PTE_P | PTE_W);
+}
+
 /* Marks user virtual page UPAGE "not present" in page
    directory PD.  Later accesses to the page will fault.  Other
    bits in the page table entry are preserved.
@@ -215,19 +239,82 @@ pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed)
 }
 
 /* Loads page directory PD into the CPU's page directory base
-   register. */
+   register, or the base page directory if PD is null.
+
+   Loading CR3 flushes the TLB's non-global entries, so we skip
+   it if PD is already loaded.  That is always the case when we
+   switch between threads of one process, and often the case
+   when we switch back to a process from a kernel thread, since
+   kernel threads just keep whatever page directory is loaded
+   (see process_activate()). */
 void
 pagedir_activate (uint32_t *pd) 
 {
+  enum intr_level old_level;
+
   if (pd == NULL)
     pd = base_page_dir;
 
+  old_level = intr_disable ();
+  if (cpu_current ()->pagedir != pd)
+    load_pagedir (pd);
+  else
+    cpu_current ()->cr3_skips++;
+  intr_set_level (old_level);
+}
+
+/* Prints how many times CR3 was loaded and how many loads
+   pagedir_activate() skipped because the page directory was
+   already loaded.  Without the skip, there would have been as
+   many loads as the two counts added together. */
+void
+pagedir_print_stats (void) 
+{
+  long long loads = 0, skips = 0;
+  int i;
+
+  for (i = 0; i < cpu_cnt; i++) 
+    {
+      loads += cpus[i].cr3_loads;
+      skips += cpus[i].cr3_skips;
+    }
+  printf ("Paging: %lld CR3 loads, %lld skipped as already loaded\n",
+          loads, skips);
+}
+
+/* Called on a CPU that another CPU wants to stop using a page
+   directory it is about to destroy, with interrupts off.  If the
+   running thread does not own the page directory that is
+   loaded, that is, it is a kernel thread that kept running on
+   some process's page directory, switches to the base page
+   directory instead. */
+void
+pagedir_release (void) 
+{
+  struct cpu *c = cpu_current ();
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (c->pagedir != base_page_dir && c->pagedir != thread_current ()->pagedir)
+    load_pagedir (base_page_dir);
+}
+
+/* Loads PD into CR3 on the running CPU, which flushes its TLB
+   even if PD was already loaded. */
+static void
+load_pagedir (uint32_t *pd) 
+{
+  enum intr_level old_level = intr_disable ();
+
   /* Store the physical address of the page directory into CR3
      aka PDBR (page directory base register).  This activates our
      new page tables immediately.  See [IA32-v2a] "MOV--Move
      to/from Control Registers" and [IA32-v3a] 3.7.5 "Base
      Address of the Page Directory". */
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (pd)) : "memory");
+  cpu_current ()->pagedir = pd;
+  cpu_current ()->cr3_loads++;
+  intr_set_level (old_level);
 }
 
 /* Returns the currently active page directory. */
@@ -258,6 +345,35 @@ invalidate_pagedir (uint32_t *pd)
     {
       /* Re-activating PD clears the TLB.  See [IA32-v3a] 3.12
          "Translation Lookaside Buffers (TLBs)". */
-      pagedir_activate (pd);
+      load_pagedir (pd);
     } 
 }
+
+/* Makes sure that no CPU has PD loaded, so that it may be freed.
+   A CPU running a kernel thread may have kept PD loaded after
+   its process stopped running there, so we ask each such CPU to
+   let go of it and wait until it has. */
+static void
+unload_everywhere (uint32_t *pd) 
+{
+  int i;
+
+  for (i = 0; i < cpu_cnt; i++) 
+    {
+      struct cpu *c = &cpus[i];
+      enum intr_level old_level;
+
+      if (c->pagedir != pd)
+        continue;
+
+      old_level = intr_disable ();
+      if (c == cpu_current ())
+        load_pagedir (base_page_dir);
+      else
+        cpu_release_pagedir (c);
+      intr_set_level (old_level);
+
+      while (c->pagedir == pd)
+        barrier ();
+    }
+}
@@ -124,8 +124,13 @@ process_activate (void)
 {
   struct thread *t = thread_current ();
 
-  /* Activate thread's page tables. */
-  pagedir_activate (t->pagedir);
+  /* Activate thread's page tables.  A kernel thread never
+     touches user memory, so it just keeps running on whatever
+     page directory is loaded.  Switching from a process to a
+     kernel thread and back to the process then needs no CR3
+     reload at all. */
+  if (t->pagedir != NULL)
+    pagedir_activate (t->pagedir);
 
   /* Set thread's kernel stack for use in processing
      interrupts. */
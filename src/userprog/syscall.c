@@ -1,20 +1,120 @@
 #include "userprog/syscall.h"
 #include <stdio.h>
+#include <schedstat.h>
 #include <syscall-nr.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/futex.h"
+#include "userprog/pagedir.h"
 
 static void syscall_handler (struct intr_frame *);
+static bool is_user_range (const void *, size_t, bool writable);
+static bool is_user_word (const int *);
+static bool sys_schedstat (struct schedstat *);
+static int sys_futex_wait (int *, int);
+static int sys_futex_wake (int *, int);
 
 void
 syscall_init (void) 
 {
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
+  futex_init ();
 }
 
 static void
-syscall_handler (struct intr_frame *f UNUSED) 
+syscall_handler (struct intr_frame *f) 
 {
+  const uint32_t *args = f->esp;
+
+  if (is_user_range (args, sizeof *args, false))
+    switch (args[0])
+      {
+      case SYS_SCHEDSTAT:
+        if (!is_user_range (args, 2 * sizeof *args, false))
+          break;
+        f->eax = sys_schedstat ((struct schedstat *) args[1]);
+        return;
+
+      case SYS_FUTEX_WAIT:
+        if (!is_user_range (args, 3 * sizeof *args, false))
+          break;
+        f->eax = sys_futex_wait ((int *) args[1], args[2]);
+        return;
+
+      case SYS_FUTEX_WAKE:
+        if (!is_user_range (args, 3 * sizeof *args, false))
+          break;
+        f->eax = sys_futex_wake ((int *) args[1], args[2]);
+        return;
+      }
+
   printf ("system call!\n");
   thread_exit ();
 }
+
+/* Returns true if the SIZE bytes starting at user virtual
+   address UADDR are all mapped in the running process's page
+   directory, and if WRITABLE is true, that they are all
+   writable as well. */
+static bool
+is_user_range (const void *uaddr, size_t size, bool writable)
+{
+  uint32_t *pd = thread_current ()->pagedir;
+  const uint8_t *p = uaddr;
+  const uint8_t *end = p + size;
+
+  if (size == 0)
+    return true;
+  if (end < p || !is_user_vaddr (end - 1))
+    return false;
+  for (p = pg_round_down (p); p < end; p += PGSIZE)
+    if (writable ? !pagedir_is_writable (pd, p)
+        : pagedir_get_page (pd, p) == NULL)
+      return false;
+  return true;
+}
+
+/* Returns true if UADDR is a mapped, properly aligned user
+   word. */
+static bool
+is_user_word (const int *uaddr)
+{
+  return (uintptr_t) uaddr % sizeof *uaddr == 0
+         && is_user_range (uaddr, sizeof *uaddr, false);
+}
+
+/* schedstat() system call: copies the running thread's scheduler
+   statistics into the user buffer ST.  Returns false if ST is
+   not a writable user buffer. */
+static bool
+sys_schedstat (struct schedstat *st)
+{
+  if (!is_user_range (st, sizeof *st, true))
+    return false;
+  thread_get_schedstat (st);
+  return true;
+}
+
+/* futex_wait() system call: sleeps until futex_wake() is called
+   on UADDR, provided that the word at UADDR still contains VAL.
+   Returns 0 after sleeping, or -1 if the word did not contain
+   VAL or UADDR is invalid. */
+static int
+sys_futex_wait (int *uaddr, int val)
+{
+  if (!is_user_word (uaddr))
+    return -1;
+  return futex_wait (uaddr, val) ? 0 : -1;
+}
+
+/* futex_wake() system call: wakes up to CNT threads sleeping on
+   UADDR.  Returns the number woken, or -1 if UADDR is
+   invalid. */
+static int
+sys_futex_wake (int *uaddr, int cnt)
+{
+  if (!is_user_word (uaddr))
+    return -1;
+  return futex_wake (uaddr, cnt);
+}